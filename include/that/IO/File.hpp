@@ -7,7 +7,8 @@
 
 namespace that
 {
-	Result ReadFile(std::filesystem::path const& path, std::vector<uint8_t> & res);
+	// Reads at most max_size bytes from the start of the file
+	Result ReadFile(std::filesystem::path const& path, std::vector<uint8_t> & res, size_t max_size = size_t(-1));
 
 	Result ReadFileToString(std::filesystem::path const& path, std::string & res);
 
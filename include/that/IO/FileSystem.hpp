@@ -8,6 +8,7 @@
 #include <shared_mutex>
 
 #include <that/IO/MountingPoints.hpp>
+#include <that/IO/MappedFile.hpp>
 #include <that/utils/StringSet.hpp>
 #include <that/core/Result.hpp>
 #include <that/core/Core.hpp>
@@ -195,12 +196,17 @@ namespace that
 		bool isCannon(PathStringView const& path) const;
 		bool isCannon(Path const& path) const;
 
+		// The path to give to the OS: path itself without fs or with Hint::PathIsNative, else fs->resolve(path)
+		static ResultAnd<Path> ResolveFilePath(Path const& path, Hint hint = Hint::None, FileSystem * fs = nullptr);
+
 		struct ReadFileInfo
 		{
 			Hint hint = Hint::None;
 			const Path * path = nullptr;
 			std::vector<uint8_t> * result_vector = nullptr;
 			std::string * result_string = nullptr;
+			// Only the first max_size bytes (with result_vector)
+			size_t max_size = size_t(-1);
 		};
 		Result readFile(ReadFileInfo const& info);
 
@@ -218,6 +224,18 @@ namespace that
 		static Result WriteFileToDisk(WriteFileInfo const& info);
 		static Result WriteFile(WriteFileInfo const& info, FileSystem * fs = nullptr);
 
+		struct MapFileInfo
+		{
+			Hint hint = Hint::None;
+			const Path * path = nullptr;
+			MappedFile * result = nullptr;
+			bool copy_on_write = true;
+		};
+		Result mapFile(MapFileInfo const& info);
+
+		static Result MapFileFromDisk(MapFileInfo const& info);
+		static Result MapFile(MapFileInfo const& info, FileSystem * fs = nullptr);
+
 		ResultAnd<TimePoint> getFileLastWriteTime(Path const& path, Hint hint = Hint::None) const;
 
 		Result checkFileExists(Path const& path, Hint hint = Hint::None) const;
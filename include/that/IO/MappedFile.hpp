@@ -0,0 +1,72 @@
+#pragma once
+
+#include <filesystem>
+#include <span>
+#include <cstdint>
+
+#include <that/core/Result.hpp>
+
+namespace that
+{
+	// Read only file mapped in memory
+	// With copy_on_write, the pages can be modified: the modified pages become private copies, the file is never written
+	class MappedFile
+	{
+	protected:
+
+		uint8_t* _data = nullptr;
+		size_t _size = 0;
+
+#if _WINDOWS
+		void* _file = nullptr;
+		void* _mapping = nullptr;
+#else
+		int _fd = -1;
+#endif
+
+	public:
+
+		MappedFile() = default;
+
+		MappedFile(MappedFile const&) = delete;
+		MappedFile& operator=(MappedFile const&) = delete;
+
+		MappedFile(MappedFile&& other) noexcept;
+		MappedFile& operator=(MappedFile&& other) noexcept;
+
+		~MappedFile();
+
+		Result open(std::filesystem::path const& path, bool copy_on_write = true);
+
+		void close();
+
+		bool isOpen() const
+		{
+#if _WINDOWS
+			return _file != nullptr;
+#else
+			return _fd >= 0;
+#endif
+		}
+
+		uint8_t* data()
+		{
+			return _data;
+		}
+
+		const uint8_t* data() const
+		{
+			return _data;
+		}
+
+		size_t size() const
+		{
+			return _size;
+		}
+
+		std::span<const uint8_t> span() const
+		{
+			return std::span<const uint8_t>(_data, _size);
+		}
+	};
+}
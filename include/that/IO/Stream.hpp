@@ -0,0 +1,176 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <that/core/Result.hpp>
+#include <that/utils/ExtensibleDataStorage.hpp>
+
+namespace that
+{
+	// Sequential byte sinks and sources, for the writers and readers that don't materialize the whole file
+	class OutputStream
+	{
+	public:
+
+		virtual ~OutputStream() = default;
+
+		virtual Result write(std::span<const uint8_t> data) = 0;
+
+		virtual Result flush()
+		{
+			return Result::Success;
+		}
+	};
+
+	class InputStream
+	{
+	public:
+
+		virtual ~InputStream() = default;
+
+		// read_count < dst.size() only at the end of the stream
+		virtual Result read(std::span<uint8_t> dst, size_t& read_count) = 0;
+	};
+
+	class FileOutputStream : public OutputStream
+	{
+	protected:
+
+		std::ofstream _file;
+
+	public:
+
+		FileOutputStream() = default;
+
+		// Truncates the file if it exists
+		Result open(std::filesystem::path const& path, bool create_directories = true);
+
+		Result close();
+
+		bool isOpen() const
+		{
+			return _file.is_open();
+		}
+
+		virtual Result write(std::span<const uint8_t> data) override;
+
+		virtual Result flush() override;
+	};
+
+	// Writes to a temporary file next to the destination, renamed over it by commit()
+	// The destination is untouched until then: a failed (or abandoned) write leaves an existing file as it was
+	class AtomicFileOutputStream : public FileOutputStream
+	{
+	protected:
+
+		std::filesystem::path _path = {};
+		std::filesystem::path _tmp_path = {};
+
+	public:
+
+		AtomicFileOutputStream() = default;
+
+		~AtomicFileOutputStream();
+
+		Result open(std::filesystem::path const& path, bool create_directories = true);
+
+		// Closes the temporary file and renames it over the destination (the temporary file is removed if that fails)
+		// Does nothing if the stream is not open
+		Result commit();
+
+		// Closes and removes the temporary file
+		void discard();
+	};
+
+	// Appends the writes to a storage (which must outlive the stream)
+	class MemoryOutputStream : public OutputStream
+	{
+	protected:
+
+		ExtensibleDataStorage& _storage;
+
+	public:
+
+		MemoryOutputStream(ExtensibleDataStorage& storage) :
+			_storage(storage)
+		{}
+
+		virtual Result write(std::span<const uint8_t> data) override;
+	};
+
+	// Double buffered sink: the writes are gathered in a buffer, a full buffer is written to the target by a background thread while the next one is filled
+	// Takes at most 2 * buffer_size bytes, the thread is only started if more than buffer_size bytes are written
+	class AsyncBufferedOutputStream : public OutputStream
+	{
+	protected:
+
+		OutputStream& _target;
+		size_t _buffer_size = 0;
+		std::vector<uint8_t> _filling = {};
+		// Owned by the writer thread while _has_pending
+		std::vector<uint8_t> _pending = {};
+		bool _has_pending = false;
+		bool _stop = false;
+		// First error of the target (sticky)
+		Result _result = Result::Success;
+
+		std::thread _thread = {};
+		std::mutex _mutex;
+		std::condition_variable _condition;
+
+		void writerLoop();
+
+		// Hands _filling to the writer thread (waits for the previous buffer to be written)
+		void submit();
+
+		// Waits for the pending buffer to be written
+		Result wait();
+
+	public:
+
+		AsyncBufferedOutputStream(OutputStream& target, size_t buffer_size = size_t(1) << 20);
+
+		AsyncBufferedOutputStream(AsyncBufferedOutputStream const&) = delete;
+		AsyncBufferedOutputStream& operator=(AsyncBufferedOutputStream const&) = delete;
+
+		// Writes what is left (see finish)
+		virtual ~AsyncBufferedOutputStream() override;
+
+		virtual Result write(std::span<const uint8_t> data) override;
+
+		// Writes everything to the target (and flushes it)
+		virtual Result flush() override;
+
+		// flush, then stops the writer thread
+		Result finish();
+	};
+
+	class FileInputStream : public InputStream
+	{
+	protected:
+
+		std::ifstream _file;
+
+	public:
+
+		FileInputStream() = default;
+
+		Result open(std::filesystem::path const& path);
+
+		void close();
+
+		bool isOpen() const
+		{
+			return _file.is_open();
+		}
+
+		virtual Result read(std::span<uint8_t> dst, size_t& read_count) override;
+	};
+}
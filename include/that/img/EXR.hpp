@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <that/core/Result.hpp>
+#include <that/img/Format.hpp>
+#include <that/IO/Stream.hpp>
+#include <that/img/RowSource.hpp>
+
+namespace that
+{
+	class ThreadPool;
+
+	namespace img
+	{
+		namespace io
+		{
+			// OpenEXR, single part scanline files: HALF, FLOAT (or UINT) channels, NONE, RLE, ZIPS and ZIP compressions
+			// The chunks (blocks of scanlines) are compressed and decompressed in parallel
+			// HALF channels are read and written as they are (FLOAT 2 bytes images, math::Half)
+			namespace exr
+			{
+				enum class Compression : uint8_t
+				{
+					None = 0,
+					RLE = 1,
+					// zlib, one scanline per chunk
+					ZIPS = 2,
+					// zlib, 16 scanlines per chunk
+					ZIP = 3,
+				};
+
+				enum class PixelType : uint32_t
+				{
+					UINT = 0,
+					HALF = 1,
+					FLOAT = 2,
+				};
+
+				struct Channel
+				{
+					std::string name = {};
+					PixelType type = PixelType::HALF;
+				};
+
+				struct Header
+				{
+					// In the order of the file (alphabetical)
+					std::vector<Channel> channels = {};
+					Compression compression = Compression::None;
+					// Data window (inclusive)
+					int32_t x_min = 0, y_min = 0, x_max = -1, y_max = -1;
+					// Offset of the chunk offset table (the size of the header)
+					size_t header_size = 0;
+
+					size_t width() const
+					{
+						return size_t(int64_t(x_max) - x_min + 1);
+					}
+
+					size_t height() const
+					{
+						return size_t(int64_t(y_max) - y_min + 1);
+					}
+
+					uint32_t linesPerChunk() const
+					{
+						return compression == Compression::ZIP ? 16 : 1;
+					}
+
+					size_t chunkCount() const
+					{
+						return (height() + linesPerChunk() - 1) / linesPerChunk();
+					}
+				};
+
+				// Parses the header (not the offset table, so that a prefix of the file is enough)
+				// Returns NotImplemented for the tiled, deep or multi-part files, the other compressions and the sub-sampled channels
+				Result ParseHeader(std::span<const uint8_t> file, Header& header);
+
+				// FLOAT: 2 bytes if all the channels are HALF, else 4 (UINT if all the channels are UINT)
+				// The channels are ordered R, G, B, A (or Y, A), then the others in the order of the file
+				FormatInfo GetFormat(Header const& header);
+
+				// Decodes the chunks of file into dst (width * height pixels of GetFormat(header), row major), in parallel
+				Result Decode(std::span<const uint8_t> file, Header const& header, uint8_t* dst, ThreadPool* pool = nullptr);
+
+				// pixels: row major, 1 to 4 channels (Y, YA, RGB or RGBA) of elem_size bytes: 2 (HALF) or 4 (FLOAT, or UINT if uint_samples)
+				// level: deflate level of ZIP and ZIPS (-1 for the default)
+				Result Encode(OutputStream& stream, const uint8_t* pixels, size_t width, size_t height, uint32_t channels, uint32_t elem_size, bool uint_samples,
+					Compression compression, int level = -1, ThreadPool* pool = nullptr);
+
+				// The rows of each chunk are requested when it is compressed (rows.row_bytes must be width * channels * elem_size)
+				Result Encode(OutputStream& stream, RowSource const& rows, size_t width, size_t height, uint32_t channels, uint32_t elem_size, bool uint_samples,
+					Compression compression, int level = -1, ThreadPool* pool = nullptr);
+			}
+		}
+	}
+}
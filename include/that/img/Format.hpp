@@ -77,6 +77,16 @@ namespace that
 		}
 	};
 
+	// How the alpha channel (the 4th channel) is treated by a format conversion
+	enum class AlphaMode : uint8_t
+	{
+		Keep,
+		// straight -> premultiplied: the color channels are multiplied by alpha
+		Premultiply,
+		// premultiplied -> straight: the color channels are divided by alpha (zero if alpha is zero)
+		Unpremultiply,
+	};
+
 	template <ElementType type, uint32_t size>
 	struct UnderlyingPixelType : public std::type_identity<void> {};
 
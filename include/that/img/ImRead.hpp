@@ -1,9 +1,15 @@
 #pragma once
 
 #include "ImageIO.hpp"
+#include "NetPBM.hpp"
+#include "PFM.hpp"
+#include "ThatImg.hpp"
+#include "QOI.hpp"
+#include "EXR.hpp"
 #include <stb/stb_image.h>
 
 #include <that/IO/FileSystem.hpp>
+#include <that/utils/AsyncResult.hpp>
 
 namespace that
 {
@@ -19,9 +25,55 @@ namespace that
 				const FileSystem::Path* path = nullptr; // required
 				FileSystem* filesystem = nullptr; // optional
 				FormatedImage* target = nullptr; // required
+				// Binary NetPBM (P5 to P7) and PFM: the pixels of target point straight into a copy-on-write mapping of the file (no copy)
+				// Other formats just read the file from the mapping (.thatimg files are always mapped)
+				bool memory_map = false;
+				ThreadPool* pool = nullptr; // optional, used by the parallel decoders (the default pool if nullptr)
+				// optional, the file is read into it (its capacity is reused from one read to the next) instead of a temporary vector
+				std::vector<uint8_t>* file_buffer = nullptr;
+				// Preferred output format, elem_size == 0 means the native format of the file
+				// stb converts while decoding (from the decoded buffer), the other readers convert the decoded image
+				FormatInfo format = {};
 			};
+			// The format is detected from the first bytes of the file (see DetectFileFormat), the extension is not required (only used for TGA files which header is not recognized)
+			// A file of an unknown format fails with WrongFileFormat (UnknownFileExtension if its extension is not supported either) before the rest of it is read
 			Result ReadFormatedImage(ReadImageInfo const&);
 
+			// ReadFormatedImage(info) on the executor (ThreadPool::Default() if nullptr)
+			// The path is copied, the other pointers (target, filesystem, ...) must stay valid until the read is completed
+			AsyncResult ReadFormatedImageAsync(ReadImageInfo const& info, ThreadPool* executor = nullptr);
+
+			// Reads (and decodes) the images in parallel, results[i] is the result of ReadFormatedImage(infos[i])
+			// The files being read or decoded at the same time take at most max_in_flight_bytes (a larger file is read alone)
+			// The file buffers are reused from one image to the next (infos[i].file_buffer is ignored)
+			// Returns the first failure (in the order of infos), Success if all the images were read
+			Result ReadFormatedImages(std::span<const ReadImageInfo> infos, std::span<Result> results, ThreadPool* pool = nullptr, size_t max_in_flight_bytes = size_t(1) << 29);
+
+			struct ImageProbe
+			{
+				// The native format of the file (what ReadFormatedImage returns without a preferred format)
+				FormatInfo format = {};
+				size_t width = 0;
+				size_t height = 0;
+				bool row_major = true;
+			};
+
+			// Reads the size and format of an image from the first bytes of the file (4KB, more only if the header does not fit), without decoding it
+			// The format is detected like ReadFormatedImage
+			// info.target is ignored
+			Result ProbeImage(ReadImageInfo const& info, ImageProbe& result);
+
+			// Decodes an image from the content of a file in memory, the format is detected from the content (see DetectFileFormat)
+			// info.path, info.memory_map and info.file_buffer are ignored, the pixels never point into content
+			Result Decode(std::span<const uint8_t> content, ReadImageInfo const& info);
+
+			// ProbeImage from (the first bytes of) the content of a file in memory
+			Result ProbeImage(std::span<const uint8_t> content, ImageProbe& result);
+
+			// Probes paths in parallel (with info.pool), info.path is ignored
+			// probes and results must have the size of paths, results[i] is the result of ProbeImage for paths[i]
+			void ProbeImages(std::span<const FileSystem::Path> paths, ReadImageInfo const& info, std::span<ImageProbe> probes, std::span<Result> results);
+
 			inline FormatedImage ReadFormatedImage(std::filesystem::path const& path)
 			{
 				ReadImageInfo info = {};
@@ -32,25 +84,12 @@ namespace that
 				return res;
 			}
 			
+			// Per format: ReadFormatedImage reads the file of info.path, DecodeFormatedImage decodes the content of a file (info.path is ignored)
+
 			namespace netpbm
 			{
-				struct Header
-				{
-					std::string magic_number = "";
-					int width = 0, height = 0, max_value = 0;
-
-					bool valid()const
-					{
-						return max_value > 0;
-					}
-
-					bool validMagicNumber()const
-					{
-						return magic_number.size() == 2 && magic_number[0] == 'P' && (magic_number[1] >= '1' && magic_number[1] <= '3');
-					}
-				};
-
 				Result ReadFormatedImage(ReadImageInfo const& info);
+				Result DecodeFormatedImage(std::span<const uint8_t> content, ReadImageInfo const& info);
 
 				//template <class T, bool RM = IMAGE_ROW_MAJOR>
 				//Image<T, RM> read(const wchar_t* name, T T_max)
@@ -181,9 +220,36 @@ namespace that
 			
 			}
 
+			namespace pfm
+			{
+				Result ReadFormatedImage(ReadImageInfo const& info);
+				Result DecodeFormatedImage(std::span<const uint8_t> content, ReadImageInfo const& info);
+			}
+
+			namespace thatimg
+			{
+				// The first slice of the first subresource, no copy if not compressed
+				Result ReadFormatedImage(ReadImageInfo const& info);
+				Result DecodeFormatedImage(std::span<const uint8_t> content, ReadImageInfo const& info);
+			}
+
+			namespace qoi
+			{
+				Result ReadFormatedImage(ReadImageInfo const& info);
+				Result DecodeFormatedImage(std::span<const uint8_t> content, ReadImageInfo const& info);
+			}
+
+			namespace exr
+			{
+				// Scanline files, HALF channels are not converted (FLOAT 2 bytes)
+				Result ReadFormatedImage(ReadImageInfo const& info);
+				Result DecodeFormatedImage(std::span<const uint8_t> content, ReadImageInfo const& info);
+			}
+
 			namespace stbi
 			{
 				Result ReadFormatedImage(ReadImageInfo const& info);
+				Result DecodeFormatedImage(std::span<const uint8_t> content, ReadImageInfo const& info);
 
 				//template <class T, bool RM = IMAGE_ROW_MAJOR>
 				//Image<T, RM> read(const wchar_t* path)
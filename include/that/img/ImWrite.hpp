@@ -7,8 +7,12 @@
 
 #include <that/core/Result.hpp>
 #include <that/IO/FileSystem.hpp>
+#include <that/utils/AsyncResult.hpp>
+#include <that/utils/ExtensibleDataStorage.hpp>
 namespace that
 {
+	class ThreadPool;
+
 	namespace img
 	{
 		namespace io
@@ -19,11 +23,14 @@ namespace that
 				FileSystem::Hint hint = FileSystem::Hint::None;
 				int magic_number = -1;
 				int quality = -1; // -1 means no quality loss, mainly for jpg
-				int compression = -1; // -1 means no compression, mainly for png
+				// -1 means the default of the format, mainly for png: 0 (no compression, fastest) to 9 (smallest), see png::Encode
+				int compression = -1;
 				bool path_is_native = false;
 				bool row_major = false;
 				bool can_modify_image = false;
 				FormatInfo format = {};
+				// Used if the image has to be converted from FLOAT to a LDR format (png, jpg, ...)
+				ToneMappingInfo tone_mapping = {};
 				union
 				{
 					const FormatlessImage * const_image = nullptr; // required
@@ -31,6 +38,7 @@ namespace that
 				};
 				const FileSystem::Path * path = nullptr; // required
 				FileSystem * filesystem = nullptr; // optional
+				ThreadPool * pool = nullptr; // optional, used by the parallel encoders (the default pool if nullptr)
 			};
 
 			namespace netpbm
@@ -45,6 +53,35 @@ namespace that
 				//}
 			}
 		
+			namespace pfm
+			{
+				extern Result Write(WriteInfo const& info);
+			}
+
+			namespace thatimg
+			{
+				// .thatimgz is LZ4 compressed
+				extern Result Write(WriteInfo const& info);
+			}
+
+			namespace qoi
+			{
+				// .qois is striped (encoded in parallel)
+				extern Result Write(WriteInfo const& info);
+			}
+
+			namespace png
+			{
+				// 8 or 16 bits, compressed in parallel
+				extern Result Write(WriteInfo const& info);
+			}
+
+			namespace exr
+			{
+				// HALF or FLOAT scanlines, chunks compressed in parallel (compression: 0 none, 1 RLE, else ZIP with that deflate level)
+				extern Result Write(WriteInfo const& info);
+			}
+
 			namespace stbi
 			{
 				extern Result Write(WriteInfo const& info);
@@ -59,6 +96,15 @@ namespace that
 
 			extern Result Write(WriteInfo const& info);
 
+			// Encodes to memory (appended to out, which is left as it was on failure), like Write without a file
+			// extension selects the format like the extension of a path ("png", "qois", "exr", "pam", ...), empty to choose it from info.format
+			// info.path is ignored
+			extern Result Encode(WriteInfo const& info, std::string_view extension, ExtensibleDataStorage& out);
+
+			// Write(info) on the executor (ThreadPool::Default() if nullptr)
+			// The path is copied, the image (and the filesystem) must stay valid until the write is completed
+			extern AsyncResult WriteAsync(WriteInfo const& info, ThreadPool* executor = nullptr);
+
 			//template <class T, bool RM=IMAGE_ROW_MAJOR>
 			//inline Result Write(Image<T, RM> const& img, std::filesystem::path const& path, WriteInfo const& info = WriteInfo{})
 			//{
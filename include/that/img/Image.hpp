@@ -11,6 +11,9 @@
 #include <that/core/Result.hpp>
 #include <that/math/Vector.hpp>
 #include <that/img/Format.hpp>
+#include <that/img/ImageView.hpp>
+#include <that/img/ImageStorage.hpp>
+#include <that/img/ToneMapping.hpp>
 
 #define me (*this)
 
@@ -65,27 +68,36 @@ namespace that
 
 			// In elements
 			size_t _w = 0, _h = 0, _size = 0;
-			std::vector<byte> _buffer = {};
+			ImageStorage _buffer = {};
 
 
 			friend class ImageProcessor;
 
 		public:
 
-			constexpr FormatlessImage() = default;
+			FormatlessImage() = default;
 
-			constexpr FormatlessImage(size_t w, size_t h, size_t pixel_size=1):
+			// The pixels are zero initialized
+			FormatlessImage(size_t w, size_t h, size_t pixel_size=1):
 				_w(w),
 				_h(h),
 				_size(w * h),
-				_buffer(_size * pixel_size)
+				_buffer(_size * pixel_size, ImageStorage::DefaultAlignment(), true)
 			{}
 
-			constexpr FormatlessImage(FormatlessImage const&) = default;
-			constexpr FormatlessImage(FormatlessImage&&) = default;
+			// Uses storage as the pixels (it can hold external memory), storage.size() must be at least w * h * pixel size
+			FormatlessImage(size_t w, size_t h, ImageStorage&& storage) :
+				_w(w),
+				_h(h),
+				_size(w * h),
+				_buffer(std::move(storage))
+			{}
 
-			constexpr FormatlessImage& operator=(FormatlessImage const&) = default;
-			constexpr FormatlessImage& operator=(FormatlessImage &&) = default;
+			FormatlessImage(FormatlessImage const&) = default;
+			FormatlessImage(FormatlessImage&&) = default;
+
+			FormatlessImage& operator=(FormatlessImage const&) = default;
+			FormatlessImage& operator=(FormatlessImage &&) = default;
 
 
 			constexpr size_t width()const
@@ -115,30 +127,30 @@ namespace that
 				return _buffer.data();
 			}
 
-			constexpr typename decltype(auto) rawBegin()
+			constexpr byte* rawBegin()
 			{
-				return _buffer.begin();
+				return _buffer.data();
 			}
-			constexpr typename decltype(auto) rawBegin()const
+			constexpr const byte* rawBegin()const
 			{
-				return _buffer.begin();
+				return _buffer.data();
 			}
-			constexpr typename decltype(auto) rawCBegin()const
+			constexpr const byte* rawCBegin()const
 			{
-				return _buffer.cbegin();
+				return _buffer.data();
 			}
 
-			constexpr typename decltype(auto) rawEnd()
+			constexpr byte* rawEnd()
 			{
-				return _buffer.end();
+				return _buffer.data() + _buffer.size();
 			}
-			constexpr typename decltype(auto) rawEnd()const
+			constexpr const byte* rawEnd()const
 			{
-				return _buffer.end();
+				return _buffer.data() + _buffer.size();
 			}
-			constexpr typename decltype(auto) rawCEnd()const
+			constexpr const byte* rawCEnd()const
 			{
-				return _buffer.cend();
+				return _buffer.data() + _buffer.size();
 			}
 
 			constexpr bool empty()const
@@ -146,17 +158,32 @@ namespace that
 				return _size == 0;
 			}
 
-			constexpr void resize(size_t w = 0, size_t h = 0, size_t pixel_size = 1)
+			ImageStorage const& storage() const
+			{
+				return _buffer;
+			}
+
+			// Takes ownership of data (w * h * pixel size bytes, for example from a decoder's allocator), deleter frees it when the image releases it
+			void adopt(size_t w, size_t h, byte* data, size_t byte_size, ImageStorage::Deleter&& deleter)
 			{
 				_w = w;
 				_h = h;
 				_size = _w * _h;
-				_buffer.resize(_size * pixel_size);
+				_buffer = ImageStorage(data, byte_size, std::move(deleter));
+			}
+
+			// The content is kept, new bytes are zero
+			void resize(size_t w = 0, size_t h = 0, size_t pixel_size = 1)
+			{
+				_w = w;
+				_h = h;
+				_size = _w * _h;
+				_buffer.resize(_size * pixel_size, true);
 			}
 
 			void transpose();
 
-			Result convertFormat(FormatInfo const& src_format, bool src_row_major, FormatInfo const& dst_format, bool dst_row_major);
+			Result convertFormat(FormatInfo const& src_format, bool src_row_major, FormatInfo const& dst_format, bool dst_row_major, AlphaMode alpha = AlphaMode::Keep, ToneMappingInfo const& tone_mapping = {});
 		};
 
 	
@@ -184,6 +211,14 @@ namespace that
 				_row_major(row_major)
 			{}
 
+			// See FormatlessImage(w, h, storage)
+			FormatedImage(size_t w, size_t h, FormatInfo format, bool row_major, ImageStorage&& storage) :
+				FormatlessImage(w, h, std::move(storage)),
+				_format(format),
+				_pixel_size(_format.elem_size * _format.channels),
+				_row_major(row_major)
+			{}
+
 			FormatedImage(FormatedImage const& other) :
 				FormatlessImage(other),
 				_format(other._format),
@@ -201,6 +236,15 @@ namespace that
 			FormatedImage(FormatedImage const& other, FormatInfo const& new_format, bool row_major = true);
 			FormatedImage(FormatedImage && other, FormatInfo const& new_format, bool row_major = true);
 
+			// See FormatlessImage::adopt
+			void adopt(size_t w, size_t h, FormatInfo const& format, bool row_major, byte* data, ImageStorage::Deleter&& deleter)
+			{
+				FormatlessImage::adopt(w, h, data, w * h * format.pixelSize(), std::move(deleter));
+				_format = format;
+				_pixel_size = _format.pixelSize();
+				_row_major = row_major;
+			}
+
 			FormatedImage& operator=(FormatedImage const& other)
 			{
 				FormatlessImage::operator=(other);
@@ -292,6 +336,19 @@ namespace that
 				return t_data[i * _format.channels + c];
 			}
 
+			// A column major image is seen as its transpose
+			ImageView view()
+			{
+				const ImageExtent extent{ .width = uint32_t(majorSize()), .height = uint32_t(minorSize()), .depth = 1 };
+				return ImageView(rawData(), _format, extent);
+			}
+
+			ConstImageView view() const
+			{
+				const ImageExtent extent{ .width = uint32_t(majorSize()), .height = uint32_t(minorSize()), .depth = 1 };
+				return ConstImageView(rawData(), _format, extent);
+			}
+
 			size_t majorSize()const
 			{
 				return _row_major ? _w : _h;
@@ -345,7 +402,7 @@ namespace that
 				setFormat(format, _row_major);
 			}
 
-			Result reFormat(FormatInfo const& new_format, bool new_row_major);
+			Result reFormat(FormatInfo const& new_format, bool new_row_major, AlphaMode alpha = AlphaMode::Keep);
 			
 			Result reFormat(FormatInfo const& new_format)
 			{
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+
+#include <that/core/Result.hpp>
+#include <that/img/Format.hpp>
+#include <that/img/ImageView.hpp>
+#include <that/img/Image.hpp>
+
+namespace that
+{
+	class ThreadPool;
+
+	namespace img
+	{
+		struct CompareInfo
+		{
+			bool compute_ssim = true;
+			// Peak signal value, used for the PSNR and the SSIM stabilization constants
+			double peak = 1.0;
+			ThreadPool* pool = nullptr; // optional, the default pool if nullptr
+		};
+
+		struct ChannelComparison
+		{
+			double mse = 0;
+			double psnr = 0; // +inf for identical channels
+			double max_abs_error = 0;
+			double ssim = 0; // Only if requested
+		};
+
+		struct ImageComparison
+		{
+			std::vector<ChannelComparison> channels = {};
+			// Averages over the channels
+			double mse = 0;
+			double psnr = 0;
+			double ssim = 0;
+		};
+
+		// Compares the common channels of a and b (they must have the same extent)
+		// The formats can differ: pixels are converted on the fly to normalized float values (see ConvertFormat)
+		// If both a and b are sRGB, the sRGB encoded values are compared (not linearized)
+		// SSIM uses the 11x11 gaussian window (sigma = 1.5) of Wang et al., with clamped borders
+		Result Compare(ConstImageView const& a, ConstImageView const& b, CompareInfo const& info, ImageComparison& result);
+
+		// a and b must have the same major
+		Result Compare(FormatedImage const& a, FormatedImage const& b, CompareInfo const& info, ImageComparison& result);
+	}
+}
@@ -3,6 +3,8 @@
 #include <filesystem>
 #include <type_traits>
 #include <string>
+#include <string_view>
+#include <span>
 #include <iostream>
 #include <fstream>
 #include <algorithm>
@@ -32,12 +34,69 @@ namespace that
 				extern bool IsNetpbm(std::string_view const& ext);
 				extern bool IsNetpbm(std::wstring_view const& ext);
 
+				// The magic number of the files of an extension: 4 (pbm), 5 (pgm), 6 (ppm) or 7 (pam), -1 for pnm (5 or 6 depending on the channels)
+				extern int MagicNumber(std::string_view const& ext);
+				extern int MagicNumber(std::wstring_view const& ext);
+			}
+
+			namespace pfm
+			{
+				extern bool IsPFM(std::string_view const& ext);
+				extern bool IsPFM(std::wstring_view const& ext);
+			}
+
+			namespace thatimg
+			{
+				extern bool IsThatImg(std::string_view const& ext);
+				extern bool IsThatImg(std::wstring_view const& ext);
+
+				// .thatimgz: LZ4 compressed
+				extern bool IsCompressed(std::string_view const& ext);
+				extern bool IsCompressed(std::wstring_view const& ext);
+			}
+
+			namespace qoi
+			{
+				extern bool CanReadWrite(std::string_view const& ext);
+				extern bool CanReadWrite(std::wstring_view const& ext);
+
+				// .qois: the striped container
+				extern bool IsStriped(std::string_view const& ext);
+				extern bool IsStriped(std::wstring_view const& ext);
+			}
+
+			namespace png
+			{
+				// Native writer (read by stbi)
+				extern bool CanWrite(std::string_view const& ext);
+				extern bool CanWrite(std::wstring_view const& ext);
+			}
+
+			namespace exr
+			{
+				extern bool IsEXR(std::string_view const& ext);
+				extern bool IsEXR(std::wstring_view const& ext);
 			}
 
 			namespace stbi
 			{
 				extern bool CanReadWrite(std::string_view const& ext);
 				extern bool CanReadWrite(std::wstring_view const& ext);
+
+				// TGA has no signature, its extension is used when its header is not recognized
+				extern bool IsTGA(std::string_view const& ext);
+				extern bool IsTGA(std::wstring_view const& ext);
+
+				// jpg or jpeg
+				extern bool IsJPEG(std::string_view const& ext);
+				extern bool IsJPEG(std::wstring_view const& ext);
+
+				extern bool IsHDR(std::string_view const& ext);
+				extern bool IsHDR(std::wstring_view const& ext);
+
+				// Written by stbi, not read
+				extern bool IsBMP(std::string_view const& ext);
+				extern bool IsBMP(std::wstring_view const& ext);
 			}
 
 			using RGBu = RGB<unsigned char>;
@@ -70,6 +129,11 @@ namespace that
 			extern std::string ConvertWString(std::wstring_view const& wstr);
 
 			extern that::PathStringView ExtractExtensionSV(const std::filesystem::path* ext_path);
+
+			// Detects the format of a file from its first bytes (the first 32 bytes are enough)
+			// Returns the usual extension of the format ("png", "jpg", "tga", "hdr", "pbm", "pgm", "ppm", "pam", "pfm", "qoi", "qois", "thatimg", "exr"), empty if not recognized
+			// TGA has no signature: it is recognized by the consistency of its header, once the other formats are ruled out
+			extern std::string_view DetectFileFormat(std::span<const uint8_t> prefix);
 		}
 }
 
@@ -0,0 +1,607 @@
+#pragma once
+
+#include <that/img/Image.hpp>
+#include <that/math/Half.hpp>
+
+#include <that/img/FormatConversion.hpp>
+#include <that/img/ToneMapping.hpp>
+
+#include <concepts>
+#include <functional>
+#include <bit>
+#include <cstring>
+
+#ifndef USE_ALLOCA
+#define USE_ALLOCA 1
+#endif
+
+namespace that
+{
+	class ThreadPool;
+
+	namespace img
+	{
+		template <class F>
+		concept PixelTransformFunction = std::convertible_to<F, std::function<void(const uint8_t*, uint8_t*)>>;
+
+		class ImageProcessor
+		{
+		public:
+
+			// Are the templates really worth it?
+			// The process is probably already memory bounded...
+
+
+			template <PixelTransformFunction F>
+			static constexpr void ProcessPerPixelSameMajor(const uint8_t* src, uint8_t* dst, size_t src_pixel_size, size_t dst_pixel_size, size_t size, F const& f)
+			{
+				for (size_t i = 0; i < size; ++i)
+				{
+					const uint8_t* src_pixel = src + i * src_pixel_size;
+					uint8_t* dst_pixel = dst + i * dst_pixel_size;
+					f(src_pixel, dst_pixel);
+				}
+			}
+
+			template <bool SRC_ROW_MAJOR, PixelTransformFunction F>
+			static constexpr void ProcessPerPixelDiffMajor(const uint8_t* src, uint8_t* dst, size_t src_pixel_size, size_t dst_pixel_size, size_t w, size_t h, F const& f)
+			{
+				const bool same_buffer = src == dst;
+				if (same_buffer)
+				{
+					const size_t max_pixel_size = std::max(src_pixel_size, dst_pixel_size);
+					const size_t min_pixel_size = std::min(src_pixel_size, dst_pixel_size);
+					if (w == h && src_pixel_size == dst_pixel_size)
+					{
+#if USE_ALLOCA
+						void* tmp = alloca(src_pixel_size);
+#else
+						static thread_local std::vector<uint8_t> scratch;
+						scratch.resize(max_pixel_size);
+						void* tmp = scratch.data();
+#endif
+						// TODO per block process for better cache hit rate
+						const auto process_pixel = [&](size_t i, size_t j)
+						{
+							const size_t index1 = index<SRC_ROW_MAJOR>(i, j, w, w);
+							const size_t index2 = index<!SRC_ROW_MAJOR>(i, j, w, w);
+							uint8_t* pixel1 = dst + index1 * src_pixel_size;
+							uint8_t* pixel2 = dst + index2 * dst_pixel_size;
+							uint8_t * ttmp = static_cast<uint8_t*>(tmp);
+							std::memcpy(ttmp, pixel1, src_pixel_size); // pixel1 -> tmp
+							f(pixel2, pixel1); // pixel2 -> pixel1
+							f(ttmp, pixel2); // tmp (pixel1) -> pixel2
+						};
+					
+						for (size_t y = 0; y < h; ++y)
+						{
+							for (size_t x = 0; x < y; ++x)
+							{
+								process_pixel(x, y);
+							}
+							const size_t yindex = index<SRC_ROW_MAJOR>(y, y, w, w);
+							uint8_t* pixel = dst + yindex * dst_pixel_size;
+							f(pixel, pixel);
+						}
+
+#if USE_ALLOCA
+					// There should be a "freea(pixel_size)" to reset the stack pointer, but it appears to be done automatically
+#endif
+					}
+					else
+					{
+						std::vector<uint8_t> tmp(w * h * src_pixel_size);
+						std::memcpy(tmp.data(), src, tmp.size());
+						assert(tmp.data() != src);
+						ProcessPerPixelDiffMajor<SRC_ROW_MAJOR>(tmp.data(), dst, src_pixel_size, dst_pixel_size, w, h, f);
+					}
+				}
+				else
+				{
+					// TODO per block process for better cache hit rate
+					const auto loop = [&](auto pp)
+					{
+						if constexpr (SRC_ROW_MAJOR)
+						{
+							for (size_t i = 0; i < w; ++i)
+							{
+								for (size_t j = 0; j < h; ++j)
+								{
+									pp(i, j);
+								}
+							}
+						}
+						else
+						{
+							for (size_t i = 0; i < w; ++i)
+							{
+								for (size_t j = 0; j < h; ++j)
+								{
+									pp(i, j);
+								}
+							}
+						}
+					};
+
+					const auto process_pixel = [&](size_t i, size_t j)
+					{
+						const size_t src_index = index<SRC_ROW_MAJOR>(i, j, w, h);
+						const size_t dst_index = index<!SRC_ROW_MAJOR>(i, j, w, h);
+						const uint8_t* src_pixel = src + src_index * src_pixel_size;
+						uint8_t* dst_pixel = dst + dst_index * dst_pixel_size;
+						f(src_pixel, dst_pixel);
+					};
+					loop(process_pixel);
+				}
+			}
+
+			template <PixelTransformFunction F>
+			static constexpr void ProcessPerPixel(const uint8_t* src, uint8_t* dst, size_t src_pixel_size, size_t dst_pixel_size, size_t w, size_t h, bool src_row_major, bool dst_row_major, F const& f)
+			{
+				if (src_row_major == dst_row_major)
+				{
+					ProcessPerPixelSameMajor(src, dst, src_pixel_size, dst_pixel_size, w * h, f);
+				}
+				else
+				{
+					if (src_row_major)
+					{
+						ProcessPerPixelDiffMajor<true>(src, dst, src_pixel_size, dst_pixel_size, w, h, f);
+					}
+					else
+					{
+						ProcessPerPixelDiffMajor<false>(src, dst, src_pixel_size, dst_pixel_size, w, h, f);
+					}
+				}
+			}
+
+			template <bool SRC_ROW_MAJOR>
+			static void TransposeImpl(uint8_t* pixels, size_t pixel_size, size_t w, size_t h)
+			{
+				if (w == h)
+				{
+#if USE_ALLOCA
+					void * tmp = alloca(pixel_size);
+#else
+					static thread_local std::vector<uint8_t> scratch;
+					scratch.resize(pixel_size);
+					void * tmp = scratch.data();
+#endif
+					auto swap_pixel = [&](size_t i, size_t j)
+					{
+						const size_t src_index = index<SRC_ROW_MAJOR>(i, j, w, h);
+						const size_t dst_index = index<!SRC_ROW_MAJOR>(i, j, h, w);
+						uint8_t* src_pixel = pixels + src_index * pixel_size;
+						uint8_t* dst_pixel = pixels + dst_index * pixel_size;
+						std::memcpy(tmp, src_pixel, pixel_size);
+						std::memcpy(src_pixel, dst_pixel, pixel_size);
+						std::memcpy(dst_pixel, tmp, pixel_size);
+					};
+					// TODO per block for better cache hit rate
+					for (size_t i = 0; i < w; ++i)
+					{
+						for (size_t j = 0; j < i; ++j)
+						{
+							swap_pixel(i, j);
+						}
+					}
+#if USE_ALLOCA
+				// There should be a "freea(pixel_size)" to reset the stack pointer, but it appears to be done automatically
+#endif
+				}
+				else
+				{
+					// We can't just swap pixels
+					std::vector<uint8_t> tmp(w * h * pixel_size);
+					std::memcpy(tmp.data(), pixels, tmp.size());
+					// TODO per block for better cache hit rate
+					for (size_t i = 0; i < w; ++i)
+					{
+						for (size_t j = 0; j < h; ++j)
+						{
+							const size_t src_index = index<SRC_ROW_MAJOR>(i, j, w, h);
+							const size_t dst_index = index<!SRC_ROW_MAJOR>(i, j, h, w);
+							uint8_t* src_pixel = pixels + src_index * pixel_size;
+							uint8_t* dst_pixel = pixels + dst_index * pixel_size;
+							std::memcpy(dst_pixel, tmp.data() + src_index, pixel_size);
+						}
+					}
+				}
+			}
+
+			static void Transpose(uint8_t* pixels, size_t pixel_size, size_t w, size_t h, bool src_row_major)
+			{
+				if (src_row_major)
+				{
+					TransposeImpl<true>(pixels, pixel_size, w, h);
+				}
+				else
+				{
+					TransposeImpl<false>(pixels, pixel_size, w, h);
+				}
+			}
+
+			struct ConvertParams
+			{
+				const uint8_t* src;
+				uint8_t* dst;
+				size_t w;
+				size_t h;
+				FormatInfo const& src_format;
+				FormatInfo const& dst_format;
+				bool src_row_major;
+				bool dst_row_major;
+				// Premultiplication is fused in the conversion (the pixels are read and written once)
+				// Ignored if src has no alpha channel, not supported with UINT / SINT formats
+				AlphaMode alpha = AlphaMode::Keep;
+				// Only used for FLOAT -> non FLOAT conversions
+				ToneMappingInfo tone_mapping = {};
+				// Large conversions are split over the pool (the default one if nullptr), unless dst aliases src with a different pixel size
+				ThreadPool* pool = nullptr;
+			};
+
+			template <PixelTransformFunction F>
+			static constexpr void ProcessPerPixel(ConvertParams const& params, F const f)
+			{
+				ProcessPerPixel(params.src, params.dst, params.src_format.pixelSize(), params.dst_format.pixelSize(), params.w, params.h, params.src_row_major, params.dst_row_major, f);
+			}
+
+			
+			
+			template <ElementType src_type, uint32_t src_size, ElementType dst_type, uint32_t dst_size>
+			static void ConvertPixel(const uint8_t* src, uint8_t* dst, uint32_t channels, uint32_t zero_channels)
+			{
+				using SrcType = typename UnderlyingPixelType<src_type, src_size>::type;
+				using DstType = typename UnderlyingPixelType<dst_type, dst_size>::type;
+				static_assert(!std::is_same<SrcType, void>::value);
+				static_assert(!std::is_same<DstType, void>::value);
+				const SrcType * typed_src = reinterpret_cast<const SrcType*>(src);
+				DstType * typed_dst = reinterpret_cast<DstType*>(dst);
+
+				auto convert_channel = GetConvertPixelChannelFunction<src_type, src_size, dst_type, dst_size>();
+
+				for (uint32_t i = 0; i < channels; ++i)
+				{
+					if (i == 3)
+					{
+						// Special case for the alpha channel
+						constexpr const ElementType src_type_alpha = src_type == ElementType::sRGB ? ElementType::UNORM : src_type;
+						constexpr const ElementType dst_type_alpha = dst_type == ElementType::sRGB ? ElementType::UNORM : dst_type;
+						auto convert_channel_alpha = GetConvertPixelChannelFunction<src_type_alpha, src_size, dst_type_alpha, dst_size>();
+						convert_channel_alpha(typed_src[i], typed_dst[i]);
+					}
+					else
+					{
+						convert_channel(typed_src[i], typed_dst[i]);
+					}
+				}
+				if (zero_channels)
+				{
+					std::memset(typed_dst + channels, 0, zero_channels);
+				}
+			}
+
+			// Converts a pixel with at least 4 source channels through a float, applying the alpha operation on the way
+			// Alpha is read before anything is written, so dst can be src (if the dst pixel is not larger)
+			template <ElementType src_type, uint32_t src_size, ElementType dst_type, uint32_t dst_size, AlphaMode alpha_mode>
+			static void ConvertPixelAlpha(const uint8_t* src, uint8_t* dst, uint32_t channels, uint32_t zero_channels)
+			{
+				using SrcType = typename UnderlyingPixelType<src_type, src_size>::type;
+				using DstType = typename UnderlyingPixelType<dst_type, dst_size>::type;
+				constexpr const uint32_t compute_size = (src_size == 8 || dst_size == 8) ? 8 : 4;
+				using ComputeType = typename FloatTypePerSize<compute_size>::type;
+				const SrcType* typed_src = reinterpret_cast<const SrcType*>(src);
+				DstType* typed_dst = reinterpret_cast<DstType*>(dst);
+
+				constexpr const ElementType src_type_alpha = src_type == ElementType::sRGB ? ElementType::UNORM : src_type;
+				constexpr const ElementType dst_type_alpha = dst_type == ElementType::sRGB ? ElementType::UNORM : dst_type;
+				auto load = GetConvertPixelChannelFunction<src_type, src_size, ElementType::FLOAT, compute_size>();
+				auto load_alpha = GetConvertPixelChannelFunction<src_type_alpha, src_size, ElementType::FLOAT, compute_size>();
+				auto store = GetConvertPixelChannelFunction<ElementType::FLOAT, compute_size, dst_type, dst_size>();
+				auto store_alpha = GetConvertPixelChannelFunction<ElementType::FLOAT, compute_size, dst_type_alpha, dst_size>();
+
+				ComputeType alpha;
+				load_alpha(typed_src[3], alpha);
+				ComputeType factor = alpha;
+				if constexpr (alpha_mode == AlphaMode::Unpremultiply)
+				{
+					factor = (alpha != ComputeType(0)) ? (ComputeType(1) / alpha) : ComputeType(0);
+				}
+
+				// The color channels (sRGB is linearized first)
+				ComputeType color[3];
+				for (uint32_t i = 0; i < 3; ++i)
+				{
+					load(typed_src[i], color[i]);
+				}
+				for (uint32_t i = 0; i < 3; ++i)
+				{
+					color[i] *= factor;
+				}
+				for (uint32_t i = 0; i < std::min<uint32_t>(channels, 3); ++i)
+				{
+					store(color[i], typed_dst[i]);
+				}
+				if (channels > 3)
+				{
+					store_alpha(alpha, typed_dst[3]);
+				}
+				for (uint32_t i = 4; i < channels; ++i)
+				{
+					ComputeType tmp;
+					load(typed_src[i], tmp);
+					store(tmp, typed_dst[i]);
+				}
+				if (zero_channels)
+				{
+					std::memset(typed_dst + channels, 0, zero_channels * sizeof(DstType));
+				}
+			}
+
+			// FLOAT -> LDR, with the tone mapping (and the optional alpha operation) in the same pass
+			template <uint32_t src_size, ElementType dst_type, uint32_t dst_size>
+			static void ConvertPixelToneMapped(const uint8_t* src, uint8_t* dst, uint32_t channels, uint32_t zero_channels, uint32_t src_channels, ToneMapper const& tone_mapper, AlphaMode alpha_mode)
+			{
+				using SrcType = typename UnderlyingPixelType<ElementType::FLOAT, src_size>::type;
+				using DstType = typename UnderlyingPixelType<dst_type, dst_size>::type;
+				const SrcType* typed_src = reinterpret_cast<const SrcType*>(src);
+				DstType* typed_dst = reinterpret_cast<DstType*>(dst);
+
+				constexpr const ElementType dst_type_alpha = dst_type == ElementType::sRGB ? ElementType::UNORM : dst_type;
+				auto store = GetConvertPixelChannelFunction<ElementType::FLOAT, 4, dst_type, dst_size>();
+				auto store_alpha = GetConvertPixelChannelFunction<ElementType::FLOAT, 4, dst_type_alpha, dst_size>();
+
+				// Grey alpha or RGBA: the alpha channel is not tone mapped
+				const uint32_t alpha_index = (src_channels == 2) ? 1 : 3;
+				const uint32_t color_channels = std::min<uint32_t>(src_channels, alpha_index);
+				const bool has_alpha = src_channels > alpha_index;
+				float pixel[4];
+				for (uint32_t i = 0; i < std::min<uint32_t>(src_channels, 4); ++i)
+				{
+					pixel[i] = static_cast<float>(typed_src[i]);
+				}
+				float alpha = has_alpha ? std::clamp(pixel[alpha_index], 0.0f, 1.0f) : 1.0f;
+				if (has_alpha && alpha_mode == AlphaMode::Unpremultiply && alpha > 0)
+				{
+					for (uint32_t i = 0; i < color_channels; ++i)
+					{
+						pixel[i] /= alpha;
+					}
+				}
+				tone_mapper(pixel, color_channels);
+				if (has_alpha && (alpha_mode == AlphaMode::Premultiply || (alpha_mode == AlphaMode::Unpremultiply && alpha == 0)))
+				{
+					for (uint32_t i = 0; i < color_channels; ++i)
+					{
+						pixel[i] *= alpha;
+					}
+				}
+				for (uint32_t i = 0; i < std::min<uint32_t>(channels, alpha_index); ++i)
+				{
+					store(pixel[i], typed_dst[i]);
+				}
+				if (channels > alpha_index)
+				{
+					store_alpha(alpha, typed_dst[alpha_index]);
+				}
+				for (uint32_t i = alpha_index + 1; i < channels; ++i)
+				{
+					store(static_cast<float>(typed_src[i]), typed_dst[i]);
+				}
+				if (zero_channels)
+				{
+					std::memset(typed_dst + channels, 0, zero_channels * sizeof(DstType));
+				}
+			}
+
+			template <ElementType src_type, uint32_t src_size, ElementType dst_type, uint32_t dst_size>
+			static bool ConvertFormatDispatchFinal(ConvertParams const& params)
+			{
+				const uint32_t src_channels = params.src_format.channels;
+				const uint32_t dst_channels = params.dst_format.channels;
+
+				const uint32_t convert_channels = std::min(src_channels, dst_channels);
+				const uint32_t zero_channels = (dst_channels > src_channels) ? (dst_channels - src_channels) : 0;
+
+				constexpr const auto type_is_int = [](ElementType type) {return type == ElementType::SINT || type == ElementType::UINT; };
+				if constexpr (src_type == ElementType::FLOAT && dst_type != ElementType::FLOAT && !type_is_int(dst_type))
+				{
+					if (!params.tone_mapping.isIdentity())
+					{
+						const ToneMapper tone_mapper(params.tone_mapping);
+						ProcessPerPixel(params, [&](const uint8_t* src, uint8_t* dst)
+						{
+							ConvertPixelToneMapped<src_size, dst_type, dst_size>(src, dst, convert_channels, zero_channels, src_channels, tone_mapper, params.alpha);
+						});
+						return true;
+					}
+				}
+				if constexpr (!type_is_int(src_type) && !type_is_int(dst_type))
+				{
+					if (params.alpha != AlphaMode::Keep && src_channels >= 4)
+					{
+						if (params.alpha == AlphaMode::Premultiply)
+						{
+							ProcessPerPixel(params, [&](const uint8_t* src, uint8_t* dst)
+							{
+								ConvertPixelAlpha<src_type, src_size, dst_type, dst_size, AlphaMode::Premultiply>(src, dst, convert_channels, zero_channels);
+							});
+						}
+						else
+						{
+							ProcessPerPixel(params, [&](const uint8_t* src, uint8_t* dst)
+							{
+								ConvertPixelAlpha<src_type, src_size, dst_type, dst_size, AlphaMode::Unpremultiply>(src, dst, convert_channels, zero_channels);
+							});
+						}
+						return true;
+					}
+				}
+
+				const auto lambda = [&](const uint8_t* src, uint8_t* dst)
+				{
+					ConvertPixel<src_type, src_size, dst_type, dst_size>(src, dst, convert_channels, zero_channels);
+				};
+
+				ProcessPerPixel(params, lambda);
+
+				return true;
+			}
+
+			template <ElementType src_type, uint32_t src_size, ElementType dst_type>
+			static bool ConvertFormatDispatch4(ConvertParams const& params)
+			{
+				bool res = false;
+				switch (params.dst_format.elem_size)
+				{
+					case 1:
+					{
+						if constexpr (dst_type != ElementType::FLOAT)
+						{
+							res = ConvertFormatDispatchFinal<src_type, src_size, dst_type, 1>(params);
+						}
+					}
+					break;
+					case 2:
+					{
+						res = ConvertFormatDispatchFinal<src_type, src_size, dst_type, 2>(params);
+					}
+					break;
+					case 4:
+					{
+						res = ConvertFormatDispatchFinal<src_type, src_size, dst_type, 4>(params);
+					}
+					break;
+					case 8:
+					{
+						res = ConvertFormatDispatchFinal<src_type, src_size, dst_type, 8>(params);
+					}
+					break;
+				}
+				return res;
+			}
+
+			template <ElementType src_type, ElementType dst_type>
+			static bool ConvertFormatDispatch3(ConvertParams const& params)
+			{
+				bool res = false;
+				switch (params.src_format.elem_size)
+				{
+					case 1:
+					{
+						if constexpr (src_type != ElementType::FLOAT)
+						{
+							res = ConvertFormatDispatch4<src_type, 1, dst_type>(params);
+						}
+						break;
+					}
+					case 2:
+					{
+						res = ConvertFormatDispatch4<src_type, 2, dst_type>(params);
+					}
+					break;
+					case 4:
+					{
+						res = ConvertFormatDispatch4<src_type, 4, dst_type>(params);
+					}
+					break;
+					case 8:
+					{
+						res = ConvertFormatDispatch4<src_type, 8, dst_type>(params);
+					}
+					break;
+				}
+				return res;
+			}
+
+			template <ElementType src_type>
+			static bool ConvertFormatDispatch2(ConvertParams const& params)
+			{
+				bool res = false;
+				switch (params.dst_format.type)
+				{
+				case ElementType::UNORM:
+				{
+					res = ConvertFormatDispatch3<src_type, ElementType::UNORM>(params);
+				}
+				break;
+				case ElementType::SNORM:
+				{
+					res = ConvertFormatDispatch3<src_type, ElementType::SNORM>(params);
+				}
+				break;
+				case ElementType::UINT:
+				{
+					res = ConvertFormatDispatch3<src_type, ElementType::UINT>(params);
+				}
+				break;
+				case ElementType::SINT:
+				{
+					res = ConvertFormatDispatch3<src_type, ElementType::SINT>(params);
+				}
+				break;
+				case ElementType::sRGB:
+				{
+					res = ConvertFormatDispatch3<src_type, ElementType::sRGB>(params);
+				}
+				break;
+				case ElementType::FLOAT:
+				{
+					res = ConvertFormatDispatch3<src_type, ElementType::FLOAT>(params);
+				}
+				break;
+				default:
+					res = false;
+					break;
+				}
+				return res;
+			}
+
+			static bool ConvertFormatDispatch1(ConvertParams const& params)
+			{
+				bool res = false;
+				switch (params.src_format.type)
+				{
+				case ElementType::UNORM:
+				{
+					res = ConvertFormatDispatch2<ElementType::UNORM>(params);
+				}
+				break;
+				case ElementType::SNORM:
+				{
+					res = ConvertFormatDispatch2<ElementType::SNORM>(params);
+				}
+				break;
+				case ElementType::UINT:
+				{
+					res = ConvertFormatDispatch2<ElementType::UINT>(params);
+				}
+				break;
+				case ElementType::SINT:
+				{
+					res = ConvertFormatDispatch2<ElementType::SINT>(params);
+				}
+				break;
+				case ElementType::sRGB:
+				{
+					res = ConvertFormatDispatch2<ElementType::sRGB>(params);
+				}
+				break;
+				case ElementType::FLOAT:
+				{
+					res = ConvertFormatDispatch2<ElementType::FLOAT>(params);
+				}
+				break;
+				default:
+					res = false;
+				break;
+				}
+				return res;
+			}
+
+
+			// dst can be src
+			static Result ConvertFormat(ConvertParams const& params);
+		};
+	}
+}
\ No newline at end of file
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <vector>
+#include <cassert>
+#include <algorithm>
+
+#include <that/core/Result.hpp>
+#include <that/img/Format.hpp>
+#include <that/img/ImageView.hpp>
+#include <that/img/ImageStorage.hpp>
+#include <that/img/Image.hpp>
+
+namespace that
+{
+	namespace img
+	{
+		// Multi dimensional image, following the Vulkan concept of Image:
+		// Up to 3D, with array layers and mip levels
+		// All the subresources (a mip level of a layer) are stored in a single aligned allocation
+		// Layout: layer 0 [mip 0, mip 1, ...], layer 1 [mip 0, mip 1, ...], ...
+		// Each subresource starts on an aligned offset and is packed (no row / slice padding)
+		class ImageResource
+		{
+		public:
+
+			using byte = uint8_t;
+
+			struct CreateInfo
+			{
+				FormatInfo format = {};
+				ImageExtent extent = {};
+				uint32_t layers = 1;
+				uint32_t mips = 1; // 0 means the full mip chain
+				size_t alignment = ImageStorage::DefaultAlignment();
+				bool zero_init = false;
+			};
+			using CI = CreateInfo;
+
+		protected:
+
+			FormatInfo _format = {};
+			ImageExtent _extent = {};
+			uint32_t _layers = 0;
+			uint32_t _mips = 0;
+			size_t _alignment = ImageStorage::DefaultAlignment();
+
+			// Byte offset of each subresource in _storage (indexed with subresourceIndex()), plus the total size at the end
+			std::vector<size_t> _offsets = {};
+
+			ImageStorage _storage = {};
+
+			void computeOffsets();
+
+		public:
+
+			ImageResource() = default;
+
+			ImageResource(CreateInfo const& ci);
+
+			// Adopts storage (for example a file mapping), which must hold the layout of ci (see ComputeLayout)
+			// ci.zero_init is ignored
+			ImageResource(CreateInfo const& ci, ImageStorage&& storage);
+
+			ImageResource(ImageResource const&) = default;
+			ImageResource(ImageResource&&) noexcept = default;
+
+			ImageResource& operator=(ImageResource const&) = default;
+			ImageResource& operator=(ImageResource&&) noexcept = default;
+
+			static constexpr ImageExtent MipExtent(ImageExtent const& extent, uint32_t mip)
+			{
+				const auto reduce = [mip](uint32_t e) -> uint32_t
+				{
+					const uint32_t r = mip < 32 ? (e >> mip) : 0;
+					return r ? r : 1;
+				};
+				return ImageExtent{
+					.width = reduce(extent.width),
+					.height = reduce(extent.height),
+					.depth = reduce(extent.depth),
+				};
+			}
+
+			static constexpr uint32_t MaxMipLevels(ImageExtent const& extent)
+			{
+				uint32_t m = std::max(std::max(extent.width, extent.height), extent.depth);
+				uint32_t res = 0;
+				while (m)
+				{
+					++res;
+					m >>= 1;
+				}
+				return res;
+			}
+
+			// Computes the byte offsets of a layout without allocating anything
+			// offsets.size() == layers * mips + 1, the last one is the total byte size
+			static void ComputeLayout(FormatInfo const& format, ImageExtent const& extent, uint32_t layers, uint32_t mips, size_t alignment, std::vector<size_t>& offsets);
+
+			constexpr FormatInfo format() const
+			{
+				return _format;
+			}
+
+			constexpr ImageExtent extent() const
+			{
+				return _extent;
+			}
+
+			constexpr ImageExtent extent(uint32_t mip) const
+			{
+				return MipExtent(_extent, mip);
+			}
+
+			constexpr uint32_t layers() const
+			{
+				return _layers;
+			}
+
+			constexpr uint32_t mips() const
+			{
+				return _mips;
+			}
+
+			constexpr uint32_t subresourceCount() const
+			{
+				return _layers * _mips;
+			}
+
+			constexpr size_t alignment() const
+			{
+				return _alignment;
+			}
+
+			bool empty() const
+			{
+				return _storage.empty();
+			}
+
+			size_t byteSize() const
+			{
+				return _storage.size();
+			}
+
+			const byte* rawData() const
+			{
+				return _storage.data();
+			}
+
+			byte* rawData()
+			{
+				return _storage.data();
+			}
+
+			constexpr uint32_t subresourceIndex(uint32_t layer, uint32_t mip) const
+			{
+				assert(layer < _layers);
+				assert(mip < _mips);
+				return layer * _mips + mip;
+			}
+
+			size_t subresourceOffset(uint32_t layer, uint32_t mip) const
+			{
+				return _offsets[subresourceIndex(layer, mip)];
+			}
+
+			size_t subresourceByteSize(uint32_t layer, uint32_t mip) const
+			{
+				assert(layer < _layers);
+				return extent(mip).pixelCount() * _format.pixelSize();
+			}
+
+			std::vector<size_t> const& offsets() const
+			{
+				return _offsets;
+			}
+
+			ImageView subresource(uint32_t layer, uint32_t mip = 0)
+			{
+				return ImageView(rawData() + subresourceOffset(layer, mip), _format, extent(mip));
+			}
+
+			ConstImageView subresource(uint32_t layer, uint32_t mip = 0) const
+			{
+				return ConstImageView(rawData() + subresourceOffset(layer, mip), _format, extent(mip));
+			}
+
+			// f(uint32_t layer, uint32_t mip, ImageView view)
+			template <class F>
+			void forEachSubresource(F const& f)
+			{
+				for (uint32_t l = 0; l < _layers; ++l)
+				{
+					for (uint32_t m = 0; m < _mips; ++m)
+					{
+						f(l, m, subresource(l, m));
+					}
+				}
+			}
+
+			// f(uint32_t layer, uint32_t mip, ConstImageView view)
+			template <class F>
+			void forEachSubresource(F const& f) const
+			{
+				for (uint32_t l = 0; l < _layers; ++l)
+				{
+					for (uint32_t m = 0; m < _mips; ++m)
+					{
+						f(l, m, subresource(l, m));
+					}
+				}
+			}
+
+			// Converts all the subresources to new_format
+			// In place if the pixel size does not change, else in a new allocation
+			Result reFormat(FormatInfo const& new_format);
+
+			// Converts one subresource into dst (dst.extent must match the subresource extent)
+			Result convertSubresource(uint32_t layer, uint32_t mip, ImageView const& dst) const;
+
+			// Copies (and converts if needed) a 2D image into a slice of a subresource
+			Result copyFromImage(FormatedImage const& src, uint32_t layer, uint32_t mip = 0, uint32_t slice = 0);
+
+			// Extracts a slice of a subresource as a 2D image
+			Result copyToImage(FormatedImage& dst, uint32_t layer, uint32_t mip = 0, uint32_t slice = 0) const;
+		};
+	}
+}
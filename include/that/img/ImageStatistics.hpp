@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+#include <span>
+
+#include <that/core/Result.hpp>
+#include <that/img/Format.hpp>
+#include <that/img/ImageView.hpp>
+#include <that/img/Image.hpp>
+#include <that/utils/EnumClassOperators.hpp>
+
+namespace that
+{
+	class ThreadPool;
+
+	namespace img
+	{
+		enum class StatisticsFlags : uint32_t
+		{
+			None = 0x0,
+			MinMax = 0x1,
+			MeanVariance = 0x2,
+			Histogram = 0x4,
+			All = MinMax | MeanVariance | Histogram,
+		};
+		THAT_DECLARE_ENUM_CLASS_OPERATORS(StatisticsFlags);
+
+		// Values are expressed in the "shader" range of the format:
+		// UNORM, sRGB: [0, 1] (sRGB is not linearized)
+		// SNORM: [-1, 1]
+		// UINT, SINT: raw integer value
+		// FLOAT: raw value
+		struct ChannelStatistics
+		{
+			double min = 0;
+			double max = 0;
+			double mean = 0;
+			double variance = 0;
+		};
+
+		struct ImageStatistics
+		{
+			size_t pixel_count = 0;
+			std::vector<ChannelStatistics> channels = {};
+			uint32_t histogram_bins = 0;
+			// channels.size() * histogram_bins counters, channel by channel
+			std::vector<uint64_t> histogram = {};
+
+			std::span<const uint64_t> channelHistogram(uint32_t c) const
+			{
+				return std::span<const uint64_t>(histogram.data() + size_t(c) * histogram_bins, histogram_bins);
+			}
+		};
+
+		struct ComputeStatisticsInfo
+		{
+			// All the requested statistics are computed in a single read of the pixels
+			StatisticsFlags flags = StatisticsFlags::All;
+			uint32_t histogram_bins = 256;
+			// Values outside of the range are counted in the first / last bin
+			double histogram_min = 0;
+			double histogram_max = 1;
+			ThreadPool* pool = nullptr; // optional, the default pool if nullptr
+		};
+
+		Result ComputeStatistics(ConstImageView const& view, ComputeStatisticsInfo const& info, ImageStatistics& result);
+
+		inline Result ComputeStatistics(FormatedImage const& img, ComputeStatisticsInfo const& info, ImageStatistics& result)
+		{
+			return ComputeStatistics(img.view(), info, result);
+		}
+	}
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+
+namespace that
+{
+	namespace img
+	{
+		// Raw, aligned memory block holding the pixels of an image.
+		// Unlike a std::vector, the memory is not zero initialized (unless requested).
+		// Copies are deep.
+		// The storage can also adopt external memory (a file mapping, a decoder's buffer, ...), released with a custom deleter.
+		class ImageStorage
+		{
+		public:
+
+			using byte = uint8_t;
+
+			// Called with the adopted pointer and size
+			using Deleter = std::function<void(byte*, size_t)>;
+
+			static constexpr size_t DefaultAlignment()
+			{
+				// Cache line size, also enough for any SIMD register
+				return 64;
+			}
+
+		protected:
+
+			byte* _data = nullptr;
+			size_t _size = 0;
+			// Size of the allocated (or adopted) block, _size can be smaller after a shrinking resize
+			size_t _capacity = 0;
+			size_t _alignment = DefaultAlignment();
+			Deleter _deleter = {};
+
+			void release();
+
+		public:
+
+			ImageStorage() = default;
+
+			ImageStorage(size_t size, size_t alignment = DefaultAlignment(), bool zero_init = false);
+
+			// Adopts data (size bytes), deleter is called on release (it can be empty if the memory outlives the storage)
+			ImageStorage(byte* data, size_t size, Deleter&& deleter);
+
+			ImageStorage(ImageStorage const& other);
+
+			ImageStorage(ImageStorage&& other) noexcept;
+
+			~ImageStorage();
+
+			ImageStorage& operator=(ImageStorage const& other);
+
+			ImageStorage& operator=(ImageStorage&& other) noexcept;
+
+			// Discards the previous content
+			void allocate(size_t size, size_t alignment = DefaultAlignment(), bool zero_init = false);
+
+			// Keeps the content (up to the new size), new bytes are zero only if requested
+			// External memory is copied to an owned allocation if it has to grow
+			void resize(size_t size, bool zero_init = false);
+
+			void clear();
+
+			void swap(ImageStorage& other) noexcept;
+
+			constexpr byte* data()
+			{
+				return _data;
+			}
+
+			constexpr const byte* data() const
+			{
+				return _data;
+			}
+
+			constexpr size_t size() const
+			{
+				return _size;
+			}
+
+			constexpr size_t alignment() const
+			{
+				return _alignment;
+			}
+
+			constexpr bool empty() const
+			{
+				return _size == 0;
+			}
+
+			bool isExternal() const
+			{
+				return !!_deleter;
+			}
+		};
+	}
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+
+#include <that/img/Format.hpp>
+
+namespace that
+{
+	namespace img
+	{
+		struct ImageExtent
+		{
+			uint32_t width = 1;
+			uint32_t height = 1;
+			uint32_t depth = 1;
+
+			constexpr size_t pixelCount() const
+			{
+				return size_t(width) * size_t(height) * size_t(depth);
+			}
+
+			constexpr bool operator==(ImageExtent const& other) const
+			{
+				return width == other.width && height == other.height && depth == other.depth;
+			}
+		};
+
+		// Non owning view on the pixels of a (up to 3D) image
+		// Pixels are stored x first, then y, then z (row major)
+		// Rows and slices can be padded (pitches are in bytes)
+		template <class Byte>
+		struct BasicImageView
+		{
+			Byte* data = nullptr;
+			FormatInfo format = {};
+			ImageExtent extent = {};
+			size_t row_pitch = 0;
+			size_t slice_pitch = 0;
+
+			constexpr BasicImageView() = default;
+
+			constexpr BasicImageView(Byte* data, FormatInfo const& format, ImageExtent const& extent, size_t row_pitch = 0, size_t slice_pitch = 0) :
+				data(data),
+				format(format),
+				extent(extent),
+				row_pitch(row_pitch ? row_pitch : size_t(extent.width) * format.pixelSize()),
+				slice_pitch(slice_pitch ? slice_pitch : this->row_pitch * extent.height)
+			{}
+
+			// Implicit conversion from a mutable view to a const view
+			template <class Q>
+				requires (std::is_const<Byte>::value && !std::is_const<Q>::value)
+			constexpr BasicImageView(BasicImageView<Q> const& other) :
+				data(other.data),
+				format(other.format),
+				extent(other.extent),
+				row_pitch(other.row_pitch),
+				slice_pitch(other.slice_pitch)
+			{}
+
+			constexpr size_t pixelSize() const
+			{
+				return format.pixelSize();
+			}
+
+			constexpr size_t pixelCount() const
+			{
+				return extent.pixelCount();
+			}
+
+			constexpr size_t byteSize() const
+			{
+				return slice_pitch * extent.depth;
+			}
+
+			// No padding between rows and slices: the whole view can be processed as a 1D array
+			constexpr bool isPacked() const
+			{
+				return row_pitch == size_t(extent.width) * pixelSize() && slice_pitch == row_pitch * extent.height;
+			}
+
+			constexpr bool empty() const
+			{
+				return data == nullptr || extent.pixelCount() == 0;
+			}
+
+			constexpr Byte* row(size_t y, size_t z = 0) const
+			{
+				return data + z * slice_pitch + y * row_pitch;
+			}
+
+			constexpr Byte* getPixelPtr(size_t x, size_t y, size_t z = 0) const
+			{
+				return row(y, z) + x * pixelSize();
+			}
+		};
+
+		using ImageView = BasicImageView<uint8_t>;
+		using ConstImageView = BasicImageView<const uint8_t>;
+	}
+}
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <span>
+#include <cstdint>
+
+#include <that/core/Result.hpp>
+#include <that/img/Format.hpp>
+#include <that/IO/FileSystem.hpp>
+#include <that/IO/Stream.hpp>
+
+namespace that
+{
+	class ThreadPool;
+
+	namespace img
+	{
+		namespace io
+		{
+			namespace netpbm
+			{
+				struct Header
+				{
+					std::string magic_number = "";
+					int width = 0, height = 0, max_value = 0;
+					// Number of channels (from the magic number, or DEPTH for P7)
+					int depth = 0;
+					// P7 only, can be empty
+					std::string tuple_type = "";
+
+					bool valid()const
+					{
+						return max_value > 0 && max_value <= 65535 && depth > 0 && depth <= 255;
+					}
+
+					bool validMagicNumber()const
+					{
+						return magic_number.size() == 2 && magic_number[0] == 'P' && (magic_number[1] >= '1' && magic_number[1] <= '7');
+					}
+				};
+
+				// Parses the header in [ptr, end), leaves ptr on the first byte of the pixels
+				// mode is the digit of the magic number (7 for PAM)
+				Result ParseHeader(const uint8_t*& ptr, const uint8_t* end, Header& header, int& mode);
+
+				// The format of the pixels once read (P1 / P4 bits are expanded to bytes)
+				// 8 bits samples are sRGB, wider samples (max_value > 255) are UNORM16
+				FormatInfo GetFormat(Header const& header, int mode);
+
+				// Size of a row in a binary file
+				size_t FileRowSize(int mode, size_t width, FormatInfo const& format);
+
+				// Decodes the rows of a binary file (P4 to P7) to the format given by GetFormat:
+				// P4 bits expansion, big endian 16 bits samples swap, rescaling when max_value is not 255 or 65535
+				class BinaryRowDecoder
+				{
+				protected:
+
+					int _mode = 0;
+					size_t _width = 0;
+					FormatInfo _format = {};
+					size_t _file_row_size = 0;
+					uint32_t _max_value = 0;
+					std::vector<uint8_t> _lut8 = {};
+					std::vector<uint16_t> _lut16 = {};
+
+				public:
+
+					void init(Header const& header, int mode);
+
+					FormatInfo const& format() const
+					{
+						return _format;
+					}
+
+					size_t fileRowSize() const
+					{
+						return _file_row_size;
+					}
+
+					size_t rowByteSize() const
+					{
+						return _width * _format.pixelSize();
+					}
+
+					// The file bytes are the decoded pixels
+					bool isIdentity() const;
+
+					// src and dst can be the same (except for P4)
+					void decode(const uint8_t* src, uint8_t* dst, size_t rows) const;
+				};
+
+				// Parses the pixels of a plain (ASCII) file: P1, P2 or P3
+				// [begin, end) starts right after the header, dst receives width * height * channels values (16 bits if max_value > 255)
+				// The text is split on line boundaries and parsed in parallel (pool == nullptr means the default pool)
+				Result ParseASCII(const uint8_t* begin, const uint8_t* end, int mode, int max_value, size_t value_count, uint8_t* dst, ThreadPool* pool = nullptr);
+
+				// 1 bit per pixel (1 is black), padded to a byte <-> 1 byte per pixel (0 or 255)
+				void UnpackBitmapRow(const uint8_t* src, uint8_t* dst, size_t width);
+				void PackBitmapRow(const uint8_t* src, uint8_t* dst, size_t width);
+
+				// Reads a binary NetPBM file (P4 to P7) by bands of rows, the memory used is independent of the image size
+				class StreamReader
+				{
+				public:
+
+					struct CreateInfo
+					{
+						FileSystem::Hint hint = FileSystem::Hint::None;
+						const FileSystem::Path* path = nullptr; // required
+						FileSystem* filesystem = nullptr; // optional
+					};
+					using CI = CreateInfo;
+
+				protected:
+
+					FileInputStream _file;
+					InputStream* _stream = nullptr;
+					Header _header = {};
+					int _mode = 0;
+					FormatInfo _format = {};
+					BinaryRowDecoder _decoder = {};
+					size_t _row = 0;
+					// Bytes read with the header that belong to the pixels
+					std::vector<uint8_t> _pending = {};
+					size_t _pending_offset = 0;
+					std::vector<uint8_t> _file_row = {};
+
+					Result readBytes(uint8_t* dst, size_t size);
+
+				public:
+
+					StreamReader() = default;
+
+					Result open(CreateInfo const& ci);
+
+					// Reads from stream (which must outlive the reader)
+					Result open(InputStream& stream);
+
+					void close();
+
+					Header const& header() const
+					{
+						return _header;
+					}
+
+					FormatInfo const& format() const
+					{
+						return _format;
+					}
+
+					size_t width() const
+					{
+						return _header.width;
+					}
+
+					size_t height() const
+					{
+						return _header.height;
+					}
+
+					size_t rowByteSize() const
+					{
+						return width() * _format.pixelSize();
+					}
+
+					size_t rowsLeft() const
+					{
+						return height() - _row;
+					}
+
+					// Reads the next min(rows, rowsLeft()) rows into dst, which must hold them (row major, packed)
+					Result readRows(std::span<uint8_t> dst, size_t rows);
+				};
+
+				// Writes a binary NetPBM file row by row, the rows are not kept in memory
+				// A file (ci.path) is only replaced by a successful close()
+				class StreamWriter
+				{
+				public:
+
+					struct CreateInfo
+					{
+						FileSystem::Hint hint = FileSystem::Hint::None;
+						const FileSystem::Path* path = nullptr; // required (unless a stream is provided)
+						FileSystem* filesystem = nullptr; // optional
+						size_t width = 0;
+						size_t height = 0;
+						// 8 or 16 bits, 1 or 3 channels (any for P7, 8 bits 1 channel for P4)
+						FormatInfo format = {};
+						// 4 to 7, -1 to deduce it from the channels
+						int magic_number = -1;
+						// P7 only, empty for the default one (GRAYSCALE, GRAYSCALE_ALPHA, RGB or RGB_ALPHA)
+						std::string tuple_type = "";
+					};
+					using CI = CreateInfo;
+
+				protected:
+
+					AtomicFileOutputStream _file;
+					OutputStream* _stream = nullptr;
+					size_t _width = 0;
+					size_t _height = 0;
+					size_t _row = 0;
+					int _mode = 0;
+					FormatInfo _format = {};
+					std::vector<uint8_t> _file_row = {};
+
+				public:
+
+					StreamWriter() = default;
+
+					Result open(CreateInfo const& ci);
+
+					// Writes to stream (which must outlive the writer), ci.path is ignored
+					Result open(OutputStream& stream, CreateInfo const& ci);
+
+					// src holds rows * width * pixel size bytes (row major, packed)
+					Result writeRows(std::span<const uint8_t> src, size_t rows);
+
+					// Fails if not all the rows were written
+					Result close();
+
+					size_t rowsLeft() const
+					{
+						return _height - _row;
+					}
+				};
+			}
+		}
+	}
+}
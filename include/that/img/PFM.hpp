@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+#include <that/core/Result.hpp>
+#include <that/img/Format.hpp>
+#include <that/IO/Stream.hpp>
+#include <that/img/RowSource.hpp>
+
+namespace that
+{
+	class ThreadPool;
+
+	namespace img
+	{
+		namespace io
+		{
+			// Portable Float Map: a text header ("PF" or "Pf", width height, scale) followed by raw float32 rows, bottom-up
+			namespace pfm
+			{
+				struct Header
+				{
+					int width = 0, height = 0;
+					// 3 (PF) or 1 (Pf)
+					uint32_t channels = 0;
+					// The sign gives the endianness of the samples (negative is little endian)
+					float scale = -1;
+
+					bool littleEndian() const
+					{
+						return scale < 0;
+					}
+				};
+
+				// Parses the header in [ptr, end), leaves ptr on the first byte of the pixels
+				Result ParseHeader(const uint8_t*& ptr, const uint8_t* end, Header& header);
+
+				// FLOAT 4 bytes, 1 or 3 channels
+				FormatInfo GetFormat(Header const& header);
+
+				// Copies the bottom-up rows of the file to top-down rows, swapping the bytes if the file endianness is not the native one
+				// src and dst can be the same (the rows are then swapped in place)
+				void CopyRows(const uint8_t* src, uint8_t* dst, Header const& header, ThreadPool* pool = nullptr);
+
+				// Writes the header and the rows (top-down, row major, native endianness), channels is 1 or 3
+				Result Write(OutputStream& stream, const float* pixels, size_t width, size_t height, uint32_t channels);
+
+				// The rows are requested in bands, from the bottom
+				Result Write(OutputStream& stream, RowSource const& rows, size_t width, size_t height, uint32_t channels);
+			}
+		}
+	}
+}
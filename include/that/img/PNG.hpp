@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+
+#include <that/core/Result.hpp>
+#include <that/IO/Stream.hpp>
+#include <that/img/RowSource.hpp>
+
+namespace that
+{
+	class ThreadPool;
+
+	namespace img
+	{
+		namespace io
+		{
+			// Native PNG writer (PNG files are read by stb_image): 8 or 16 bits, grey, grey alpha, RGB or RGBA
+			// The filter of each row is chosen in parallel (smallest sum of absolute differences among the 5 PNG filters)
+			// The filtered rows are compressed in stripes of about 1MB on worker threads: each stripe is a deflate segment ending with a sync flush,
+			// primed with the last 32KB of the previous stripe (like pigz), and the segments are concatenated in one zlib stream (one IDAT chunk per stripe)
+			// The stripes don't depend on the number of threads: the output is deterministic
+			namespace png
+			{
+				// Default deflate level
+				constexpr const int DefaultLevel = 6;
+
+				// pixels: row major, 1 to 4 channels of elem_size (1 or 2) bytes, 16 bits samples in native endianness
+				// level: -1 for DefaultLevel
+				//  0: no compression, no filter and stored deflate blocks (about the speed of a copy)
+				//  1: fastest compression, Sub filter on every row and run length only deflate
+				//  2 to 9: adaptive filters and deflate level (larger is smaller and slower)
+				Result Encode(OutputStream& stream, const uint8_t* pixels, size_t width, size_t height, uint32_t channels, uint32_t elem_size, int level = -1, ThreadPool* pool = nullptr);
+
+				// The rows are requested in bands while filtering (rows.row_bytes must be width * channels * elem_size)
+				Result Encode(OutputStream& stream, RowSource const& rows, size_t width, size_t height, uint32_t channels, uint32_t elem_size, int level = -1, ThreadPool* pool = nullptr);
+			}
+		}
+	}
+}
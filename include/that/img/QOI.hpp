@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+#include <that/core/Result.hpp>
+#include <that/img/Format.hpp>
+#include <that/img/Image.hpp>
+#include <that/IO/Stream.hpp>
+
+namespace that
+{
+	class ThreadPool;
+
+	namespace img
+	{
+		namespace io
+		{
+			// The Quite OK Image format (https://qoiformat.org/qoi-specification.pdf): 8 bits RGB or RGBA, lossless
+			// .qoi: a standard QOI file, encoded and decoded sequentially
+			// .qois: the image is split in stripes of rows encoded independently (in parallel), in a small container:
+			//  "qois" magic, the QOI header fields, stripe rows, stripe count, the byte size of each stripe, then the QOI chunks of each stripe
+			// All the header fields are big endian, like in QOI
+			namespace qoi
+			{
+				// Largest image accepted by the decoder (as in the reference implementation), its byte size always fits in a size_t
+				constexpr const size_t PixelsMax = 400000000;
+
+				struct Header
+				{
+					uint32_t width = 0;
+					uint32_t height = 0;
+					// 3 or 4
+					uint8_t channels = 0;
+					// 0: sRGB color with linear alpha, 1: all linear
+					uint8_t colorspace = 0;
+					// Striped container only
+					bool striped = false;
+					uint32_t stripe_rows = 0;
+					uint32_t stripe_count = 0;
+				};
+
+				// Parses the header of a .qoi or .qois file, rejects the images of more than PixelsMax pixels
+				Result ParseHeader(std::span<const uint8_t> file, Header& header);
+
+				// sRGB 8 bits if colorspace is 0, else UNORM
+				FormatInfo GetFormat(Header const& header);
+
+				// Decodes file into dst (width * height * channels bytes, row major)
+				// The stripes of a .qois file are decoded in parallel (pool == nullptr means the default pool)
+				Result Decode(std::span<const uint8_t> file, Header const& header, uint8_t* dst, ThreadPool* pool = nullptr);
+
+				// pixels: 8 bits, row major, 1 to 4 channels (grey is written as RGB, grey alpha as RGBA)
+				// srgb selects the colorspace field
+				// striped: .qois container, the stripes are encoded in parallel
+				Result Encode(OutputStream& stream, const uint8_t* pixels, size_t width, size_t height, uint32_t channels, bool srgb, bool striped, ThreadPool* pool = nullptr);
+			}
+		}
+	}
+}
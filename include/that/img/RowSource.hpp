@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+#include <functional>
+
+namespace that
+{
+	namespace img
+	{
+		namespace io
+		{
+			// The rows of an image as an encoder consumes them (row major): stored, or produced on demand (like converted from another format)
+			// Lets an encoder convert a band of rows into a small scratch buffer right before using it, instead of converting the whole image first
+			struct RowSource
+			{
+				// Bands of about this size are a good trade-off between the scratch memory and the overhead per band
+				static constexpr const size_t DefaultBandBytes = size_t(1) << 20;
+
+				// Used if produce is empty
+				const uint8_t* pixels = nullptr;
+				// Size of a row, in the format the encoder expects
+				size_t row_bytes = 0;
+				// Writes the rows [begin, end) in dst (contiguous), must be safe to call from multiple threads (on different rows)
+				std::function<void(size_t begin, size_t end, uint8_t* dst)> produce = {};
+
+				// The rows [begin, end), in scratch if they have to be produced (valid until the next call with the same scratch)
+				const uint8_t* rows(size_t begin, size_t end, std::vector<uint8_t>& scratch) const
+				{
+					if (!produce)
+					{
+						return pixels + begin * row_bytes;
+					}
+					scratch.resize((end - begin) * row_bytes);
+					produce(begin, end, scratch.data());
+					return scratch.data();
+				}
+
+				// Number of rows of a band of about band_bytes (at least 1)
+				size_t bandRows(size_t band_bytes = DefaultBandBytes) const
+				{
+					return row_bytes ? std::max<size_t>(1, band_bytes / row_bytes) : 1;
+				}
+			};
+		}
+	}
+}
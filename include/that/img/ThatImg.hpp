@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <that/core/Result.hpp>
+#include <that/img/Format.hpp>
+#include <that/img/Image.hpp>
+#include <that/img/ImageResource.hpp>
+#include <that/IO/FileSystem.hpp>
+#include <that/IO/Stream.hpp>
+
+namespace that
+{
+	class ThreadPool;
+
+	namespace img
+	{
+		namespace io
+		{
+			// Native raw container (.thatimg): a fixed header, the subresource offsets, then the raw (aligned) payload
+			// The layout of the payload is the one of ImageResource, so a file mapping can be used as is
+			// The payload can also be split in independently compressed blocks (.thatimgz), listed in a block index after the offsets
+			// All the fields are little endian
+			namespace thatimg
+			{
+				enum class Compression : uint8_t
+				{
+					None,
+					// LZ4 blocks (see that/utils/LZ4.hpp), a block that does not compress is stored as is
+					LZ4,
+				};
+
+				struct FileHeader
+				{
+					char magic[8] = {'T', 'H', 'A', 'T', 'I', 'M', 'G', '\0'};
+					uint32_t version = 1;
+					// Size of this header plus the offsets table (and the block index)
+					uint32_t header_size = 0;
+					uint16_t type = 0;
+					uint8_t elem_size = 0;
+					uint8_t channels = 0;
+					uint8_t row_major = 1;
+					uint8_t compression = uint8_t(Compression::None);
+					uint8_t reserved[2] = {};
+					uint32_t width = 0;
+					uint32_t height = 0;
+					uint32_t depth = 0;
+					uint32_t layers = 0;
+					uint32_t mips = 0;
+					// Of the payload offset and of the subresources in the payload
+					uint32_t alignment = 0;
+					uint64_t payload_offset = 0;
+					// Uncompressed
+					uint64_t payload_size = 0;
+				};
+				static_assert(sizeof(FileHeader) == 64);
+
+				// Max alignment, a file mapping is at least aligned on pages
+				constexpr const size_t MaxAlignment = 4096;
+
+				struct Header
+				{
+					FileHeader file = {};
+					FormatInfo format = {};
+					ImageExtent extent = {};
+					// From the start of the payload, subresourceCount() + 1 (see ImageResource::ComputeLayout)
+					std::vector<size_t> offsets = {};
+					// Compressed payloads only: uncompressed size of the blocks (except the last one)
+					size_t block_size = 0;
+					// Compressed payloads only: from the payload offset in the file, block count + 1
+					std::vector<size_t> block_offsets = {};
+
+					Compression compression() const
+					{
+						return Compression(file.compression);
+					}
+				};
+
+				// Only the fixed header (file can be the first bytes of the file): fills header.file, header.format and header.extent
+				Result ParseFileHeader(std::span<const uint8_t> file, Header& header);
+
+				// Validates the header, the offsets and the block index against the size of file
+				Result ParseHeader(std::span<const uint8_t> file, Header& header);
+
+				// Decompresses the bytes [offset, offset + dst.size()) of the payload into dst (random access: only the touched blocks are decompressed)
+				// The blocks are decompressed in parallel (pool == nullptr means the default pool)
+				// Also works (as a copy) for uncompressed files
+				Result ReadPayload(std::span<const uint8_t> file, Header const& header, size_t offset, std::span<uint8_t> dst, ThreadPool* pool = nullptr);
+
+				// A 2D image (one layer, one mip)
+				// The blocks are compressed in parallel, the compressed payload is held in memory until it is written
+				Result Write(OutputStream& stream, FormatlessImage const& image, FormatInfo const& format, bool row_major, Compression compression = Compression::None, ThreadPool* pool = nullptr);
+
+				Result Write(OutputStream& stream, ImageResource const& resource, Compression compression = Compression::None, ThreadPool* pool = nullptr);
+
+				struct ReadResourceInfo
+				{
+					FileSystem::Hint hint = FileSystem::Hint::None;
+					const FileSystem::Path* path = nullptr; // required
+					FileSystem* filesystem = nullptr; // optional
+					ImageResource* target = nullptr; // required
+					ThreadPool* pool = nullptr; // optional, to decompress
+				};
+
+				// Uncompressed: the pixels of target point into a copy on write mapping of the file
+				Result ReadImageResource(ReadResourceInfo const& info);
+
+				struct WriteResourceInfo
+				{
+					FileSystem::Hint hint = FileSystem::Hint::None;
+					const FileSystem::Path* path = nullptr; // required
+					FileSystem* filesystem = nullptr; // optional
+					const ImageResource* resource = nullptr; // required
+					Compression compression = Compression::None;
+					ThreadPool* pool = nullptr; // optional, to compress
+				};
+
+				Result WriteImageResource(WriteResourceInfo const& info);
+
+				// Maps the file at path (copy on write) and parses its header
+				Result MapFile(FileSystem::Hint hint, FileSystem::Path const& path, FileSystem* filesystem, MappedFile& mapped, Header& header);
+			}
+		}
+	}
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+namespace that
+{
+	namespace img
+	{
+		enum class ToneMapOperator : uint8_t
+		{
+			// Values above 1 are clamped (the default behavior of the FLOAT -> LDR conversions)
+			Clamp,
+			// x / (1 + x), per channel
+			Reinhard,
+			// Narkowicz's fit of the ACES filmic curve, per channel
+			ACES,
+			// Approximation of Blender's AgX base view (Rec.709 primaries)
+			AgX,
+		};
+
+		// Applied when converting FLOAT to a non FLOAT format (UNORM, SNORM, sRGB)
+		// The result is linear, it is then encoded by the conversion to the destination format (sRGB curve for example)
+		struct ToneMappingInfo
+		{
+			ToneMapOperator op = ToneMapOperator::Clamp;
+			// In stops: the linear values are multiplied by 2^exposure before the operator
+			float exposure = 0;
+
+			constexpr bool isIdentity() const
+			{
+				return op == ToneMapOperator::Clamp && exposure == 0;
+			}
+		};
+
+		// Tone maps the color channels of a linear pixel (the alpha channel is not touched)
+		class ToneMapper
+		{
+		protected:
+
+			ToneMapOperator _op;
+			float _scale;
+
+			static float Reinhard(float x)
+			{
+				return x / (1.0f + x);
+			}
+
+			static float ACES(float x)
+			{
+				const float a = 2.51f, b = 0.03f, c = 2.43f, d = 0.59f, e = 0.14f;
+				return (x * (a * x + b)) / (x * (c * x + d) + e);
+			}
+
+			static void AgX(float* rgb)
+			{
+				// Inset matrix, column major
+				constexpr const float inset[9] = {
+					0.842479062253094f, 0.0423282422610123f, 0.0423756549057051f,
+					0.0784335999999992f, 0.878468636469772f, 0.0784336f,
+					0.0792237451477643f, 0.0791661274605434f, 0.879142973793104f,
+				};
+				constexpr const float outset[9] = {
+					1.19687900512017f, -0.0528968517574562f, -0.0529716355144438f,
+					-0.0980208811401368f, 1.15190312990417f, -0.0980434501171241f,
+					-0.0990297440797205f, -0.0989611768448433f, 1.15107367264116f,
+				};
+				constexpr const float min_ev = -12.47393f;
+				constexpr const float max_ev = 4.026069f;
+				float v[3];
+				for (uint32_t i = 0; i < 3; ++i)
+				{
+					v[i] = inset[i] * rgb[0] + inset[3 + i] * rgb[1] + inset[6 + i] * rgb[2];
+				}
+				for (uint32_t i = 0; i < 3; ++i)
+				{
+					// log2 encoding, then the sigmoid contrast curve (6th order polynomial fit)
+					float x = std::log2(std::max(v[i], 1e-10f));
+					x = (std::clamp(x, min_ev, max_ev) - min_ev) / (max_ev - min_ev);
+					const float x2 = x * x;
+					const float x4 = x2 * x2;
+					v[i] = 15.5f * x4 * x2 - 40.14f * x4 * x + 31.96f * x4 - 6.868f * x2 * x + 0.4298f * x2 + 0.1191f * x - 0.00232f;
+				}
+				for (uint32_t i = 0; i < 3; ++i)
+				{
+					const float o = outset[i] * v[0] + outset[3 + i] * v[1] + outset[6 + i] * v[2];
+					// The curve outputs display encoded values (gamma 2.2), back to linear
+					rgb[i] = std::pow(std::clamp(o, 0.0f, 1.0f), 2.2f);
+				}
+			}
+
+		public:
+
+			ToneMapper(ToneMappingInfo const& info) :
+				_op(info.op),
+				_scale(std::exp2(info.exposure))
+			{}
+
+			// color_channels: the number of channels before alpha (1 to 3)
+			void operator()(float* color, uint32_t color_channels) const
+			{
+				for (uint32_t i = 0; i < color_channels; ++i)
+				{
+					color[i] *= _scale;
+				}
+				switch (_op)
+				{
+				case ToneMapOperator::Reinhard:
+					for (uint32_t i = 0; i < color_channels; ++i)
+					{
+						color[i] = Reinhard(std::max(color[i], 0.0f));
+					}
+				break;
+				case ToneMapOperator::ACES:
+					for (uint32_t i = 0; i < color_channels; ++i)
+					{
+						color[i] = ACES(std::max(color[i], 0.0f));
+					}
+				break;
+				case ToneMapOperator::AgX:
+					if (color_channels == 3)
+					{
+						AgX(color);
+					}
+					else
+					{
+						// Grey (or two channels): each one as a neutral color
+						for (uint32_t i = 0; i < color_channels; ++i)
+						{
+							float grey[3] = {color[i], color[i], color[i]};
+							AgX(grey);
+							color[i] = grey[0];
+						}
+					}
+				break;
+				default:
+				break;
+				}
+				for (uint32_t i = 0; i < color_channels; ++i)
+				{
+					color[i] = std::clamp(color[i], 0.0f, 1.0f);
+				}
+			}
+		};
+	}
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <coroutine>
+
+#include <that/core/Result.hpp>
+
+namespace that
+{
+	class ThreadPool;
+
+	// Result of an asynchronous operation, shared between the producer (AsyncPromise) and the consumers
+	// Can be waited on (blocking), given completion callbacks, or co_awaited from a coroutine
+	class AsyncResult
+	{
+	public:
+
+		using Callback = std::function<void(Result)>;
+
+	protected:
+
+		friend class AsyncPromise;
+
+		struct State
+		{
+			std::mutex mutex;
+			std::condition_variable condition;
+			bool done = false;
+			Result result = Result::Success;
+			std::vector<Callback> callbacks = {};
+		};
+
+		std::shared_ptr<State> _state = {};
+
+		AsyncResult(std::shared_ptr<State> const& state) :
+			_state(state)
+		{}
+
+	public:
+
+		constexpr AsyncResult() = default;
+
+		bool valid() const
+		{
+			return !!_state;
+		}
+
+		bool ready() const;
+
+		// Blocks until the operation is completed
+		Result wait() const;
+
+		// callback(result) is called once the operation is completed:
+		// by the thread completing it, or immediately by the calling thread if it is already completed
+		// Returns *this (to chain)
+		AsyncResult const& then(Callback&& callback) const;
+
+		// co_await support: the coroutine is resumed by the thread completing the operation (on the executor)
+		bool await_ready() const
+		{
+			return ready();
+		}
+
+		bool await_suspend(std::coroutine_handle<> handle) const;
+
+		Result await_resume() const
+		{
+			return wait();
+		}
+	};
+
+	// Producer side of an AsyncResult
+	class AsyncPromise
+	{
+	protected:
+
+		std::shared_ptr<AsyncResult::State> _state;
+
+	public:
+
+		AsyncPromise();
+
+		AsyncResult getResult() const
+		{
+			return AsyncResult(_state);
+		}
+
+		// Must be called exactly once: wakes the waiters and calls the callbacks (on the calling thread)
+		void complete(Result result);
+	};
+
+	// Runs f() (returning a Result) on the executor (ThreadPool::Default() if nullptr)
+	// f is moved in the task: it must own (or outlive) everything it references
+	AsyncResult RunAsync(std::function<Result()>&& f, ThreadPool* executor = nullptr);
+}
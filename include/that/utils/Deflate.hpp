@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include <that/core/Result.hpp>
+
+namespace that
+{
+	// Deflate (RFC 1951) compressor and decompressor, the zlib (RFC 1950) container and checksums
+	// Raw deflate segments can be compressed independently and concatenated (like pigz):
+	// every segment but the last ends with an empty stored block (a sync flush), so it ends on a byte boundary
+	namespace deflate
+	{
+		struct CompressInfo
+		{
+			// 0: stored blocks only, 1 (fastest) to 9 (smallest)
+			int level = 6;
+			// Run length only (like zlib's Z_RLE): the matches are repetitions of the previous byte, without hash chains
+			// Much faster than level 1, efficient on filtered image rows (ignored if level is 0)
+			bool rle = false;
+			// The last segment of the stream (its last block has BFINAL set)
+			bool final = true;
+			// The bytes [src - dictionary_size, src) are readable and precede src in the stream (the matches can refer to them)
+			// Only the last 32KB are used
+			size_t dictionary_size = 0;
+		};
+
+		// Appends the raw deflate segment of src to dst
+		void Compress(const uint8_t* src, size_t src_size, CompressInfo const& info, std::vector<uint8_t>& dst);
+
+		// Decompresses the raw deflate stream src into dst, dst_size must be the exact decompressed size
+		// Returns WrongFileFormat on malformed (or truncated) data, never reads or writes out of the buffers
+		Result Decompress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_size);
+
+		// zlib stream: header, deflate stream (a single segment) and Adler32
+		void ZlibCompress(const uint8_t* src, size_t src_size, int level, std::vector<uint8_t>& dst);
+
+		// Also checks the Adler32
+		Result ZlibDecompress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_size);
+
+		// The 2 bytes zlib header (32KB window, no preset dictionary)
+		void ZlibHeader(int level, uint8_t header[2]);
+
+		uint32_t Adler32(const uint8_t* data, size_t size, uint32_t adler = 1);
+
+		// Adler32 of the concatenation of two buffers (of Adler32 adler1 and adler2), the second one being size2 bytes long
+		uint32_t Adler32Combine(uint32_t adler1, uint32_t adler2, size_t size2);
+
+		uint32_t CRC32(const uint8_t* data, size_t size, uint32_t crc = 0);
+	}
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include <that/core/Result.hpp>
+
+namespace that
+{
+	// LZ4 block format (no frame): greedy hash-chain-less compressor, fast decompressor
+	// Compatible with the reference implementation (LZ4_compress_default / LZ4_decompress_safe)
+	namespace lz4
+	{
+		// Max compressed size of src_size bytes
+		constexpr size_t CompressBound(size_t src_size)
+		{
+			return src_size + src_size / 255 + 16;
+		}
+
+		// Returns the compressed size, or 0 if dst is too small (capacity >= CompressBound(src_size) never fails)
+		// acceleration >= 1: larger is faster, with a lower ratio
+		size_t Compress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t capacity, uint32_t acceleration = 1);
+
+		// dst_size must be the exact decompressed size
+		// Returns WrongFileFormat on malformed (or truncated) data, never reads or writes out of the buffers
+		Result Decompress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_size);
+	}
+}
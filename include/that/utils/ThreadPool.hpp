@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+
+namespace that
+{
+	// Basic pool of worker threads executing tasks in FIFO order
+	class ThreadPool
+	{
+	public:
+
+		using Task = std::function<void()>;
+
+		struct CreateInfo
+		{
+			uint32_t threads = 0; // 0 means std::thread::hardware_concurrency()
+		};
+		using CI = CreateInfo;
+
+	protected:
+
+		std::vector<std::thread> _threads = {};
+
+		std::mutex _mutex;
+		std::condition_variable _condition;
+		std::deque<Task> _tasks = {};
+		bool _stop = false;
+
+		void workerLoop();
+
+	public:
+
+		ThreadPool();
+
+		ThreadPool(CreateInfo const& ci);
+
+		ThreadPool(ThreadPool const&) = delete;
+		ThreadPool& operator=(ThreadPool const&) = delete;
+
+		// Waits for the queued tasks to be executed
+		~ThreadPool();
+
+		size_t threadCount() const
+		{
+			return _threads.size();
+		}
+
+		void push(Task&& task);
+
+		// Calls f(i) for i in [0, count)
+		// The calling thread participates, so it is safe to call from a task of the same pool
+		// Returns once every f(i) has returned
+		void parallelFor(size_t count, std::function<void(size_t)> const& f);
+
+		// Process wide pool, created on first use
+		static ThreadPool& Default();
+	};
+
+	// Splits [0, count) in contiguous ranges of at least min_grain elements and calls f(begin, end) on each of them in parallel
+	// pool == nullptr means ThreadPool::Default()
+	template <class F>
+	void ParallelForRange(size_t count, size_t min_grain, F const& f, ThreadPool* pool = nullptr)
+	{
+		if (count == 0)
+		{
+			return;
+		}
+		min_grain = min_grain ? min_grain : 1;
+		ThreadPool& p = pool ? *pool : ThreadPool::Default();
+		const size_t max_tasks = (p.threadCount() + 1) * 4;
+		const size_t tasks = std::max<size_t>(1, std::min<size_t>(count / min_grain, max_tasks));
+		if (tasks == 1)
+		{
+			f(size_t(0), count);
+		}
+		else
+		{
+			const size_t per_task = count / tasks;
+			const size_t remainder = count % tasks;
+			p.parallelFor(tasks, [&](size_t t)
+			{
+				const size_t begin = t * per_task + std::min(t, remainder);
+				const size_t end = begin + per_task + (t < remainder ? 1 : 0);
+				f(begin, end);
+			});
+		}
+	}
+}
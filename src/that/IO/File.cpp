@@ -3,6 +3,7 @@
 #include <fstream>
 #include <thread>
 #include <chrono>
+#include <algorithm>
 
 #if _WINDOWS
 #include <Windows.h>
@@ -10,7 +11,7 @@
 
 namespace that
 {
-	Result ReadFile(std::filesystem::path const& path, std::vector<uint8_t> & res)
+	Result ReadFile(std::filesystem::path const& path, std::vector<uint8_t> & res, size_t max_size)
 	{
 		Result result = Result::Success;
 		if (std::filesystem::exists(path))
@@ -22,7 +23,7 @@ namespace that
 				return result;
 			}
 
-			size_t size = file.tellg();
+			const size_t size = std::min<size_t>(file.tellg(), max_size);
 			res.resize(size);
 			file.seekg(0);
 			file.read((char*)res.data(), size);
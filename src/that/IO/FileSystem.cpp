@@ -277,6 +277,15 @@ namespace that
 		return isCannon(_tmp_path2.value);
 	}
 
+	ResultAnd<FileSystem::Path> FileSystem::ResolveFilePath(Path const& path, Hint hint, FileSystem* fs)
+	{
+		if (!fs || !!(hint & Hint::PathIsNative))
+		{
+			return {Result::Success, path};
+		}
+		return fs->resolve(path, hint);
+	}
+
 	Result FileSystem::readFile(ReadFileInfo const& info)
 	{
 		Result res = Result::Success;
@@ -319,7 +328,7 @@ namespace that
 		{
 			if (info.result_vector)
 			{
-				res = ::that::ReadFile(*info.path, *info.result_vector);
+				res = ::that::ReadFile(*info.path, *info.result_vector, info.max_size);
 			}
 			else if (info.result_string)
 			{
@@ -406,6 +415,63 @@ namespace that
 		}
 	}
 
+	Result FileSystem::mapFile(MapFileInfo const& info)
+	{
+		Result res = Result::Success;
+		if (info.path)
+		{
+			const Path* path;
+			if (!!(info.hint & Hint::PathIsNative))
+			{
+				path = info.path;
+			}
+			else
+			{
+				_tmp_path = resolve(*info.path);
+				if (_tmp_path.result != Result::Success)
+				{
+					return _tmp_path.result;
+				}
+				path = &_tmp_path.value;
+			}
+
+			MapFileInfo info2 = info;
+			info2.path = path;
+			res = MapFileFromDisk(info2);
+		}
+		else
+		{
+			res = Result::InvalidParameter;
+		}
+		return res;
+	}
+
+	Result FileSystem::MapFileFromDisk(MapFileInfo const& info)
+	{
+		Result res = Result::Success;
+		if (!info.path || !info.result)
+		{
+			res = Result::InvalidParameter;
+		}
+		else
+		{
+			res = info.result->open(*info.path, info.copy_on_write);
+		}
+		return res;
+	}
+
+	Result FileSystem::MapFile(MapFileInfo const& info, FileSystem* fs)
+	{
+		if (fs)
+		{
+			return fs->mapFile(info);
+		}
+		else
+		{
+			return FileSystem::MapFileFromDisk(info);
+		}
+	}
+
 	ResultAnd<FileSystem::TimePoint> FileSystem::getFileLastWriteTime(Path const& path, Hint hint) const
 	{
 		FileInfos const& infos = getFileInfos(path, hint, true, false);
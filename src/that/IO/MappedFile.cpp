@@ -0,0 +1,146 @@
+#include <that/IO/MappedFile.hpp>
+
+#include <utility>
+
+#if _WINDOWS
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace that
+{
+	MappedFile::MappedFile(MappedFile&& other) noexcept
+	{
+		*this = std::move(other);
+	}
+
+	MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+	{
+		if (this != &other)
+		{
+			close();
+			std::swap(_data, other._data);
+			std::swap(_size, other._size);
+#if _WINDOWS
+			std::swap(_file, other._file);
+			std::swap(_mapping, other._mapping);
+#else
+			std::swap(_fd, other._fd);
+#endif
+		}
+		return *this;
+	}
+
+	MappedFile::~MappedFile()
+	{
+		close();
+	}
+
+	Result MappedFile::open(std::filesystem::path const& path, bool copy_on_write)
+	{
+		close();
+		std::error_code ec;
+		if (!std::filesystem::exists(path, ec))
+		{
+			return Result::FileDoesNotExist;
+		}
+#if _WINDOWS
+		HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			return Result::CannotOpenFile;
+		}
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size))
+		{
+			CloseHandle(file);
+			return Result::FileReadError;
+		}
+		_file = file;
+		_size = static_cast<size_t>(size.QuadPart);
+		if (_size == 0)
+		{
+			// Empty files can't be mapped
+			return Result::Success;
+		}
+		HANDLE mapping = CreateFileMappingW(file, nullptr, copy_on_write ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+		if (!mapping)
+		{
+			close();
+			return Result::FileReadError;
+		}
+		_mapping = mapping;
+		void* view = MapViewOfFile(mapping, copy_on_write ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+		if (!view)
+		{
+			close();
+			return Result::FileReadError;
+		}
+		_data = static_cast<uint8_t*>(view);
+#else
+		const int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			return Result::CannotOpenFile;
+		}
+		struct stat st;
+		if (::fstat(fd, &st) != 0)
+		{
+			::close(fd);
+			return Result::FileReadError;
+		}
+		_fd = fd;
+		_size = static_cast<size_t>(st.st_size);
+		if (_size == 0)
+		{
+			return Result::Success;
+		}
+		const int prot = copy_on_write ? (PROT_READ | PROT_WRITE) : PROT_READ;
+		void* view = ::mmap(nullptr, _size, prot, MAP_PRIVATE, fd, 0);
+		if (view == MAP_FAILED)
+		{
+			close();
+			return Result::FileReadError;
+		}
+		::madvise(view, _size, MADV_SEQUENTIAL);
+		_data = static_cast<uint8_t*>(view);
+#endif
+		return Result::Success;
+	}
+
+	void MappedFile::close()
+	{
+#if _WINDOWS
+		if (_data)
+		{
+			UnmapViewOfFile(_data);
+		}
+		if (_mapping)
+		{
+			CloseHandle(_mapping);
+		}
+		if (_file)
+		{
+			CloseHandle(_file);
+		}
+		_mapping = nullptr;
+		_file = nullptr;
+#else
+		if (_data)
+		{
+			::munmap(_data, _size);
+		}
+		if (_fd >= 0)
+		{
+			::close(_fd);
+		}
+		_fd = -1;
+#endif
+		_data = nullptr;
+		_size = 0;
+	}
+}
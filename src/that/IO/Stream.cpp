@@ -0,0 +1,301 @@
+#include <that/IO/Stream.hpp>
+
+#include <that/IO/File.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <string>
+
+namespace that
+{
+	Result FileOutputStream::open(std::filesystem::path const& path, bool create_directories)
+	{
+		Result result = Result::Success;
+		if (_file.is_open())
+		{
+			_file.close();
+		}
+		if (create_directories && path.has_parent_path())
+		{
+			result = CreateDirectoriesIFP(path.parent_path());
+			if (result != Result::Success)
+			{
+				return result;
+			}
+		}
+		_file.open(path, std::ios::binary | std::ios::trunc);
+		if (!_file.is_open())
+		{
+			result = Result::CannotOpenFile;
+		}
+		return result;
+	}
+
+	Result FileOutputStream::close()
+	{
+		Result result = Result::Success;
+		if (_file.is_open())
+		{
+			_file.close();
+			if (_file.fail())
+			{
+				result = Result::FileWriteError;
+			}
+		}
+		return result;
+	}
+
+	Result FileOutputStream::write(std::span<const uint8_t> data)
+	{
+		if (!_file.is_open())
+		{
+			return Result::InvalidValue;
+		}
+		_file.write(reinterpret_cast<const char*>(data.data()), data.size());
+		return _file.good() ? Result::Success : Result::FileWriteError;
+	}
+
+	namespace
+	{
+		// Unique to this process (and to each call): concurrent writes of the same file, from any process, use different temporary files
+		std::filesystem::path MakeTemporaryPath(std::filesystem::path const& path)
+		{
+			static const uint64_t process_nonce = (uint64_t(std::random_device{}()) << 32) ^ std::random_device{}();
+			static std::atomic<uint64_t> counter = 0;
+			std::filesystem::path res = path;
+			res += "." + std::to_string(process_nonce) + "-" + std::to_string(counter.fetch_add(1)) + ".tmp";
+			return res;
+		}
+	}
+
+	AtomicFileOutputStream::~AtomicFileOutputStream()
+	{
+		discard();
+	}
+
+	Result AtomicFileOutputStream::open(std::filesystem::path const& path, bool create_directories)
+	{
+		discard();
+		_path = path;
+		_tmp_path = MakeTemporaryPath(path);
+		Result result = FileOutputStream::open(_tmp_path, create_directories);
+		if (result != Result::Success)
+		{
+			_tmp_path.clear();
+		}
+		return result;
+	}
+
+	Result AtomicFileOutputStream::commit()
+	{
+		if (!isOpen())
+		{
+			return Result::Success;
+		}
+		Result result = close();
+		if (result == Result::Success)
+		{
+			std::error_code ec;
+			std::filesystem::rename(_tmp_path, _path, ec);
+			if (ec)
+			{
+				result = Result::FileWriteError;
+			}
+			else
+			{
+				_tmp_path.clear();
+			}
+		}
+		discard();
+		return result;
+	}
+
+	void AtomicFileOutputStream::discard()
+	{
+		close();
+		if (!_tmp_path.empty())
+		{
+			std::error_code ec;
+			std::filesystem::remove(_tmp_path, ec);
+			_tmp_path.clear();
+		}
+	}
+
+	Result MemoryOutputStream::write(std::span<const uint8_t> data)
+	{
+		if (!data.empty())
+		{
+			_storage.pushBack(data.data(), data.size());
+		}
+		return Result::Success;
+	}
+
+	Result FileOutputStream::flush()
+	{
+		if (!_file.is_open())
+		{
+			return Result::InvalidValue;
+		}
+		_file.flush();
+		return _file.good() ? Result::Success : Result::FileWriteError;
+	}
+
+	AsyncBufferedOutputStream::AsyncBufferedOutputStream(OutputStream& target, size_t buffer_size) :
+		_target(target),
+		_buffer_size(std::max<size_t>(buffer_size, 1))
+	{
+		_filling.reserve(_buffer_size);
+	}
+
+	AsyncBufferedOutputStream::~AsyncBufferedOutputStream()
+	{
+		if (_thread.joinable() || !_filling.empty())
+		{
+			finish();
+		}
+	}
+
+	void AsyncBufferedOutputStream::writerLoop()
+	{
+		std::unique_lock lock(_mutex);
+		while (true)
+		{
+			_condition.wait(lock, [this]() {return _stop || _has_pending; });
+			if (!_has_pending)
+			{
+				return;
+			}
+			lock.unlock();
+			Result result = Result::Success;
+			if (_result == Result::Success)
+			{
+				result = _target.write(_pending);
+			}
+			lock.lock();
+			if (_result == Result::Success)
+			{
+				_result = result;
+			}
+			_pending.clear();
+			_has_pending = false;
+			_condition.notify_all();
+		}
+	}
+
+	void AsyncBufferedOutputStream::submit()
+	{
+		std::unique_lock lock(_mutex);
+		_condition.wait(lock, [this]() {return !_has_pending; });
+		std::swap(_filling, _pending);
+		_has_pending = true;
+		if (!_thread.joinable())
+		{
+			_filling.reserve(_buffer_size);
+			_thread = std::thread([this]() {writerLoop(); });
+		}
+		lock.unlock();
+		_condition.notify_all();
+	}
+
+	Result AsyncBufferedOutputStream::wait()
+	{
+		std::unique_lock lock(_mutex);
+		_condition.wait(lock, [this]() {return !_has_pending; });
+		return _result;
+	}
+
+	Result AsyncBufferedOutputStream::write(std::span<const uint8_t> data)
+	{
+		while (!data.empty())
+		{
+			const size_t n = std::min(data.size(), _buffer_size - _filling.size());
+			_filling.insert(_filling.end(), data.begin(), data.begin() + n);
+			data = data.subspan(n);
+			if (_filling.size() == _buffer_size)
+			{
+				submit();
+			}
+		}
+		std::unique_lock lock(_mutex);
+		return _result;
+	}
+
+	Result AsyncBufferedOutputStream::flush()
+	{
+		Result result = wait();
+		if (result == Result::Success && !_filling.empty())
+		{
+			// The last (partial) buffer is written by the calling thread
+			result = _target.write(_filling);
+			_filling.clear();
+			std::unique_lock lock(_mutex);
+			_result = result;
+		}
+		if (result == Result::Success)
+		{
+			result = _target.flush();
+		}
+		return result;
+	}
+
+	Result AsyncBufferedOutputStream::finish()
+	{
+		const Result result = flush();
+		if (_thread.joinable())
+		{
+			{
+				std::unique_lock lock(_mutex);
+				_stop = true;
+			}
+			_condition.notify_all();
+			_thread.join();
+		}
+		return result;
+	}
+
+	Result FileInputStream::open(std::filesystem::path const& path)
+	{
+		if (_file.is_open())
+		{
+			_file.close();
+		}
+		std::error_code ec;
+		if (!std::filesystem::exists(path, ec))
+		{
+			return Result::FileDoesNotExist;
+		}
+		_file.open(path, std::ios::binary);
+		if (!_file.is_open())
+		{
+			return Result::CannotOpenFile;
+		}
+		return Result::Success;
+	}
+
+	void FileInputStream::close()
+	{
+		if (_file.is_open())
+		{
+			_file.close();
+		}
+	}
+
+	Result FileInputStream::read(std::span<uint8_t> dst, size_t& read_count)
+	{
+		read_count = 0;
+		if (!_file.is_open())
+		{
+			return Result::InvalidValue;
+		}
+		_file.read(reinterpret_cast<char*>(dst.data()), dst.size());
+		read_count = static_cast<size_t>(_file.gcount());
+		if (_file.bad())
+		{
+			return Result::FileReadError;
+		}
+		// Reaching the end is not an error
+		_file.clear();
+		return Result::Success;
+	}
+}
@@ -0,0 +1,658 @@
+#include <that/img/EXR.hpp>
+
+#include <that/utils/ThreadPool.hpp>
+#include <that/utils/Deflate.hpp>
+#include <that/math/Half.hpp>
+
+#include <cstring>
+#include <atomic>
+#include <algorithm>
+#include <bit>
+
+namespace that
+{
+	namespace img
+	{
+		namespace io
+		{
+			namespace exr
+			{
+				using byte = uint8_t;
+
+				namespace
+				{
+					constexpr const byte Magic[4] = {0x76, 0x2F, 0x31, 0x01};
+					constexpr const uint32_t Version = 2;
+					constexpr const uint32_t TiledFlag = 0x200;
+					constexpr const uint32_t LongNamesFlag = 0x400;
+					constexpr const uint32_t NonImageFlag = 0x800;
+					constexpr const uint32_t MultiPartFlag = 0x1000;
+
+					// Largest image accepted by the reader (in pixels per side)
+					constexpr const int64_t MaxExtent = int64_t(1) << 24;
+
+					uint32_t ReadLE32(const byte* p)
+					{
+						return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+					}
+
+					uint64_t ReadLE64(const byte* p)
+					{
+						return uint64_t(ReadLE32(p)) | (uint64_t(ReadLE32(p + 4)) << 32);
+					}
+
+					void WriteLE32(std::vector<byte>& out, uint32_t v)
+					{
+						const byte b[4] = {byte(v), byte(v >> 8), byte(v >> 16), byte(v >> 24)};
+						out.insert(out.end(), b, b + 4);
+					}
+
+					void WriteLE64(byte* p, uint64_t v)
+					{
+						for (uint32_t i = 0; i < 8; ++i)
+						{
+							p[i] = byte(v >> (8 * i));
+						}
+					}
+
+					uint32_t TypeSize(PixelType type)
+					{
+						return type == PixelType::HALF ? 2 : 4;
+					}
+
+					// Reads a null terminated string of at most max_size characters
+					bool ReadString(const byte*& p, const byte* end, size_t max_size, std::string& s)
+					{
+						const byte* z = std::find(p, std::min(end, p + max_size + 1), byte(0));
+						if (z == end || z == p + max_size + 1)
+						{
+							return false;
+						}
+						s.assign(reinterpret_cast<const char*>(p), z - p);
+						p = z + 1;
+						return true;
+					}
+
+					// Image channel -> file channel
+					std::vector<uint32_t> ChannelOrder(Header const& header)
+					{
+						std::vector<uint32_t> order;
+						const auto find = [&](const char* name)
+						{
+							for (uint32_t c = 0; c < header.channels.size(); ++c)
+							{
+								if (header.channels[c].name == name)
+								{
+									return int(c);
+								}
+							}
+							return -1;
+						};
+						const int r = find("R"), g = find("G"), b = find("B"), a = find("A"), y = find("Y");
+						if (r >= 0 && g >= 0 && b >= 0)
+						{
+							order = {uint32_t(r), uint32_t(g), uint32_t(b)};
+						}
+						else if (y >= 0)
+						{
+							order = {uint32_t(y)};
+						}
+						if (!order.empty() && a >= 0)
+						{
+							order.push_back(uint32_t(a));
+						}
+						for (uint32_t c = 0; c < header.channels.size(); ++c)
+						{
+							if (std::find(order.begin(), order.end(), c) == order.end())
+							{
+								order.push_back(c);
+							}
+						}
+						return order;
+					}
+
+					// Preprocessing of RLE and ZIP: the bytes are split in two halves (even then odd indices), then delta encoded
+					void Preprocess(const byte* raw, size_t size, byte* out)
+					{
+						byte* t1 = out;
+						byte* t2 = out + (size + 1) / 2;
+						for (size_t i = 0; i < size; i += 2)
+						{
+							*t1++ = raw[i];
+							if (i + 1 < size)
+							{
+								*t2++ = raw[i + 1];
+							}
+						}
+						int p = size ? out[0] : 0;
+						for (size_t i = 1; i < size; ++i)
+						{
+							const int d = int(out[i]) - p + (128 + 256);
+							p = out[i];
+							out[i] = byte(d);
+						}
+					}
+
+					// Inverse of Preprocess (tmp is modified)
+					void Postprocess(byte* tmp, size_t size, byte* raw)
+					{
+						for (size_t i = 1; i < size; ++i)
+						{
+							tmp[i] = byte(int(tmp[i - 1]) + int(tmp[i]) - 128);
+						}
+						const byte* t1 = tmp;
+						const byte* t2 = tmp + (size + 1) / 2;
+						for (size_t i = 0; i < size; i += 2)
+						{
+							raw[i] = *t1++;
+							if (i + 1 < size)
+							{
+								raw[i + 1] = *t2++;
+							}
+						}
+					}
+
+					// OpenEXR's RLE: a positive count c is a run of c + 1 copies of the next byte, a negative count -c is followed by c literal bytes
+					// out must have RLEBound(size) bytes
+					size_t RLEBound(size_t size)
+					{
+						return size + size / 127 + 2;
+					}
+
+					size_t RLEEncode(const byte* in, size_t size, byte* out)
+					{
+						constexpr const ptrdiff_t MinRun = 3;
+						constexpr const ptrdiff_t MaxRun = 127;
+						const byte* const end = in + size;
+						const byte* run_start = in;
+						const byte* run_end = in + 1;
+						byte* w = out;
+						while (run_start < end)
+						{
+							while (run_end < end && *run_start == *run_end && run_end - run_start - 1 < MaxRun)
+							{
+								++run_end;
+							}
+							if (run_end - run_start >= MinRun)
+							{
+								*w++ = byte((run_end - run_start) - 1);
+								*w++ = *run_start;
+								run_start = run_end;
+							}
+							else
+							{
+								while (run_end < end &&
+									((run_end + 1 >= end || *run_end != *(run_end + 1)) || (run_end + 2 >= end || *(run_end + 1) != *(run_end + 2))) &&
+									run_end - run_start < MaxRun)
+								{
+									++run_end;
+								}
+								*w++ = byte(int8_t(run_start - run_end));
+								while (run_start < run_end)
+								{
+									*w++ = *run_start++;
+								}
+							}
+							++run_end;
+						}
+						return w - out;
+					}
+
+					bool RLEDecode(const byte* in, size_t in_size, byte* out, size_t out_size)
+					{
+						size_t i = 0, o = 0;
+						while (i < in_size)
+						{
+							const int c = int8_t(in[i++]);
+							if (c < 0)
+							{
+								const size_t count = size_t(-c);
+								if (i + count > in_size || o + count > out_size)
+								{
+									return false;
+								}
+								std::memcpy(out + o, in + i, count);
+								i += count;
+								o += count;
+							}
+							else
+							{
+								const size_t count = size_t(c) + 1;
+								if (i >= in_size || o + count > out_size)
+								{
+									return false;
+								}
+								std::memset(out + o, in[i++], count);
+								o += count;
+							}
+						}
+						return o == out_size;
+					}
+
+					void PutString(std::vector<byte>& out, const char* s)
+					{
+						out.insert(out.end(), s, s + std::strlen(s) + 1);
+					}
+
+					void PutAttribute(std::vector<byte>& out, const char* name, const char* type, std::vector<byte> const& value)
+					{
+						PutString(out, name);
+						PutString(out, type);
+						WriteLE32(out, uint32_t(value.size()));
+						out.insert(out.end(), value.begin(), value.end());
+					}
+				}
+
+				Result ParseHeader(std::span<const uint8_t> file, Header& header)
+				{
+					header = Header{};
+					if (file.size() < 8 || std::memcmp(file.data(), Magic, 4) != 0)
+					{
+						return Result::WrongFileFormat;
+					}
+					const uint32_t version = ReadLE32(file.data() + 4);
+					if ((version & 0xFF) != Version)
+					{
+						return Result::WrongFileFormat;
+					}
+					if (version & (TiledFlag | NonImageFlag | MultiPartFlag))
+					{
+						return Result::NotImplemented;
+					}
+					const size_t max_name = (version & LongNamesFlag) ? 255 : 31;
+					const byte* p = file.data() + 8;
+					const byte* const end = file.data() + file.size();
+					bool has_channels = false, has_compression = false, has_data_window = false;
+					while (true)
+					{
+						std::string name, type;
+						if (!ReadString(p, end, max_name, name))
+						{
+							return Result::WrongFileFormat;
+						}
+						if (name.empty())
+						{
+							break;
+						}
+						if (!ReadString(p, end, max_name, type) || end - p < 4)
+						{
+							return Result::WrongFileFormat;
+						}
+						const size_t size = ReadLE32(p);
+						p += 4;
+						if (size_t(end - p) < size)
+						{
+							return Result::WrongFileFormat;
+						}
+						const byte* value = p;
+						p += size;
+						if (name == "channels" && type == "chlist")
+						{
+							const byte* c = value;
+							const byte* const c_end = value + size;
+							while (true)
+							{
+								Channel channel;
+								if (!ReadString(c, c_end, max_name, channel.name))
+								{
+									return Result::WrongFileFormat;
+								}
+								if (channel.name.empty())
+								{
+									break;
+								}
+								if (c_end - c < 16)
+								{
+									return Result::WrongFileFormat;
+								}
+								const uint32_t pixel_type = ReadLE32(c);
+								const int32_t x_sampling = int32_t(ReadLE32(c + 8));
+								const int32_t y_sampling = int32_t(ReadLE32(c + 12));
+								c += 16;
+								if (pixel_type > uint32_t(PixelType::FLOAT))
+								{
+									return Result::WrongFileFormat;
+								}
+								if (x_sampling != 1 || y_sampling != 1)
+								{
+									return Result::NotImplemented;
+								}
+								channel.type = PixelType(pixel_type);
+								header.channels.push_back(std::move(channel));
+							}
+							has_channels = !header.channels.empty();
+						}
+						else if (name == "compression" && type == "compression" && size == 1)
+						{
+							if (value[0] > uint8_t(Compression::ZIP))
+							{
+								return Result::NotImplemented;
+							}
+							header.compression = Compression(value[0]);
+							has_compression = true;
+						}
+						else if (name == "dataWindow" && type == "box2i" && size == 16)
+						{
+							header.x_min = int32_t(ReadLE32(value));
+							header.y_min = int32_t(ReadLE32(value + 4));
+							header.x_max = int32_t(ReadLE32(value + 8));
+							header.y_max = int32_t(ReadLE32(value + 12));
+							has_data_window = true;
+						}
+					}
+					if (!has_channels || !has_compression || !has_data_window)
+					{
+						return Result::WrongFileFormat;
+					}
+					const int64_t w = int64_t(header.x_max) - header.x_min + 1;
+					const int64_t h = int64_t(header.y_max) - header.y_min + 1;
+					if (w <= 0 || h <= 0 || w > MaxExtent || h > MaxExtent)
+					{
+						return Result::WrongFileFormat;
+					}
+					const bool any_uint = std::any_of(header.channels.begin(), header.channels.end(), [](Channel const& c) {return c.type == PixelType::UINT; });
+					const bool all_uint = std::all_of(header.channels.begin(), header.channels.end(), [](Channel const& c) {return c.type == PixelType::UINT; });
+					if (any_uint && !all_uint)
+					{
+						return Result::CannotConvertFormat;
+					}
+					header.header_size = size_t(p - file.data());
+					return Result::Success;
+				}
+
+				FormatInfo GetFormat(Header const& header)
+				{
+					FormatInfo res{
+						.type = ElementType::FLOAT,
+						.elem_size = 2,
+						.channels = uint8_t(header.channels.size()),
+					};
+					for (Channel const& c : header.channels)
+					{
+						if (c.type == PixelType::UINT)
+						{
+							res.type = ElementType::UINT;
+						}
+						if (c.type != PixelType::HALF)
+						{
+							res.elem_size = 4;
+						}
+					}
+					return res;
+				}
+
+				Result Decode(std::span<const uint8_t> file, Header const& header, uint8_t* dst, ThreadPool* pool)
+				{
+					const size_t width = header.width();
+					const size_t height = header.height();
+					const size_t chunk_count = header.chunkCount();
+					const uint32_t lines_per_chunk = header.linesPerChunk();
+					if (header.header_size + chunk_count * 8 > file.size())
+					{
+						return Result::WrongFileFormat;
+					}
+					const FormatInfo format = GetFormat(header);
+					const size_t pixel_size = size_t(format.elem_size) * format.channels;
+					const std::vector<uint32_t> order = ChannelOrder(header);
+					// Offset of each file channel in a line of a chunk
+					std::vector<size_t> channel_offsets(header.channels.size());
+					size_t line_size = 0;
+					for (size_t c = 0; c < header.channels.size(); ++c)
+					{
+						channel_offsets[c] = line_size;
+						line_size += width * TypeSize(header.channels[c].type);
+					}
+					const byte* const offsets = file.data() + header.header_size;
+
+					// Each chunk must appear once: the offset table has chunk_count entries, so no chunk is missing if none is repeated
+					// (two tasks would write the same rows, and the rows of the missing chunk would not be initialized)
+					std::vector<std::atomic<uint8_t>> seen(chunk_count);
+					std::atomic<Result> result = Result::Success;
+					ParallelForRange(chunk_count, 1, [&](size_t begin, size_t end)
+					{
+						// Per task scratch
+						std::vector<byte> tmp, raw;
+						for (size_t i = begin; i < end && result == Result::Success; ++i)
+						{
+							const uint64_t offset = ReadLE64(offsets + i * 8);
+							if (offset > file.size() || file.size() - offset < 8)
+							{
+								result = Result::WrongFileFormat;
+								break;
+							}
+							const byte* chunk = file.data() + offset;
+							const int64_t y = int64_t(int32_t(ReadLE32(chunk))) - header.y_min;
+							const size_t data_size = ReadLE32(chunk + 4);
+							if (y < 0 || size_t(y) >= height || (y % lines_per_chunk) != 0 || data_size > file.size() - offset - 8)
+							{
+								result = Result::WrongFileFormat;
+								break;
+							}
+							if (seen[size_t(y) / lines_per_chunk].exchange(1) != 0)
+							{
+								result = Result::WrongFileFormat;
+								break;
+							}
+							const byte* data = chunk + 8;
+							const size_t lines = std::min<size_t>(lines_per_chunk, height - size_t(y));
+							const size_t raw_size = lines * line_size;
+							const byte* pixels = data;
+							if (data_size != raw_size)
+							{
+								// Compressed (the chunks that don't compress are stored as they are)
+								tmp.resize(raw_size);
+								raw.resize(raw_size);
+								bool ok = false;
+								if (header.compression == Compression::RLE)
+								{
+									ok = RLEDecode(data, data_size, tmp.data(), raw_size);
+								}
+								else if (header.compression == Compression::ZIPS || header.compression == Compression::ZIP)
+								{
+									ok = deflate::ZlibDecompress(data, data_size, tmp.data(), raw_size) == Result::Success;
+								}
+								if (!ok)
+								{
+									result = Result::WrongFileFormat;
+									break;
+								}
+								Postprocess(tmp.data(), raw_size, raw.data());
+								pixels = raw.data();
+							}
+
+							// Planar lines -> interleaved pixels
+							for (size_t l = 0; l < lines; ++l)
+							{
+								const byte* line = pixels + l * line_size;
+								byte* out = dst + (size_t(y) + l) * width * pixel_size;
+								for (size_t ic = 0; ic < order.size(); ++ic)
+								{
+									const uint32_t fc = order[ic];
+									const byte* src = line + channel_offsets[fc];
+									byte* o = out + ic * format.elem_size;
+									const uint32_t src_size = TypeSize(header.channels[fc].type);
+									if (src_size == format.elem_size)
+									{
+										for (size_t x = 0; x < width; ++x)
+										{
+											std::memcpy(o + x * pixel_size, src + x * src_size, src_size);
+										}
+									}
+									else
+									{
+										// HALF channel of a FLOAT image
+										for (size_t x = 0; x < width; ++x)
+										{
+											uint16_t h;
+											std::memcpy(&h, src + x * 2, 2);
+											const float f = float(std::bit_cast<math::Half>(h));
+											std::memcpy(o + x * pixel_size, &f, 4);
+										}
+									}
+								}
+							}
+						}
+					}, pool);
+					return result;
+				}
+
+				Result Encode(OutputStream& stream, const uint8_t* pixels, size_t width, size_t height, uint32_t channels, uint32_t elem_size, bool uint_samples,
+					Compression compression, int level, ThreadPool* pool)
+				{
+					const RowSource rows{
+						.pixels = pixels,
+						.row_bytes = width * channels * elem_size,
+					};
+					return Encode(stream, rows, width, height, channels, elem_size, uint_samples, compression, level, pool);
+				}
+
+				Result Encode(OutputStream& stream, RowSource const& rows, size_t width, size_t height, uint32_t channels, uint32_t elem_size, bool uint_samples,
+					Compression compression, int level, ThreadPool* pool)
+				{
+					if ((!rows.pixels && !rows.produce) || width == 0 || height == 0 || int64_t(width) > MaxExtent || int64_t(height) > MaxExtent)
+					{
+						return Result::InvalidParameter;
+					}
+					if (channels < 1 || channels > 4 || (elem_size != 2 && elem_size != 4) || (uint_samples && elem_size != 4) || compression > Compression::ZIP)
+					{
+						return Result::InvalidParameter;
+					}
+					const PixelType type = uint_samples ? PixelType::UINT : (elem_size == 2 ? PixelType::HALF : PixelType::FLOAT);
+					const char* const names[4][4] = {
+						{"Y"},
+						{"Y", "A"},
+						{"R", "G", "B"},
+						{"R", "G", "B", "A"},
+					};
+					Header header;
+					header.compression = compression;
+					header.x_max = int32_t(width - 1);
+					header.y_max = int32_t(height - 1);
+					for (uint32_t c = 0; c < channels; ++c)
+					{
+						header.channels.push_back(Channel{.name = names[channels - 1][c], .type = type});
+					}
+					std::sort(header.channels.begin(), header.channels.end(), [](Channel const& a, Channel const& b) {return a.name < b.name; });
+					const std::vector<uint32_t> order = ChannelOrder(header);
+					const size_t pixel_size = size_t(elem_size) * channels;
+					const size_t line_size = width * pixel_size;
+					if (rows.row_bytes != line_size)
+					{
+						return Result::InvalidParameter;
+					}
+
+					std::vector<byte> head(Magic, Magic + 4);
+					WriteLE32(head, Version);
+					{
+						std::vector<byte> chlist;
+						for (Channel const& c : header.channels)
+						{
+							PutString(chlist, c.name.c_str());
+							WriteLE32(chlist, uint32_t(c.type));
+							WriteLE32(chlist, 0); // pLinear and reserved
+							WriteLE32(chlist, 1); // x sampling
+							WriteLE32(chlist, 1); // y sampling
+						}
+						chlist.push_back(0);
+						PutAttribute(head, "channels", "chlist", chlist);
+					}
+					PutAttribute(head, "compression", "compression", {byte(compression)});
+					std::vector<byte> box;
+					WriteLE32(box, 0);
+					WriteLE32(box, 0);
+					WriteLE32(box, uint32_t(header.x_max));
+					WriteLE32(box, uint32_t(header.y_max));
+					PutAttribute(head, "dataWindow", "box2i", box);
+					PutAttribute(head, "displayWindow", "box2i", box);
+					PutAttribute(head, "lineOrder", "lineOrder", {0}); // increasing y
+					const float one = 1.0f;
+					std::vector<byte> one_bytes(4);
+					std::memcpy(one_bytes.data(), &one, 4);
+					PutAttribute(head, "pixelAspectRatio", "float", one_bytes);
+					PutAttribute(head, "screenWindowCenter", "v2f", std::vector<byte>(8, 0));
+					PutAttribute(head, "screenWindowWidth", "float", one_bytes);
+					head.push_back(0);
+
+					// Chunks: y, data size, data
+					const size_t chunk_count = header.chunkCount();
+					const uint32_t lines_per_chunk = header.linesPerChunk();
+					std::vector<std::vector<byte>> chunks(chunk_count);
+					ParallelForRange(chunk_count, 1, [&](size_t begin, size_t end)
+					{
+						std::vector<byte> source, raw, tmp, packed;
+						for (size_t i = begin; i < end; ++i)
+						{
+							const size_t y = i * lines_per_chunk;
+							const size_t lines = std::min<size_t>(lines_per_chunk, height - y);
+							const size_t raw_size = lines * line_size;
+							raw.resize(raw_size);
+							const byte* pixels = rows.rows(y, y + lines, source);
+							// Interleaved pixels -> planar lines (file channel order)
+							for (size_t l = 0; l < lines; ++l)
+							{
+								const byte* in = pixels + l * line_size;
+								byte* line = raw.data() + l * line_size;
+								for (uint32_t fc = 0; fc < channels; ++fc)
+								{
+									const uint32_t ic = uint32_t(std::find(order.begin(), order.end(), fc) - order.begin());
+									byte* o = line + fc * width * elem_size;
+									const byte* src = in + ic * elem_size;
+									for (size_t x = 0; x < width; ++x)
+									{
+										std::memcpy(o + x * elem_size, src + x * pixel_size, elem_size);
+									}
+								}
+							}
+							const byte* data = raw.data();
+							size_t data_size = raw_size;
+							if (compression != Compression::None)
+							{
+								tmp.resize(raw_size);
+								Preprocess(raw.data(), raw_size, tmp.data());
+								packed.clear();
+								if (compression == Compression::RLE)
+								{
+									packed.resize(RLEBound(raw_size));
+									packed.resize(RLEEncode(tmp.data(), raw_size, packed.data()));
+								}
+								else
+								{
+									deflate::ZlibCompress(tmp.data(), raw_size, level < 0 ? 6 : level, packed);
+								}
+								if (packed.size() < raw_size)
+								{
+									data = packed.data();
+									data_size = packed.size();
+								}
+							}
+							std::vector<byte>& chunk = chunks[i];
+							chunk.reserve(8 + data_size);
+							WriteLE32(chunk, uint32_t(y));
+							WriteLE32(chunk, uint32_t(data_size));
+							chunk.insert(chunk.end(), data, data + data_size);
+						}
+					}, pool);
+
+					std::vector<byte> offsets(chunk_count * 8);
+					uint64_t offset = head.size() + offsets.size();
+					for (size_t i = 0; i < chunk_count; ++i)
+					{
+						WriteLE64(offsets.data() + i * 8, offset);
+						offset += chunks[i].size();
+					}
+					Result result = stream.write(head);
+					if (result == Result::Success)
+					{
+						result = stream.write(offsets);
+					}
+					for (size_t i = 0; i < chunk_count && result == Result::Success; ++i)
+					{
+						result = stream.write(chunks[i]);
+						chunks[i] = {};
+					}
+					return result;
+				}
+			}
+		}
+	}
+}
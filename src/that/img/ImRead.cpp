@@ -1,9 +1,15 @@
 #include <that/img/ImRead.hpp>
 
 #include <that/IO/File.hpp>
+#include <that/IO/Stream.hpp>
+#include <that/utils/ThreadPool.hpp>
+#include <that/img/ImageProcessor.hpp>
 
 #include <fstream>
 #include <cassert>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
 
 namespace that
 {
@@ -11,144 +17,390 @@ namespace that
 	{
 		namespace io
 		{
-			namespace netpbm
+			namespace
 			{
-				__forceinline void eat_white(pbyte& ptr, const pbyte end)
+				// The content of a file, read (into info.file_buffer if provided) or mapped
+				struct LoadedFile
+				{
+					std::vector<byte> local = {};
+					MappedFile mapped = {};
+					std::span<const byte> content = {};
+				};
+
+				Result LoadFile(ReadImageInfo const& info, bool copy_on_write, LoadedFile& file)
 				{
-					for (; ptr != end; ++ptr)
+					Result result = Result::Success;
+					if (info.memory_map)
 					{
-						if (*ptr != '\n' && *ptr != '\r' && *ptr != '\t' && *ptr != ' ')
-							break;
+						FileSystem::MapFileInfo fs_info{
+							.hint = info.hint,
+							.path = info.path,
+							.result = &file.mapped,
+							.copy_on_write = copy_on_write,
+						};
+						result = FileSystem::MapFile(fs_info, info.filesystem);
+						file.content = file.mapped.span();
 					}
+					else
+					{
+						std::vector<byte>& buffer = info.file_buffer ? *info.file_buffer : file.local;
+						FileSystem::ReadFileInfo fs_info{
+							.hint = info.hint,
+							.path = info.path,
+							.result_vector = &buffer,
+						};
+						result = FileSystem::ReadFile(fs_info, info.filesystem);
+						file.content = buffer;
+					}
+					return result;
 				}
+			}
 
-				__forceinline void eat_line(pbyte& ptr, const pbyte end)
+			namespace netpbm
+			{
+				namespace
 				{
-					for (; ptr != end; ++ptr)
+					// mapped: the copy on write mapping of content for a zero copy decoding, nullptr if content is not mapped
+					Result DecodeContent(std::span<const byte> content, MappedFile* mapped, ReadImageInfo const& info)
 					{
-						if (*ptr == '\n')
-							break;
+						Result result = Result::Success;
+						const byte* begin = content.data();
+						const byte* end = begin + content.size();
+
+						Header header;
+						int mode = 0;
+						const byte* ptr = begin;
+						result = ParseHeader(ptr, end, header, mode);
+						if (result != Result::Success)
+						{
+							return result;
+						}
+
+						const bool row_major = true;
+						const size_t w = header.width;
+						const size_t h = header.height;
+						const size_t available = end - ptr;
+
+						if (mode <= 3) // ASCII
+						{
+							const FormatInfo format = GetFormat(header, mode);
+							const size_t byte_size = w * h * format.pixelSize();
+							ImageStorage storage(byte_size);
+							result = ParseASCII(ptr, end, mode, header.max_value, w * h * format.channels, storage.data(), info.pool);
+							if (result == Result::Success)
+							{
+								*info.target = FormatedImage(w, h, format, row_major, std::move(storage));
+							}
+							return result;
+						}
+
+						BinaryRowDecoder decoder;
+						decoder.init(header, mode);
+						const FormatInfo format = decoder.format();
+						const size_t byte_size = w * h * format.pixelSize();
+						if (available < decoder.fileRowSize() * h)
+						{
+							return Result::WrongFileFormat;
+						}
+
+						ImageStorage storage;
+						// The mapping is page aligned: 16 bits samples are used in place only if the header size keeps them aligned
+						const bool in_place = mapped && mode != 4 && ((ptr - begin) % format.elem_size) == 0;
+						if (in_place)
+						{
+							// Zero copy: the image points into the (copy on write) mapping, which lives as long as the pixels
+							// The samples that need it are decoded in place (only the touched pages are copied)
+							byte* pixels = mapped->data() + (ptr - begin);
+							std::shared_ptr<MappedFile> owner = std::make_shared<MappedFile>(std::move(*mapped));
+							storage = ImageStorage(pixels, byte_size, [owner](byte*, size_t) {});
+						}
+						else
+						{
+							storage = ImageStorage(byte_size);
+							if (decoder.isIdentity())
+							{
+								std::memcpy(storage.data(), ptr, byte_size);
+							}
+						}
+
+						if (!decoder.isIdentity())
+						{
+							const byte* src = in_place ? storage.data() : ptr;
+							constexpr const size_t min_bytes_per_task = 1 << 18;
+							ParallelForRange(h, std::max<size_t>(1, min_bytes_per_task / std::max<size_t>(decoder.rowByteSize(), 1)), [&](size_t y_begin, size_t y_end)
+							{
+								decoder.decode(src + y_begin * decoder.fileRowSize(), storage.data() + y_begin * decoder.rowByteSize(), y_end - y_begin);
+							}, info.pool);
+						}
+						*info.target = FormatedImage(w, h, format, row_major, std::move(storage));
+
+						return result;
 					}
-					ptr++;
 				}
 
-				__forceinline void eat_token(pbyte& ptr, const pbyte end)
+				Result ReadFormatedImage(ReadImageInfo const& info)
 				{
-					for (; ptr != end; ++ptr)
+					Result result = Result::Success;
+					if (!info.target)
 					{
-						if (*ptr == '\n' || *ptr == '\r' || *ptr == '\t' || *ptr == ' ')
-							break;
+						result = Result::InvalidParameter;
+						return result;
 					}
+
+					LoadedFile file;
+					result = LoadFile(info, true, file);
+					if (result != Result::Success)
+					{
+						return result;
+					}
+					return DecodeContent(file.content, info.memory_map ? &file.mapped : nullptr, info);
 				}
 
-				__forceinline int eat_int(pbyte& ptr, const pbyte end)
+				Result DecodeFormatedImage(std::span<const byte> content, ReadImageInfo const& info)
 				{
-					eat_white(ptr, end);
-					int v = atoi((char*)ptr);
-					eat_token(ptr, end);
-					return v;
+					if (!info.target)
+					{
+						return Result::InvalidParameter;
+					}
+					return DecodeContent(content, nullptr, info);
 				}
+			}
 
-				__forceinline void eat_comment(pbyte& ptr, const pbyte end)
+			namespace pfm
+			{
+				namespace
 				{
-					while (ptr != end)
+					// mapped: the copy on write mapping of content for an in place decoding, nullptr if content is not mapped
+					Result DecodeContent(std::span<const byte> content, MappedFile* mapped, ReadImageInfo const& info)
 					{
-						eat_white(ptr, end);
-						if (*ptr != '#')
-							break;
-						eat_line(ptr, end);
+						Result result = Result::Success;
+						const byte* begin = content.data();
+						const byte* end = begin + content.size();
+
+						Header header;
+						const byte* ptr = begin;
+						result = ParseHeader(ptr, end, header);
+						if (result != Result::Success)
+						{
+							return result;
+						}
+
+						const bool row_major = true;
+						const FormatInfo format = GetFormat(header);
+						const size_t w = header.width;
+						const size_t h = header.height;
+						const size_t byte_size = w * h * format.pixelSize();
+						if (size_t(end - ptr) < byte_size)
+						{
+							return Result::WrongFileFormat;
+						}
+
+						ImageStorage storage;
+						if (mapped && (reinterpret_cast<uintptr_t>(ptr) % alignof(float)) == 0)
+						{
+							// The rows are flipped in place in the (copy on write) mapping, which lives as long as the pixels
+							byte* pixels = mapped->data() + (ptr - begin);
+							std::shared_ptr<MappedFile> owner = std::make_shared<MappedFile>(std::move(*mapped));
+							storage = ImageStorage(pixels, byte_size, [owner](byte*, size_t) {});
+							CopyRows(pixels, pixels, header, info.pool);
+						}
+						else
+						{
+							// The flip is done by the copy
+							storage = ImageStorage(byte_size);
+							CopyRows(ptr, storage.data(), header, info.pool);
+						}
+						*info.target = FormatedImage(w, h, format, row_major, std::move(storage));
+						return result;
 					}
 				}
 
 				Result ReadFormatedImage(ReadImageInfo const& info)
 				{
 					Result result = Result::Success;
-					std::vector<byte> file;
-
 					if (!info.target)
 					{
-						result = Result::InvalidValue;
+						result = Result::InvalidParameter;
+						return result;
 					}
 
+					LoadedFile file;
+					result = LoadFile(info, true, file);
+					if (result != Result::Success)
 					{
-						FileSystem::ReadFileInfo fs_info{
-							.hint = info.hint,
-							.path = info.path,
-							.result_vector = &file,
-						};
-						result = FileSystem::ReadFile(fs_info, info.filesystem);
+						return result;
 					}
+					return DecodeContent(file.content, info.memory_map ? &file.mapped : nullptr, info);
+				}
 
-					if (result == Result::Success)
+				Result DecodeFormatedImage(std::span<const byte> content, ReadImageInfo const& info)
+				{
+					if (!info.target)
 					{
-						Header header;
-						bool row_major = true;
-						FormatInfo format;
-						pbyte ptr = file.data();
-						const pbyte end = ptr + file.size();
+						return Result::InvalidParameter;
+					}
+					return DecodeContent(content, nullptr, info);
+				}
+			}
 
-						try
+			namespace thatimg
+			{
+				namespace
+				{
+					// mapped: the mapping of content, the uncompressed pixels are used in place (nullptr if content is not mapped)
+					Result DecodeContent(std::span<const byte> content, MappedFile* mapped, ReadImageInfo const& info)
+					{
+						Header header;
+						Result result = ParseHeader(content, header);
+						if (result != Result::Success)
+						{
+							return result;
+						}
+						const size_t w = header.extent.width;
+						const size_t h = header.extent.height;
+						// The first slice (the layout of the payload is validated by ParseHeader, so this does not overflow)
+						const size_t byte_size = w * h * header.format.pixelSize();
+						if (byte_size > header.offsets[1] - header.offsets[0])
+						{
+							return Result::WrongFileFormat;
+						}
+						ImageStorage storage;
+						if (mapped && header.compression() == thatimg::Compression::None)
+						{
+							byte* pixels = mapped->data() + header.file.payload_offset + header.offsets[0];
+							std::shared_ptr<MappedFile> owner = std::make_shared<MappedFile>(std::move(*mapped));
+							storage = ImageStorage(pixels, byte_size, [owner](byte*, size_t) {});
+						}
+						else
 						{
-							eat_comment(ptr, end);
-							eat_white(ptr, end);
-							int mode = 0;
-							if (ptr + 2 < end && ptr[0] == 'P')
+							// Only the blocks of the first slice are decompressed (or copied out of content)
+							storage = ImageStorage(byte_size);
+							result = ReadPayload(content, header, header.offsets[0], std::span<byte>(storage.data(), byte_size), info.pool);
+							if (result != Result::Success)
 							{
-								mode = ptr[1] - '0';
-								ptr += 2;
+								return result;
 							}
+						}
+						*info.target = FormatedImage(w, h, header.format, header.file.row_major != 0, std::move(storage));
+						return result;
+					}
+				}
 
-							eat_comment(ptr, end);
-							header.width = eat_int(ptr, end);
+				Result ReadFormatedImage(ReadImageInfo const& info)
+				{
+					if (!info.target || !info.path)
+					{
+						return Result::InvalidParameter;
+					}
+					MappedFile mapped;
+					FileSystem::MapFileInfo fs_info{
+						.hint = info.hint,
+						.path = info.path,
+						.result = &mapped,
+					};
+					Result result = FileSystem::MapFile(fs_info, info.filesystem);
+					if (result != Result::Success)
+					{
+						return result;
+					}
+					return DecodeContent(mapped.span(), &mapped, info);
+				}
 
-							eat_comment(ptr, end);
-							header.height = eat_int(ptr, end);
+				Result DecodeFormatedImage(std::span<const byte> content, ReadImageInfo const& info)
+				{
+					if (!info.target)
+					{
+						return Result::InvalidParameter;
+					}
+					return DecodeContent(content, nullptr, info);
+				}
+			}
 
-							double max_value;
-							if (mode == 1 || mode == 4)
-							{
-								max_value = 1;
-								header.max_value = 1;
-							}
-							else
-							{
-								eat_comment(ptr, end);
-								header.max_value = eat_int(ptr, end);
-								max_value = header.max_value;
-							}
+			namespace qoi
+			{
+				Result ReadFormatedImage(ReadImageInfo const& info)
+				{
+					if (!info.target)
+					{
+						return Result::InvalidParameter;
+					}
 
-							format.type = ElementType::sRGB;
-							format.elem_size = 1;
-							if (mode == 1 || mode == 2 || mode == 4 || mode == 5)
-							{
-								format.channels = 1;
-							}
-							else
-							{
-								format.channels = 3;
-							}
+					LoadedFile file;
+					const Result result = LoadFile(info, false, file);
+					if (result != Result::Success)
+					{
+						return result;
+					}
+					return DecodeFormatedImage(file.content, info);
+				}
+
+				Result DecodeFormatedImage(std::span<const byte> content, ReadImageInfo const& info)
+				{
+					Result result = Result::Success;
+					if (!info.target)
+					{
+						result = Result::InvalidParameter;
+						return result;
+					}
 
-							assert(header.max_value <= 255);
+					Header header;
+					result = ParseHeader(content, header);
+					if (result != Result::Success)
+					{
+						return result;
+					}
+					// Less than PixelsMax pixels (checked by ParseHeader): no overflow
+					const FormatInfo format = GetFormat(header);
+					ImageStorage storage(size_t(header.width) * size_t(header.height) * format.pixelSize());
+					result = Decode(content, header, storage.data(), info.pool);
+					if (result == Result::Success)
+					{
+						*info.target = FormatedImage(header.width, header.height, format, true, std::move(storage));
+					}
+					return result;
+				}
+			}
 
-							eat_comment(ptr, end);
+			namespace exr
+			{
+				Result ReadFormatedImage(ReadImageInfo const& info)
+				{
+					if (!info.target)
+					{
+						return Result::InvalidParameter;
+					}
 
-							*info.target = FormatedImage(header.width, header.height, format, row_major);
+					LoadedFile file;
+					const Result result = LoadFile(info, false, file);
+					if (result != Result::Success)
+					{
+						return result;
+					}
+					return DecodeFormatedImage(file.content, info);
+				}
 
-							if (mode <= 3) // ASCII
-							{
-								throw std::runtime_error("NetPBM ASCII not implemented yet");
-							}
-							else // Binary
-							{
-								std::memcpy(info.target->rawData(), ptr, info.target->byteSize());
-							}
-						}
-						catch (std::exception const& e)
-						{
-							result = Result::Exception;
-						}
+				Result DecodeFormatedImage(std::span<const byte> content, ReadImageInfo const& info)
+				{
+					Result result = Result::Success;
+					if (!info.target)
+					{
+						result = Result::InvalidParameter;
+						return result;
 					}
 
+					Header header;
+					result = ParseHeader(content, header);
+					if (result != Result::Success)
+					{
+						return result;
+					}
+					const FormatInfo format = GetFormat(header);
+					ImageStorage storage(header.width() * header.height() * format.pixelSize());
+					result = Decode(content, header, storage.data(), info.pool);
+					if (result == Result::Success)
+					{
+						*info.target = FormatedImage(header.width(), header.height(), format, true, std::move(storage));
+					}
 					return result;
 				}
 			}
@@ -156,11 +408,27 @@ namespace that
 			namespace stbi
 			{
 				Result ReadFormatedImage(ReadImageInfo const& info)
+				{
+					if (!info.target)
+					{
+						return Result::InvalidParameter;
+					}
+
+					LoadedFile file;
+					const Result result = LoadFile(info, false, file);
+					if (result != Result::Success)
+					{
+						return result;
+					}
+					return DecodeFormatedImage(file.content, info);
+				}
+
+				Result DecodeFormatedImage(std::span<const byte> content, ReadImageInfo const& info)
 				{
 					Result result = Result::Success;
 					bool row_major = true;
 					FormatInfo format;
-					int width, height, channels;
+					int width = 0, height = 0, channels = 0;
 
 					if (!info.target)
 					{
@@ -168,48 +436,87 @@ namespace that
 						return result;
 					}
 
-					std::vector<uint8_t> file;
+					// Decoded at the native precision of the file: float for .hdr, 16 bits for 16 bits png / pnm, else 8 bits
+					// stb expands or reduces the channels itself if a preferred number of channels is requested
+					const bool convert = info.format.elem_size != 0;
+					const int req_channels = (convert && info.format.channels <= 4) ? info.format.channels : 0;
+					const int size = int(content.size());
+					void* data = nullptr;
+					try
 					{
-						FileSystem::ReadFileInfo fs_info{
-							.hint = info.hint,
-							.path = info.path,
-							.result_vector = &file,
-						};
-						result = FileSystem::ReadFile(fs_info, info.filesystem);
+						if (stbi_is_hdr_from_memory(content.data(), size))
+						{
+							data = stbi_loadf_from_memory(content.data(), size, &width, &height, &channels, req_channels);
+							format.type = ElementType::FLOAT;
+							format.elem_size = sizeof(float);
+						}
+						else if (stbi_is_16_bit_from_memory(content.data(), size))
+						{
+							data = stbi_load_16_from_memory(content.data(), size, &width, &height, &channels, req_channels);
+							format.type = ElementType::UNORM;
+							format.elem_size = 2;
+						}
+						else
+						{
+							data = stbi_load_from_memory(content.data(), size, &width, &height, &channels, req_channels);
+							format.type = ElementType::UNORM;
+							format.elem_size = 1;
+						}
+					}
+					catch (std::exception const& e)
+					{
+						result = Result::STBInteralError;
+						if (data)
+						{
+							stbi_image_free(data);
+							data = nullptr;
+						}
 					}
 
-					uint8_t * data = nullptr;
 					if (result == Result::Success)
 					{
-						try
+						if (!data)
 						{
-							data = stbi_load_from_memory(file.data(), file.size(), &width, &height, &channels, 0);
+							result = Result::STBInteralError;
 						}
-						catch (std::exception const& e)
+						else if (width <= 0 || height <= 0 || channels <= 0)
 						{
-							result = Result::STBInteralError;
-							if (data)
-							{
-								stbi_image_free(data);
-							}
+							result = Result::InvalidValue;
 						}
 					}
 
 					if (result == Result::Success)
 					{
-						if (width <= 0 || height <= 0 || channels <= 0)
+						// channels is the one of the file, not the requested one
+						format.channels = uint8_t(req_channels ? req_channels : channels);
+						byte* pixels = static_cast<byte*>(data);
+						if (!convert || info.format == format)
 						{
-							result = Result::InvalidValue;
+							// The decoded pixels become the storage of the image (no copy)
+							info.target->adopt(width, height, format, row_major, pixels, [](byte* p, size_t) {stbi_image_free(p); });
+							data = nullptr;
 						}
 						else
 						{
-							format.type = ElementType::UNORM;
-							format.elem_size = 1;
-							format.channels = channels;
-
-							*info.target = FormatedImage(width, height, format, row_major);
-
-							std::memcpy(info.target->rawData(), data, info.target->byteSize());
+							// Converted straight from the decoded buffer to the storage of the image
+							const FormatInfo dst_format = info.format;
+							ImageStorage storage(size_t(width) * size_t(height) * dst_format.pixelSize());
+							ImageProcessor::ConvertParams params{
+								.src = pixels,
+								.dst = storage.data(),
+								.w = size_t(width),
+								.h = size_t(height),
+								.src_format = format,
+								.dst_format = dst_format,
+								.src_row_major = row_major,
+								.dst_row_major = row_major,
+								.pool = info.pool,
+							};
+							result = ImageProcessor::ConvertFormat(params);
+							if (result == Result::Success)
+							{
+								*info.target = FormatedImage(width, height, dst_format, row_major, std::move(storage));
+							}
 						}
 					}
 
@@ -222,37 +529,447 @@ namespace that
 				}
 			}
 
-			Result ReadFormatedImage(ReadImageInfo const& info)
+			namespace
 			{
-				Result result = Result::Success;
-				if (!info.path)
+				// Result::WrongFileFormat if the header does not fit in prefix (or is invalid)
+				// ext: the extension of the file (or the format detected from its content)
+				template <class StringView>
+				Result ProbeFromPrefix(StringView ext, std::span<const byte> prefix, ImageProbe& probe)
 				{
-					result = Result::InvalidParameter;
+					Result result = Result::Success;
+					if (netpbm::IsNetpbm(ext))
+					{
+						netpbm::Header header;
+						int mode = 0;
+						const byte* ptr = prefix.data();
+						result = netpbm::ParseHeader(ptr, prefix.data() + prefix.size(), header, mode);
+						if (result == Result::Success)
+						{
+							probe.format = netpbm::GetFormat(header, mode);
+							probe.width = header.width;
+							probe.height = header.height;
+						}
+					}
+					else if (pfm::IsPFM(ext))
+					{
+						pfm::Header header;
+						const byte* ptr = prefix.data();
+						result = pfm::ParseHeader(ptr, prefix.data() + prefix.size(), header);
+						if (result == Result::Success)
+						{
+							probe.format = pfm::GetFormat(header);
+							probe.width = header.width;
+							probe.height = header.height;
+						}
+					}
+					else if (thatimg::IsThatImg(ext))
+					{
+						thatimg::Header header;
+						result = thatimg::ParseFileHeader(prefix, header);
+						if (result == Result::Success)
+						{
+							probe.format = header.format;
+							probe.width = header.extent.width;
+							probe.height = header.extent.height;
+							probe.row_major = header.file.row_major != 0;
+						}
+					}
+					else if (qoi::CanReadWrite(ext))
+					{
+						qoi::Header header;
+						result = qoi::ParseHeader(prefix, header);
+						if (result == Result::Success)
+						{
+							probe.format = qoi::GetFormat(header);
+							probe.width = header.width;
+							probe.height = header.height;
+						}
+					}
+					else if (exr::IsEXR(ext))
+					{
+						exr::Header header;
+						result = exr::ParseHeader(prefix, header);
+						if (result == Result::Success)
+						{
+							probe.format = exr::GetFormat(header);
+							probe.width = header.width();
+							probe.height = header.height();
+						}
+					}
+					else if (stbi::CanReadWrite(ext))
+					{
+						int w = 0, h = 0, c = 0;
+						const int size = int(prefix.size());
+						if (stbi_info_from_memory(prefix.data(), size, &w, &h, &c) && w > 0 && h > 0 && c > 0)
+						{
+							// Same as stbi::ReadFormatedImage
+							if (stbi_is_hdr_from_memory(prefix.data(), size))
+							{
+								probe.format = FormatInfo{.type = ElementType::FLOAT, .elem_size = sizeof(float), .channels = uint8_t(c)};
+							}
+							else
+							{
+								const uint8_t elem_size = stbi_is_16_bit_from_memory(prefix.data(), size) ? 2 : 1;
+								probe.format = FormatInfo{.type = ElementType::UNORM, .elem_size = elem_size, .channels = uint8_t(c)};
+							}
+							probe.width = w;
+							probe.height = h;
+						}
+						else
+						{
+							result = Result::WrongFileFormat;
+						}
+					}
+					else
+					{
+						result = Result::UnknownFileExtension;
+					}
 					return result;
 				}
-				if (info.path->has_extension())
+
+				// The signatures fit in the first bytes, read once and reused for the decoding
+				constexpr const size_t DetectionBytes = 4096;
+
+				template <class StringView>
+				bool IsReadable(StringView ext)
 				{
-					const std::filesystem::path ext_path = info.path->extension();
+					return netpbm::IsNetpbm(ext) || pfm::IsPFM(ext) || thatimg::IsThatImg(ext) || qoi::CanReadWrite(ext) || exr::IsEXR(ext) || stbi::CanReadWrite(ext);
+				}
+
+				// The format of a file from its first bytes (as returned by DetectFileFormat), whatever its extension
+				// The extension is only used for the TGA files which header is not recognized
+				Result DetectFormat(std::span<const byte> prefix, FileSystem::Path const& path, std::string_view& format)
+				{
+					format = DetectFileFormat(prefix);
+					if (!format.empty())
+					{
+						return Result::Success;
+					}
+					if (!path.has_extension())
+					{
+						return Result::WrongFileFormat;
+					}
+					const std::filesystem::path ext_path = path.extension();
 					that::PathStringView ext = ExtractExtensionSV(&ext_path);
-					if (netpbm::IsNetpbm(ext))
+					if (stbi::IsTGA(ext))
 					{
-						result = netpbm::ReadFormatedImage(info);
-						result = netpbm::ReadFormatedImage(info);
+						format = "tga";
+						return Result::Success;
 					}
-					else if (stbi::CanReadWrite(ext))
+					return IsReadable(ext) ? Result::WrongFileFormat : Result::UnknownFileExtension;
+				}
+			}
+
+			Result ProbeImage(ReadImageInfo const& info, ImageProbe& result)
+			{
+				if (!info.path)
+				{
+					return Result::InvalidParameter;
+				}
+
+				// Resolved once (FileSystem::resolve is const, so this can run on many threads)
+				ResultAnd<FileSystem::Path> path = FileSystem::ResolveFilePath(*info.path, info.hint, info.filesystem);
+				if (path.result != Result::Success)
+				{
+					return path.result;
+				}
+
+				// Most headers fit in the first 4KB, some (jpg with large metadata) need more
+				Result res = Result::Success;
+				std::vector<byte> prefix;
+				std::string_view format;
+				for (size_t max_size = DetectionBytes; ; max_size *= 16)
+				{
+					FileSystem::ReadFileInfo fs_info{
+						.hint = info.hint | FileSystem::Hint::PathIsNative,
+						.path = &path.value,
+						.result_vector = &prefix,
+						.max_size = max_size,
+					};
+					res = FileSystem::ReadFileFromDisk(fs_info);
+					if (res != Result::Success)
+					{
+						break;
+					}
+					result = ImageProbe{};
+					if (format.empty())
+					{
+						res = DetectFormat(prefix, *info.path, format);
+						if (res != Result::Success)
+						{
+							break;
+						}
+					}
+					res = ProbeFromPrefix(format, prefix, result);
+					const bool whole_file = prefix.size() < max_size;
+					if (res != Result::WrongFileFormat || whole_file || max_size >= (size_t(1) << 20))
+					{
+						break;
+					}
+				}
+				return res;
+			}
+
+			AsyncResult ReadFormatedImageAsync(ReadImageInfo const& info, ThreadPool* executor)
+			{
+				std::shared_ptr<FileSystem::Path> path = info.path ? std::make_shared<FileSystem::Path>(*info.path) : nullptr;
+				return RunAsync([info, path]()
+				{
+					ReadImageInfo info2 = info;
+					info2.path = path.get();
+					return ReadFormatedImage(info2);
+				}, executor);
+			}
+
+			Result ReadFormatedImages(std::span<const ReadImageInfo> infos, std::span<Result> results, ThreadPool* pool, size_t max_in_flight_bytes)
+			{
+				assert(results.size() >= infos.size());
+
+				// Bounds the bytes of the files being processed
+				std::mutex mutex;
+				std::condition_variable condition;
+				size_t in_flight = 0;
+
+				// File buffers, reused by the tasks (at most one per running task)
+				std::vector<std::unique_ptr<std::vector<byte>>> free_buffers;
+
+				ThreadPool& p = pool ? *pool : ThreadPool::Default();
+				p.parallelFor(infos.size(), [&](size_t i)
+				{
+					ReadImageInfo info = infos[i];
+					size_t file_size = 0;
+					if (info.path && !info.memory_map)
 					{
-						result = stbi::ReadFormatedImage(info);
+						ResultAnd<FileSystem::Path> path = FileSystem::ResolveFilePath(*info.path, info.hint, info.filesystem);
+						std::error_code ec;
+						file_size = path.result == Result::Success ? size_t(std::filesystem::file_size(path.value, ec)) : 0;
+						file_size = ec ? 0 : file_size;
+					}
+
+					std::unique_ptr<std::vector<byte>> buffer;
+					{
+						std::unique_lock lock(mutex);
+						condition.wait(lock, [&]() {return in_flight == 0 || in_flight + file_size <= max_in_flight_bytes; });
+						in_flight += file_size;
+						if (!free_buffers.empty())
+						{
+							buffer = std::move(free_buffers.back());
+							free_buffers.pop_back();
+						}
+					}
+					if (!buffer)
+					{
+						buffer = std::make_unique<std::vector<byte>>();
+					}
+
+					info.file_buffer = buffer.get();
+					results[i] = ReadFormatedImage(info);
+
+					{
+						std::unique_lock lock(mutex);
+						in_flight -= file_size;
+						if (buffer->capacity() > max_in_flight_bytes / 4)
+						{
+							// Don't keep the memory of the largest files
+							buffer.reset();
+						}
+						else
+						{
+							free_buffers.push_back(std::move(buffer));
+						}
+					}
+					condition.notify_all();
+				});
+
+				for (size_t i = 0; i < infos.size(); ++i)
+				{
+					if (results[i] != Result::Success)
+					{
+						return results[i];
+					}
+				}
+				return Result::Success;
+			}
+
+			void ProbeImages(std::span<const FileSystem::Path> paths, ReadImageInfo const& info, std::span<ImageProbe> probes, std::span<Result> results)
+			{
+				assert(probes.size() >= paths.size());
+				assert(results.size() >= paths.size());
+				ThreadPool& pool = info.pool ? *info.pool : ThreadPool::Default();
+				pool.parallelFor(paths.size(), [&](size_t i)
+				{
+					ReadImageInfo path_info = info;
+					path_info.path = &paths[i];
+					path_info.target = nullptr;
+					results[i] = ProbeImage(path_info, probes[i]);
+				});
+			}
+
+			namespace
+			{
+				// The readers that could not convert while decoding
+				Result ReFormatIFN(ReadImageInfo const& info)
+				{
+					Result result = Result::Success;
+					if (info.format.elem_size != 0 && !(info.target->format() == info.format))
+					{
+						result = info.target->reFormat(info.format, info.target->rowMajor());
+					}
+					return result;
+				}
+
+				// format: as returned by DetectFormat
+				// mapped: the copy on write mapping of content for the readers that decode in place (nullptr if content is not mapped)
+				Result DecodeDetected(std::string_view format, std::span<const byte> content, MappedFile* mapped, ReadImageInfo const& info)
+				{
+					Result result = Result::Success;
+					if (netpbm::IsNetpbm(format))
+					{
+						result = netpbm::DecodeContent(content, mapped, info);
+					}
+					else if (pfm::IsPFM(format))
+					{
+						result = pfm::DecodeContent(content, mapped, info);
+					}
+					else if (thatimg::IsThatImg(format))
+					{
+						result = thatimg::DecodeContent(content, mapped, info);
+					}
+					else if (qoi::CanReadWrite(format))
+					{
+						result = qoi::DecodeFormatedImage(content, info);
+					}
+					else if (exr::IsEXR(format))
+					{
+						result = exr::DecodeFormatedImage(content, info);
+					}
+					else if (stbi::CanReadWrite(format))
+					{
+						result = stbi::DecodeFormatedImage(content, info);
 					}
 					else
 					{
-						result = Result::UnknownFileExtension;
+						result = Result::WrongFileFormat;
+					}
+					if (result == Result::Success)
+					{
+						result = ReFormatIFN(info);
 					}
+					return result;
 				}
-				else
+
+				// Maps or reads the file, its format is detected from the first bytes before the rest is read (a file of an unknown format is rejected early)
+				// The first bytes are read once, the rest of the file is appended to them
+				// .thatimg files are always mapped
+				Result LoadDetectedFile(ReadImageInfo const& info, LoadedFile& file, std::string_view& format)
+				{
+					Result result = Result::Success;
+					if (info.memory_map)
+					{
+						// Only the first pages are touched by the detection
+						result = LoadFile(info, true, file);
+						if (result == Result::Success)
+						{
+							result = DetectFormat(file.content, *info.path, format);
+						}
+						return result;
+					}
+
+					ResultAnd<FileSystem::Path> path = FileSystem::ResolveFilePath(*info.path, info.hint, info.filesystem);
+					if (path.result != Result::Success)
+					{
+						return path.result;
+					}
+					FileInputStream stream;
+					result = stream.open(path.value);
+					if (result != Result::Success)
+					{
+						return result;
+					}
+					std::error_code ec;
+					const size_t file_size = size_t(std::filesystem::file_size(path.value, ec));
+					if (ec)
+					{
+						return Result::FileReadError;
+					}
+
+					std::vector<byte>& buffer = info.file_buffer ? *info.file_buffer : file.local;
+					buffer.resize(std::min(file_size, DetectionBytes));
+					size_t read_count = 0;
+					result = stream.read(buffer, read_count);
+					if (result == Result::Success && read_count != buffer.size())
+					{
+						result = Result::FileReadError;
+					}
+					if (result == Result::Success)
+					{
+						result = DetectFormat(buffer, *info.path, format);
+					}
+					if (result != Result::Success)
+					{
+						return result;
+					}
+
+					if (thatimg::IsThatImg(format))
+					{
+						stream.close();
+						ReadImageInfo mapped_info = info;
+						mapped_info.memory_map = true;
+						return LoadFile(mapped_info, true, file);
+					}
+
+					const size_t prefix_size = buffer.size();
+					buffer.resize(file_size);
+					result = stream.read(std::span<byte>(buffer.data() + prefix_size, file_size - prefix_size), read_count);
+					if (result == Result::Success && read_count != file_size - prefix_size)
+					{
+						result = Result::FileReadError;
+					}
+					file.content = buffer;
+					return result;
+				}
+			}
+
+			Result Decode(std::span<const uint8_t> content, ReadImageInfo const& info)
+			{
+				if (!info.target)
+				{
+					return Result::InvalidParameter;
+				}
+				const std::string_view format = DetectFileFormat(content);
+				if (format.empty())
+				{
+					return Result::WrongFileFormat;
+				}
+				return DecodeDetected(format, content, nullptr, info);
+			}
+
+			Result ProbeImage(std::span<const uint8_t> content, ImageProbe& result)
+			{
+				result = ImageProbe{};
+				const std::string_view format = DetectFileFormat(content);
+				if (format.empty())
 				{
-					result = Result::InvalidParameter;
+					return Result::WrongFileFormat;
+				}
+				return ProbeFromPrefix(format, content, result);
+			}
+
+			Result ReadFormatedImage(ReadImageInfo const& info)
+			{
+				if (!info.path || !info.target)
+				{
+					return Result::InvalidParameter;
+				}
+				LoadedFile file;
+				std::string_view format;
+				Result result = LoadDetectedFile(info, file, format);
+				if (result != Result::Success)
+				{
+					return result;
 				}
-				return result;
+				MappedFile* mapped = file.mapped.data() ? &file.mapped : nullptr;
+				return DecodeDetected(format, file.content, mapped, info);
 			}
 		}
 	}
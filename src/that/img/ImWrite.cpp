@@ -1,6 +1,16 @@
 #include <that/img/ImWrite.hpp>
+#include <that/img/ImageProcessor.hpp>
+#include <that/img/NetPBM.hpp>
+#include <that/img/PFM.hpp>
+#include <that/img/ThatImg.hpp>
+#include <that/img/QOI.hpp>
+#include <that/img/PNG.hpp>
+#include <that/img/EXR.hpp>
+#include <that/img/RowSource.hpp>
 
 #include <fstream>
+#include <functional>
+#include <atomic>
 
 #include <stb/stb_image_write.h>
 #include <that/math/Half.hpp>
@@ -8,8 +18,7 @@
 #include <that/core/Strings.hpp>
 
 #include <that/IO/File.hpp>
-
-#include <that/utils/ExtensibleDataStorage.hpp>
+#include <that/IO/Stream.hpp>
 
 namespace that
 {
@@ -17,132 +26,236 @@ namespace that
 	{
 		namespace io
 		{
-			namespace netpbm
+			namespace
 			{
-				inline size_t headerSize(int magic_number, std::string const& width, std::string const& height, const std::string& max_value = "")
+				// The rows of info.const_image, in info.format
+				RowSource ImageRows(WriteInfo const& info)
 				{
-					return
-						3 + // magic number
-						width.size() + 1 +
-						height.size() + 1 +
-						(((magic_number == 1) || (magic_number == 4)) ? 0 : (max_value.size() + 1));
+					return RowSource{
+						.pixels = info.const_image->rawData(),
+						.row_bytes = info.const_image->width() * info.format.pixelSize(),
+					};
 				}
 
-				inline size_t contentSize(int magic_number, size_t number_of_pixels)
+				// Encodes with encode(OutputStream&) into a temporary file next to the file of info.path, renamed over it on success
+				// A failure leaves an existing file untouched
+				template <class Encode>
+				Result WriteToFile(WriteInfo const& info, Encode const& encode)
 				{
-					size_t size_per_pixel;
-					if (magic_number == 5)
+					ResultAnd<FileSystem::Path> path = FileSystem::ResolveFilePath(*info.path, info.hint, info.filesystem);
+					if (path.result != Result::Success)
 					{
-						size_per_pixel = 1;
+						return path.result;
 					}
-					else if (magic_number == 6)
+					AtomicFileOutputStream file;
+					Result result = file.open(path.value, !(info.hint & FileSystem::Hint::DontCreateDirectory));
+					if (result == Result::Success)
 					{
-						// 1 byte per channel, 3 channel per pixels
-						size_per_pixel = 3;
+						result = encode(file);
 					}
-					else
+					if (result == Result::Success)
 					{
-						size_per_pixel = 0;
+						result = file.commit();
 					}
-					return size_per_pixel * number_of_pixels;
+					return result;
 				}
+			}
 
-				// TODO write in a stream, the stream maybe a pointer to a buffer, or a file
+			// The EncodeRows / EncodeImage functions encode info.const_image (in info.format) to a stream, info.path only gives the extension
+			// rows: the rows of info.const_image in info.format (possibly converted on the fly)
 
-				inline void writeHeader(byte*& ptr, int magic_number, std::string const& width, std::string const& height, const std::string& max_value = "")
+			namespace netpbm
+			{
+				Result EncodeRows(WriteInfo const& info, RowSource const& rows, OutputStream& stream)
 				{
-					ptr[0] = 'P';
-					ptr[1] = '0' + (char)magic_number;
-					ptr[2] = '\n';
-					ptr += 3;
-					const auto write = [](std::string const& str, byte*& ptr)
+					if (!info.const_image || !info.path)
 					{
-						for (int i = 0; i < str.size(); ++i)
-						{
-							*ptr = str[i];
-							++ptr;
-						}
-						*ptr = ' ';
-						++ptr;
+						return Result::InvalidParameter;
+					}
+					if (!info.row_major)
+					{
+						return Result::InvalidParameter;
+					}
+					FormatlessImage const& img = *info.const_image;
+
+					int magic_number = info.magic_number;
+					if (magic_number < 0 && info.path->has_extension())
+					{
+						const std::filesystem::path ext_path = info.path->extension();
+						magic_number = netpbm::MagicNumber(ExtractExtensionSV(&ext_path));
+					}
+
+					StreamWriter writer;
+					StreamWriter::CreateInfo ci{
+						.width = img.width(),
+						.height = img.height(),
+						.format = info.format,
+						.magic_number = magic_number,
 					};
+					Result result = writer.open(stream, ci);
+					const size_t band_rows = rows.bandRows();
+					std::vector<byte> scratch;
+					for (size_t band_begin = 0; band_begin < img.height() && result == Result::Success; band_begin += band_rows)
+					{
+						const size_t band_end = std::min(img.height(), band_begin + band_rows);
+						const byte* band = rows.rows(band_begin, band_end, scratch);
+						result = writer.writeRows(std::span<const byte>(band, (band_end - band_begin) * rows.row_bytes), band_end - band_begin);
+					}
+					const Result close_result = writer.close();
+					if (result == Result::Success)
+					{
+						result = close_result;
+					}
+					return result;
+				}
 
-					write(width, ptr);
+				Result Write(WriteInfo const& info)
+				{
+					if (!info.const_image || !info.path)
+					{
+						return Result::InvalidParameter;
+					}
+					return WriteToFile(info, [&](OutputStream& file) {return EncodeRows(info, ImageRows(info), file); });
+				}
+			}
 
-					write(height, ptr);
+			namespace pfm
+			{
+				Result EncodeRows(WriteInfo const& info, RowSource const& rows, OutputStream& stream)
+				{
+					if (!info.const_image)
+					{
+						return Result::InvalidParameter;
+					}
+					if (!info.row_major || info.format.type != ElementType::FLOAT || info.format.elem_size != sizeof(float))
+					{
+						return Result::InvalidParameter;
+					}
+					FormatlessImage const& img = *info.const_image;
+					return Write(stream, rows, img.width(), img.height(), info.format.channels);
+				}
 
-					if ((magic_number != 1) && (magic_number != 4))
+				Result Write(WriteInfo const& info)
+				{
+					if (!info.const_image || !info.path)
 					{
-						write(max_value, ptr);
+						return Result::InvalidParameter;
 					}
+					return WriteToFile(info, [&](OutputStream& file) {return EncodeRows(info, ImageRows(info), file); });
+				}
+			}
 
-					*(ptr - 1) = '\n';
+			namespace thatimg
+			{
+				Result EncodeImage(WriteInfo const& info, OutputStream& stream)
+				{
+					if (!info.const_image || !info.path)
+					{
+						return Result::InvalidParameter;
+					}
+					const std::filesystem::path ext_path = info.path->extension();
+					const Compression compression = IsCompressed(ExtractExtensionSV(&ext_path)) ? Compression::LZ4 : Compression::None;
+					return Write(stream, *info.const_image, info.format, info.row_major, compression, info.pool);
 				}
 
 				Result Write(WriteInfo const& info)
 				{
-					if (!info.const_image || info.path)
+					if (!info.const_image || !info.path)
 					{
 						return Result::InvalidParameter;
 					}
-					if (!info.row_major)
+					return WriteToFile(info, [&](OutputStream& file) {return EncodeImage(info, file); });
+				}
+			}
+
+			namespace qoi
+			{
+				Result EncodeImage(WriteInfo const& info, OutputStream& stream)
+				{
+					if (!info.const_image || !info.path)
+					{
+						return Result::InvalidParameter;
+					}
+					if (!info.row_major || info.format.elem_size != 1 || info.format.type == ElementType::FLOAT)
 					{
 						return Result::InvalidParameter;
-						// TODO
-						//FormatedImage tmp(img.width(), img.height(), format, true);
 					}
 					FormatlessImage const& img = *info.const_image;
-					std::string width = std::to_string(img.width());
-					std::string height = std::to_string(img.height());
-					std::string max_value = "255";
+					const std::filesystem::path ext_path = info.path->extension();
+					const bool striped = IsStriped(ExtractExtensionSV(&ext_path));
+					const bool srgb = info.format.type == ElementType::sRGB;
+					return Encode(stream, img.rawData(), img.width(), img.height(), info.format.channels, srgb, striped, info.pool);
+				}
 
-					int magic_number = [&]
+				Result Write(WriteInfo const& info)
+				{
+					if (!info.const_image || !info.path)
 					{
-						if (info.magic_number < 0)
-						{
-							const uint32_t c = info.format.channels;
-							if (c == 1)
-							{
-								return 5;
-							}
-							else if(c == 3)
-							{
-								return 5;
-							}
-							else
-							{
-								return 7;
-							}
-						}
-						return info.magic_number;
-					}();
+						return Result::InvalidParameter;
+					}
+					return WriteToFile(info, [&](OutputStream& file) {return EncodeImage(info, file); });
+				}
+			}
 
-					if (info.magic_number < 0)
+			namespace png
+			{
+				Result EncodeRows(WriteInfo const& info, RowSource const& rows, OutputStream& stream)
+				{
+					if (!info.const_image)
 					{
-						return Result::InvalidValue;
+						return Result::InvalidParameter;
+					}
+					if (!info.row_major || (info.format.elem_size != 1 && info.format.elem_size != 2) || info.format.type == ElementType::FLOAT)
+					{
+						return Result::InvalidParameter;
 					}
+					FormatlessImage const& img = *info.const_image;
+					return Encode(stream, rows, img.width(), img.height(), info.format.channels, info.format.elem_size, info.compression, info.pool);
+				}
 
-					size_t header_size = headerSize(info.magic_number, width, height, max_value);
-					size_t content_size = contentSize(info.magic_number, img.size());
-					size_t total_size = header_size + content_size;
+				Result Write(WriteInfo const& info)
+				{
+					if (!info.const_image || !info.path)
+					{
+						return Result::InvalidParameter;
+					}
+					return WriteToFile(info, [&](OutputStream& file) {return EncodeRows(info, ImageRows(info), file); });
+				}
+			}
 
-					std::vector<byte> file_data(total_size);
-					byte* ptr = file_data.data();
-					const byte* const _ptr = ptr;
-					writeHeader(ptr, info.magic_number, width, height, max_value);
-					assert((ptr - _ptr) == header_size);
-				
-					std::memcpy(ptr, img.rawData(), content_size);
+			namespace exr
+			{
+				Result EncodeRows(WriteInfo const& info, RowSource const& rows, OutputStream& stream)
+				{
+					if (!info.const_image)
+					{
+						return Result::InvalidParameter;
+					}
+					const bool uint_samples = info.format.type == ElementType::UINT && info.format.elem_size == 4;
+					if (!info.row_major || (info.format.type != ElementType::FLOAT && !uint_samples) || (info.format.elem_size != 2 && info.format.elem_size != 4))
+					{
+						return Result::InvalidParameter;
+					}
+					Compression compression = Compression::ZIP;
+					if (info.compression == 0)
+					{
+						compression = Compression::None;
+					}
+					else if (info.compression == 1)
+					{
+						compression = Compression::RLE;
+					}
+					FormatlessImage const& img = *info.const_image;
+					return Encode(stream, rows, img.width(), img.height(), info.format.channels, info.format.elem_size, uint_samples, compression, info.compression, info.pool);
+				}
 
-					Result result = Result::Success;
+				Result Write(WriteInfo const& info)
+				{
+					if (!info.const_image || !info.path)
 					{
-						FileSystem::WriteFileInfo fs_info{
-							.hint = info.hint,
-							.path = info.path,
-							.data = file_data,
-						};
-						result = FileSystem::WriteFile(fs_info, info.filesystem);
+						return Result::InvalidParameter;
 					}
-					return result;
+					return WriteToFile(info, [&](OutputStream& file) {return EncodeRows(info, ImageRows(info), file); });
 				}
 			}
 
@@ -150,7 +263,7 @@ namespace that
 			{
 				struct WriteContext
 				{
-					ExtensibleDataStorage & file;
+					OutputStream & file;
 					Result result;
 				};
 			
@@ -159,85 +272,109 @@ namespace that
 					WriteContext* _context = (stbi::WriteContext*)context;
 					if (_context->result == Result::Success)
 					{
-						_context->file.pushBack(data, len);
+						_context->result = _context->file.write(std::span<const uint8_t>(static_cast<const uint8_t*>(data), size_t(len)));
 					}
 				}
-			
-				Result Write(WriteInfo const& info)
+
+				// The encoder of the extension of info.path (empty if the format can't be written)
+				std::function<int(stbi_write_func*, void*)> GetEncoder(WriteInfo const& info)
 				{
-					Result result = Result::Success;
-					if (!info.const_image || !info.path)
+					std::function<int(stbi_write_func*, void*)> encode;
+					if (!info.path->has_extension())
 					{
-						return Result::InvalidParameter;
+						return encode;
 					}
-					const std::filesystem::path ext = info.path->extension();
-					ExtensibleDataStorage storage;
-
-					WriteContext context{
-						.file = storage,
-						.result = Result::Success,
-					};
-
-					// Hope this code is not used by stbi
-					const int did_not_write = 196;
-					int stbi_res = did_not_write;
-
+					const std::filesystem::path ext_path = info.path->extension();
+					const that::PathStringView ext = ExtractExtensionSV(&ext_path);
 					const FormatlessImage & img = *info.const_image; 
+					const int comp = info.format.channels;
 
-					int comp = info.format.channels;
-					if (ext == ".png")
+					if (png::CanWrite(ext))
 					{
 						if (info.format.elem_size == 1)
 						{
-							stbi_res = stbi_write_png_to_func(writeFileCallback, &context, img.width(), img.height(), comp, img.rawData(), 0);
+							encode = [&img, comp](stbi_write_func* func, void* context) {return stbi_write_png_to_func(func, context, img.width(), img.height(), comp, img.rawData(), 0); };
 						}
 					}
-					else if (ext == ".bmp")
+					else if (IsBMP(ext))
 					{
 						if (info.format.elem_size == 1)
 						{
-							stbi_res = stbi_write_bmp_to_func(writeFileCallback, &context, img.width(), img.height(), comp, img.rawData());
+							encode = [&img, comp](stbi_write_func* func, void* context) {return stbi_write_bmp_to_func(func, context, img.width(), img.height(), comp, img.rawData()); };
 						}
 					}
-					else if (ext == ".tga")
+					else if (IsTGA(ext))
 					{
 						if (info.format.elem_size == 1)
 						{
-							stbi_res = stbi_write_tga_to_func(writeFileCallback, &context, img.width(), img.height(), comp, img.rawData());
+							encode = [&img, comp](stbi_write_func* func, void* context) {return stbi_write_tga_to_func(func, context, img.width(), img.height(), comp, img.rawData()); };
 						}
 					}
-					else if (ext == ".jpg")
+					else if (IsJPEG(ext))
 					{
 						if (info.format.elem_size == 1)
 						{
 							int quality = info.quality;
 							if(quality == -1) quality = 100;
-							stbi_res = stbi_write_jpg_to_func(writeFileCallback, &context, img.width(), img.height(), comp, img.rawData(), quality);
+							encode = [&img, comp, quality](stbi_write_func* func, void* context) {return stbi_write_jpg_to_func(func, context, img.width(), img.height(), comp, img.rawData(), quality); };
 						}
 					}
-					else if (ext == ".hdr")
+					else if (IsHDR(ext))
 					{
 						if ((info.format.elem_size == sizeof(float)) && info.format.type == ElementType::FLOAT)
 						{
-							stbi_res = stbi_write_hdr_to_func(writeFileCallback, &context, img.width(), img.height(), comp, reinterpret_cast<const float*>(img.rawData()));
+							encode = [&img, comp](stbi_write_func* func, void* context) {return stbi_write_hdr_to_func(func, context, img.width(), img.height(), comp, reinterpret_cast<const float*>(img.rawData())); };
 						}
 					}
+					return encode;
+				}
+
+				Result Encode(std::function<int(stbi_write_func*, void*)> const& encode, OutputStream& stream)
+				{
+					WriteContext context{
+						.file = stream,
+						.result = Result::Success,
+					};
+					const int stbi_res = encode(writeFileCallback, &context);
 					// stbi write returns 0 on failure, not 0 on success (stupid, int res should be an error code)
-					if(stbi_res == did_not_write) context.result = Result::WrongFileFormat;
-					else if(stbi_res == 0)	context.result = Result::STBInteralError;
-					else if (context.result == Result::Success)
+					if (stbi_res == 0) return Result::STBInteralError;
+					return context.result;
+				}
+
+				Result EncodeImage(WriteInfo const& info, OutputStream& stream)
+				{
+					if (!info.const_image || !info.path)
 					{
-						{
-							FileSystem::WriteFileInfo fs_info{
-								.hint = info.hint,
-								.path = info.path,
-								.data = storage.storage(),
-							};
-							result = FileSystem::WriteFile(fs_info, info.filesystem);
-						}
+						return Result::InvalidParameter;
 					}
-					result = context.result;
-					return result;
+					const std::function<int(stbi_write_func*, void*)> encode = GetEncoder(info);
+					if (!encode)
+					{
+						return Result::WrongFileFormat;
+					}
+					return Encode(encode, stream);
+				}
+			
+				Result Write(WriteInfo const& info)
+				{
+					if (!info.const_image || !info.path)
+					{
+						return Result::InvalidParameter;
+					}
+					// The encoder, chosen before creating the file
+					const std::function<int(stbi_write_func*, void*)> encode = GetEncoder(info);
+					if (!encode)
+					{
+						return Result::WrongFileFormat;
+					}
+					return WriteToFile(info, [&](OutputStream& file)
+					{
+						// The encoded chunks go straight to the file: the disk writes overlap with the encoding
+						AsyncBufferedOutputStream stream(file);
+						const Result result = Encode(encode, stream);
+						const Result finish_result = stream.finish();
+						return result == Result::Success ? finish_result : result;
+					});
 				}
 
 				//Result Write(FormatedImage const& img, std::filesystem::path const& path, WriteInfo const& info)
@@ -249,6 +386,10 @@ namespace that
 			enum class WriterLibrary
 			{
 				NETPBM,
+				PFM,
+				THATIMG,
+				QOI,
+				PNG,
 				STBI,
 				OPENEXR,
 			};
@@ -257,7 +398,6 @@ namespace that
 				std::filesystem::path& path_with_extension, const std::filesystem::path*& write_path, bool & need_format_conversion, FormatInfo & write_format, bool & write_major
 			)
 			{
-				const bool can_exr = false;
 				if (!path.has_extension())
 				{
 					path_with_extension = path;
@@ -274,28 +414,20 @@ namespace that
 						break;
 						case ElementType::FLOAT:
 						{
+							// Lossless and without conversion: PFM for float, OpenEXR (HALF channels) for half, double is narrowed to a float PFM
 							if (format.elem_size == sizeof(float))
 							{
-								path_with_extension += ".hdr";
+								path_with_extension += ".pfm";
 							}
 							else if (format.elem_size == sizeof(double))
 							{
-								path_with_extension += ".hdr";
+								path_with_extension += ".pfm";
 								need_format_conversion = true;
 								write_format.elem_size = sizeof(float);
 							}
 							else if (format.elem_size == (sizeof(math::float16_t))) 
 							{
-								if (can_exr)
-								{
-									path_with_extension += ".exr";
-								}
-								else
-								{
-									path_with_extension += ".hdr";
-									need_format_conversion = true;
-									write_format.elem_size = sizeof(float);
-								}
+								path_with_extension += ".exr";
 							}
 						}
 						break;
@@ -316,10 +448,134 @@ namespace that
 					// it might need one
 					if (writer == WriterLibrary::NETPBM)
 					{
-						res = Result::NotImplemented;
+						// 8 or 16 bits rows, grey (P4 / P5) or RGB (P6), any number of channels for PAM (P7)
+						if (row_major != IMAGE_ROW_MAJOR)
+						{
+							need_format_conversion = true;
+							write_major = IMAGE_ROW_MAJOR;
+						}
+						// The magic number (and so the channels) is given by the extension, unless it is forced
+						const int magic_number = info.magic_number >= 0 ? info.magic_number : netpbm::MagicNumber(ExtractExtensionSV(&extension));
+						const bool bitmap = magic_number == 4;
+						if (format.type == ElementType::FLOAT)
+						{
+							need_format_conversion = true;
+							write_format.elem_size = 1;
+							write_format.type = ElementType::sRGB;
+						}
+						else if (format.elem_size >= 2 && !bitmap)
+						{
+							// 16 bits samples are read back as UNORM16
+							if (format.elem_size != 2 || format.type != ElementType::UNORM)
+							{
+								need_format_conversion = true;
+								write_format.elem_size = 2;
+								write_format.type = ElementType::UNORM;
+							}
+						}
+						else if (format.elem_size != 1)
+						{
+							need_format_conversion = true;
+							write_format.elem_size = 1;
+						}
+						uint32_t channels = format.channels < 3 ? 1 : 3;
+						if (magic_number == 4 || magic_number == 5)
+						{
+							channels = 1;
+						}
+						else if (magic_number == 6)
+						{
+							channels = 3;
+						}
+						else if (magic_number == 7)
+						{
+							channels = format.channels;
+						}
+						if (format.channels != channels)
+						{
+							need_format_conversion = true;
+							write_format.channels = channels;
+						}
+					}
+					else if (writer == WriterLibrary::PFM)
+					{
+						// float rows, grey or RGB
+						if (row_major != IMAGE_ROW_MAJOR)
+						{
+							need_format_conversion = true;
+							write_major = IMAGE_ROW_MAJOR;
+						}
+						if (format.type != ElementType::FLOAT || format.elem_size != sizeof(float))
+						{
+							need_format_conversion = true;
+							write_format.type = ElementType::FLOAT;
+							write_format.elem_size = sizeof(float);
+						}
+						const uint32_t channels = format.channels < 3 ? 1 : 3;
+						if (format.channels != channels)
+						{
+							need_format_conversion = true;
+							write_format.channels = channels;
+						}
+					}
+					else if (writer == WriterLibrary::QOI)
+					{
+						// 8 bits rows, 1 to 4 channels (grey is expanded by the encoder)
+						if (row_major != IMAGE_ROW_MAJOR)
+						{
+							need_format_conversion = true;
+							write_major = IMAGE_ROW_MAJOR;
+						}
+						if (format.type == ElementType::FLOAT)
+						{
+							need_format_conversion = true;
+							write_format.elem_size = 1;
+							write_format.type = ElementType::sRGB;
+						}
+						else if (format.elem_size != 1)
+						{
+							need_format_conversion = true;
+							write_format.elem_size = 1;
+						}
+						if (format.channels > 4)
+						{
+							need_format_conversion = true;
+							write_format.channels = 4;
+						}
+					}
+					else if (writer == WriterLibrary::PNG)
+					{
+						// 8 or 16 bits rows, 1 to 4 channels
+						if (row_major != IMAGE_ROW_MAJOR)
+						{
+							need_format_conversion = true;
+							write_major = IMAGE_ROW_MAJOR;
+						}
+						if (format.type == ElementType::FLOAT)
+						{
+							need_format_conversion = true;
+							write_format.elem_size = 1;
+							write_format.type = ElementType::sRGB;
+						}
+						else if (format.elem_size >= 2)
+						{
+							// 16 bits samples are read back as UNORM16
+							if (format.elem_size != 2 || format.type != ElementType::UNORM)
+							{
+								need_format_conversion = true;
+								write_format.elem_size = 2;
+								write_format.type = ElementType::UNORM;
+							}
+						}
+						if (format.channels > 4)
+						{
+							need_format_conversion = true;
+							write_format.channels = 4;
+						}
 					}
 					else if (writer == WriterLibrary::STBI)
 					{
+						const bool hdr = stbi::IsHDR(ExtractExtensionSV(&extension));
 						if (row_major != IMAGE_ROW_MAJOR)
 						{
 							need_format_conversion = true;
@@ -333,7 +589,7 @@ namespace that
 							case ElementType::SINT:
 							case ElementType::sRGB:
 							{
-								if (extension == ".hdr")
+								if (hdr)
 								{
 									need_format_conversion = true;
 									write_format.elem_size = sizeof(float);
@@ -351,7 +607,7 @@ namespace that
 							break;
 							case ElementType::FLOAT:
 							{
-								if (extension == ".hdr")
+								if (hdr)
 								{
 									// stbi .hdr can only write float
 									if (format.elem_size != sizeof(float))
@@ -372,14 +628,24 @@ namespace that
 					}
 					else if (writer == WriterLibrary::OPENEXR)
 					{
-						// openEXR can write float or half
-						if (format.elem_size == sizeof(double) || format.type != ElementType::FLOAT)
+						// half or float rows (or 32 bits uint), 1 to 4 channels
+						if (row_major != IMAGE_ROW_MAJOR)
+						{
+							need_format_conversion = true;
+							write_major = IMAGE_ROW_MAJOR;
+						}
+						const bool uint32 = format.type == ElementType::UINT && format.elem_size == sizeof(uint32_t);
+						if (!uint32 && (format.type != ElementType::FLOAT || format.elem_size == sizeof(double)))
 						{
 							need_format_conversion = true;
 							write_format.elem_size = sizeof(float);
 							write_format.type = ElementType::FLOAT;
 						}
-						res = Result::NotImplemented;
+						if (format.channels > 4)
+						{
+							need_format_conversion = true;
+							write_format.channels = 4;
+						}
 					}
 				}
 				return res;
@@ -390,7 +656,6 @@ namespace that
 				WriterLibrary& writer)
 			{
 				Result res = Result::Success;
-				const bool can_exr = false;
 				res = CheckExtension(format, row_major, path, info, path_with_extension, write_path, need_format_conversion, write_format, write_major);
 				
 				if (res != Result::Success)
@@ -409,83 +674,246 @@ namespace that
 				{
 					writer = WriterLibrary::NETPBM;
 				}
+				else if (pfm::IsPFM(ext))
+				{
+					writer = WriterLibrary::PFM;
+				}
+				else if (thatimg::IsThatImg(ext))
+				{
+					// Any format and major, never converted
+					writer = WriterLibrary::THATIMG;
+				}
+				else if (qoi::CanReadWrite(ext))
+				{
+					writer = WriterLibrary::QOI;
+				}
+				else if (png::CanWrite(ext))
+				{
+					writer = WriterLibrary::PNG;
+				}
 				else if (stbi::CanReadWrite(ext))
 				{
 					writer = WriterLibrary::STBI;
 				}
-				else if (can_exr && false)
+				else if (exr::IsEXR(ext))
 				{
 					writer = WriterLibrary::OPENEXR;
 				}
+				else
+				{
+					return Result::UnknownFileExtension;
+				}
 
 				res = FindFormatConversionIFP(format, row_major, ext_path, info, need_format_conversion, write_format, write_major, writer);
 
 				return res;
 			}
 
-			
-			Result Write(WriteInfo const& info)
+			namespace
 			{
-				Result res = Result::Success;
-				if (!info.const_image || info.const_image->empty() || !info.path)
+				// rows: the rows of info.const_image in info.format
+				Result EncodeWith(WriterLibrary writer, WriteInfo const& info, RowSource const& rows, OutputStream& stream)
 				{
-					return Result::InvalidParameter;
+					Result res = Result::InvalidParameter;
+					if (writer == WriterLibrary::NETPBM)
+					{
+						res = netpbm::EncodeRows(info, rows, stream);
+					}
+					else if (writer == WriterLibrary::PFM)
+					{
+						res = pfm::EncodeRows(info, rows, stream);
+					}
+					else if (writer == WriterLibrary::THATIMG)
+					{
+						res = thatimg::EncodeImage(info, stream);
+					}
+					else if (writer == WriterLibrary::QOI)
+					{
+						res = qoi::EncodeImage(info, stream);
+					}
+					else if (writer == WriterLibrary::PNG)
+					{
+						res = png::EncodeRows(info, rows, stream);
+					}
+					else if (writer == WriterLibrary::STBI)
+					{
+						res = stbi::EncodeImage(info, stream);
+					}
+					else if (writer == WriterLibrary::OPENEXR)
+					{
+						res = exr::EncodeRows(info, rows, stream);
+					}
+					return res;
 				}
-				const FormatlessImage * target = info.const_image;
 
-				const std::filesystem::path * write_path = info.path;
-				std::filesystem::path path_with_extension;
+				// Converts info.const_image if the writer of the extension of info.path needs it, then encodes it to stream
+				// or to the file of info.path if stream is nullptr
+				Result WriteImpl(WriteInfo const& info, OutputStream* stream)
+				{
+					Result res = Result::Success;
+					if (!info.const_image || info.const_image->empty() || !info.path)
+					{
+						return Result::InvalidParameter;
+					}
+					const FormatlessImage * target = info.const_image;
 
-				bool need_format_conversion = false;
-				FormatInfo write_format = info.format;
-				bool write_major = info.row_major;
-				WriterLibrary writer;
+					const std::filesystem::path * write_path = info.path;
+					std::filesystem::path path_with_extension;
 
-				res = CheckWrite(info.format, info.row_major, *info.path, info, path_with_extension, write_path, need_format_conversion, write_format, write_major, writer);
+					bool need_format_conversion = false;
+					FormatInfo write_format = info.format;
+					bool write_major = info.row_major;
+					WriterLibrary writer;
 
-				if (res != Result::Success)
-				{
-					return res;
-				}
+					res = CheckWrite(info.format, info.row_major, *info.path, info, path_with_extension, write_path, need_format_conversion, write_format, write_major, writer);
 
-				WriteInfo info2 = info;
-				info2.format = write_format;
-				info2.row_major = write_major;
-				info2.path = write_path;
+					if (res != Result::Success)
+					{
+						return res;
+					}
 
-				FormatlessImage write_image;
-				if (need_format_conversion)
-				{
-					if (info.can_modify_image)
+					WriteInfo info2 = info;
+					info2.format = write_format;
+					info2.row_major = write_major;
+					info2.path = write_path;
+
+					// The writers that consume the rows in bands convert each band right before encoding it (no full size copy)
+					const bool band_writer = writer == WriterLibrary::NETPBM || writer == WriterLibrary::PFM || writer == WriterLibrary::PNG || writer == WriterLibrary::OPENEXR;
+					if (need_format_conversion && !info.can_modify_image && band_writer && info.row_major == IMAGE_ROW_MAJOR && write_major == IMAGE_ROW_MAJOR)
+					{
+						const FormatlessImage& src = *info.const_image;
+						const size_t src_row_bytes = src.width() * info.format.pixelSize();
+						const auto convert = [&](size_t begin, size_t end, uint8_t* dst)
+						{
+							ImageProcessor::ConvertParams params{
+								.src = src.rawData() + begin * src_row_bytes,
+								.dst = dst,
+								.w = src.width(),
+								.h = end - begin,
+								.src_format = info.format,
+								.dst_format = write_format,
+								.src_row_major = true,
+								.dst_row_major = true,
+								.tone_mapping = info.tone_mapping,
+								.pool = info.pool,
+							};
+							return ImageProcessor::ConvertFormat(params);
+						};
+						// The first failure of a band conversion (the bands can be converted on several threads)
+						std::atomic<Result> convert_result = Result::Success;
+						const RowSource rows{
+							.row_bytes = src.width() * write_format.pixelSize(),
+							.produce = [&](size_t begin, size_t end, uint8_t* dst)
+							{
+								const Result r = convert(begin, end, dst);
+								if (r != Result::Success)
+								{
+									Result expected = Result::Success;
+									convert_result.compare_exchange_strong(expected, r);
+								}
+							},
+						};
+						// The encoder does not see the failures of the conversion, they are checked once it is done (so the file is not kept)
+						const auto encode = [&](OutputStream& out)
+						{
+							const Result encode_result = EncodeWith(writer, info2, rows, out);
+							const Result r = convert_result.load();
+							return r != Result::Success ? r : encode_result;
+						};
+						if (stream)
+						{
+							res = encode(*stream);
+						}
+						else
+						{
+							res = WriteToFile(info2, encode);
+						}
+						return res;
+					}
+
+					FormatlessImage write_image;
+					if (need_format_conversion)
 					{
-						res = info.image->convertFormat(info.format, info.row_major, write_format, write_major);
-						info2.image = info.image;
+						if (info.can_modify_image)
+						{
+							res = info.image->convertFormat(info.format, info.row_major, write_format, write_major, AlphaMode::Keep, info.tone_mapping);
+							info2.image = info.image;
+						}
+						else
+						{
+							// Converted straight from the source (no intermediate copy), which also allows a multithreaded conversion
+							const FormatlessImage& src = *info.const_image;
+							write_image = FormatlessImage(src.width(), src.height(), write_format.pixelSize());
+							ImageProcessor::ConvertParams params{
+								.src = src.rawData(),
+								.dst = write_image.rawData(),
+								.w = src.width(),
+								.h = src.height(),
+								.src_format = info.format,
+								.dst_format = write_format,
+								.src_row_major = info.row_major,
+								.dst_row_major = write_major,
+								.tone_mapping = info.tone_mapping,
+								.pool = info.pool,
+							};
+							res = ImageProcessor::ConvertFormat(params);
+							info2.const_image = &write_image;
+						}
+						if (res != Result::Success)
+						{
+							return res;
+						}
 					}
-					else
+
+					const RowSource rows = ImageRows(info2);
+					if (stream)
 					{
-						write_image = *info.const_image;
-						res = write_image.convertFormat(info.format, info.row_major, info2.format, info2.row_major);
-						info2.const_image = &write_image;
+						res = EncodeWith(writer, info2, rows, *stream);
 					}
-					if (res != Result::Success)
+					else if (writer == WriterLibrary::STBI)
 					{
-						return res;
+						// Buffered on a background thread
+						res = stbi::Write(info2);
+					}
+					else
+					{
+						res = WriteToFile(info2, [&](OutputStream& file) {return EncodeWith(writer, info2, rows, file); });
 					}
+					return res;
 				}
+			}
 
-				if (writer == WriterLibrary::NETPBM)
-				{
-					res = netpbm::Write(info2);
-				}
-				else if (writer == WriterLibrary::STBI)
-				{
-					res = stbi::Write(info2);
-				}
-				else if (writer == WriterLibrary::OPENEXR)
+			Result Write(WriteInfo const& info)
+			{
+				return WriteImpl(info, nullptr);
+			}
+
+			Result Encode(WriteInfo const& info, std::string_view extension, ExtensibleDataStorage& out)
+			{
+				// The extension selects the writer (and its options) as the one of a path would
+				const FileSystem::Path path = extension.empty() ? FileSystem::Path("image") : FileSystem::Path("image." + std::string(extension));
+				WriteInfo info2 = info;
+				info2.path = &path;
+				const size_t initial_size = out.size();
+				MemoryOutputStream stream(out);
+				const Result res = WriteImpl(info2, &stream);
+				if (res != Result::Success)
 				{
-					res = Result::NotImplemented;
+					// No partial encoding
+					out.resize(initial_size);
 				}
 				return res;
+			}
+
+			AsyncResult WriteAsync(WriteInfo const& info, ThreadPool* executor)
+			{
+				std::shared_ptr<FileSystem::Path> path = info.path ? std::make_shared<FileSystem::Path>(*info.path) : nullptr;
+				return RunAsync([info, path]()
+				{
+					WriteInfo info2 = info;
+					info2.path = path.get();
+					return Write(info2);
+				}, executor);
 			}		
 		}
 
@@ -0,0 +1,395 @@
+#include <that/img/ImageCompare.hpp>
+#include <that/img/ImageProcessor.hpp>
+
+#include <that/utils/ThreadPool.hpp>
+
+#include <array>
+#include <cmath>
+#include <mutex>
+#include <limits>
+
+namespace that
+{
+	namespace img
+	{
+		namespace
+		{
+			constexpr const int SSIM_RADIUS = 5;
+			constexpr const int SSIM_TAPS = 2 * SSIM_RADIUS + 1;
+
+			std::array<float, SSIM_TAPS> SSIMKernel()
+			{
+				std::array<float, SSIM_TAPS> res;
+				const double sigma = 1.5;
+				double sum = 0;
+				for (int i = 0; i < SSIM_TAPS; ++i)
+				{
+					const double x = double(i - SSIM_RADIUS);
+					const double g = std::exp(-(x * x) / (2 * sigma * sigma));
+					res[i] = float(g);
+					sum += g;
+				}
+				for (float& g : res)
+				{
+					g = float(g / sum);
+				}
+				return res;
+			}
+
+			// The 5 horizontally filtered moments of a row, w * channels floats each
+			enum Moment
+			{
+				MU_A,
+				MU_B,
+				AA,
+				BB,
+				AB,
+				MOMENT_COUNT,
+			};
+
+			struct CompareContext
+			{
+				ConstImageView a;
+				ConstImageView b;
+				FormatInfo a_format;
+				FormatInfo b_format;
+				FormatInfo float_format;
+				uint32_t channels;
+				bool ssim;
+				float c1;
+				float c2;
+				std::array<float, SSIM_TAPS> kernel;
+			};
+
+			struct PartialComparison
+			{
+				std::vector<double> squared_error = {};
+				std::vector<double> max_abs_error = {};
+				std::vector<double> ssim = {};
+
+				void init(uint32_t channels)
+				{
+					squared_error.assign(channels, 0.0);
+					max_abs_error.assign(channels, 0.0);
+					ssim.assign(channels, 0.0);
+				}
+
+				void merge(PartialComparison const& o)
+				{
+					for (size_t c = 0; c < squared_error.size(); ++c)
+					{
+						squared_error[c] += o.squared_error[c];
+						max_abs_error[c] = std::max(max_abs_error[c], o.max_abs_error[c]);
+						ssim[c] += o.ssim[c];
+					}
+				}
+			};
+
+			// Per task scratch memory, bounded by a few rows
+			class RowComparator
+			{
+			protected:
+
+				CompareContext const& _ctx;
+				const size_t _w;
+				const size_t _h;
+				const size_t _row_floats;
+				std::vector<float> _row_a;
+				std::vector<float> _row_b;
+				// Ring of SSIM_TAPS horizontally filtered rows
+				std::vector<float> _ring;
+
+				float* ringRow(int64_t virtual_row, Moment m)
+				{
+					const size_t slot = size_t((virtual_row % SSIM_TAPS + SSIM_TAPS) % SSIM_TAPS);
+					return _ring.data() + (slot * MOMENT_COUNT + m) * _row_floats;
+				}
+
+				Result decodeRow(size_t y, size_t z)
+				{
+					ImageProcessor::ConvertParams pa{
+						.src = _ctx.a.row(y, z),
+						.dst = reinterpret_cast<uint8_t*>(_row_a.data()),
+						.w = _w,
+						.h = 1,
+						.src_format = _ctx.a_format,
+						.dst_format = _ctx.float_format,
+						.src_row_major = true,
+						.dst_row_major = true,
+					};
+					Result res = ImageProcessor::ConvertFormat(pa);
+					if (res == Result::Success)
+					{
+						ImageProcessor::ConvertParams pb{
+							.src = _ctx.b.row(y, z),
+							.dst = reinterpret_cast<uint8_t*>(_row_b.data()),
+							.w = _w,
+							.h = 1,
+							.src_format = _ctx.b_format,
+							.dst_format = _ctx.float_format,
+							.src_row_major = true,
+							.dst_row_major = true,
+						};
+						res = ImageProcessor::ConvertFormat(pb);
+					}
+					return res;
+				}
+
+				void accumulateErrors(PartialComparison& p)
+				{
+					const uint32_t C = _ctx.channels;
+					for (uint32_t c = 0; c < C; ++c)
+					{
+						double se = 0;
+						float max_abs = 0;
+						for (size_t x = 0; x < _w; ++x)
+						{
+							const float d = _row_a[x * C + c] - _row_b[x * C + c];
+							se += double(d * d);
+							max_abs = std::max(max_abs, std::abs(d));
+						}
+						p.squared_error[c] += se;
+						p.max_abs_error[c] = std::max<double>(p.max_abs_error[c], max_abs);
+					}
+				}
+
+				void filterRow(int64_t virtual_row)
+				{
+					const int64_t C = _ctx.channels;
+					const int64_t w = int64_t(_w);
+					float* mu_a = ringRow(virtual_row, MU_A);
+					float* mu_b = ringRow(virtual_row, MU_B);
+					float* aa = ringRow(virtual_row, AA);
+					float* bb = ringRow(virtual_row, BB);
+					float* ab = ringRow(virtual_row, AB);
+					for (int64_t x = 0; x < w; ++x)
+					{
+						for (int64_t c = 0; c < C; ++c)
+						{
+							float sa = 0, sb = 0, saa = 0, sbb = 0, sab = 0;
+							for (int k = 0; k < SSIM_TAPS; ++k)
+							{
+								const int64_t xx = std::clamp<int64_t>(x + k - SSIM_RADIUS, 0, w - 1);
+								const float g = _ctx.kernel[k];
+								const float va = _row_a[xx * C + c];
+								const float vb = _row_b[xx * C + c];
+								sa += g * va;
+								sb += g * vb;
+								saa += g * va * va;
+								sbb += g * vb * vb;
+								sab += g * va * vb;
+							}
+							const size_t i = size_t(x * C + c);
+							mu_a[i] = sa;
+							mu_b[i] = sb;
+							aa[i] = saa;
+							bb[i] = sbb;
+							ab[i] = sab;
+						}
+					}
+				}
+
+				void accumulateSSIM(int64_t y, PartialComparison& p)
+				{
+					const uint32_t C = _ctx.channels;
+					std::array<const float*, SSIM_TAPS * MOMENT_COUNT> rows;
+					for (int k = 0; k < SSIM_TAPS; ++k)
+					{
+						for (int m = 0; m < MOMENT_COUNT; ++m)
+						{
+							rows[k * MOMENT_COUNT + m] = ringRow(y + k - SSIM_RADIUS, Moment(m));
+						}
+					}
+					for (uint32_t c = 0; c < C; ++c)
+					{
+						double sum = 0;
+						for (size_t x = 0; x < _w; ++x)
+						{
+							const size_t i = x * C + c;
+							float m[MOMENT_COUNT] = { 0, 0, 0, 0, 0 };
+							for (int k = 0; k < SSIM_TAPS; ++k)
+							{
+								const float g = _ctx.kernel[k];
+								for (int mm = 0; mm < MOMENT_COUNT; ++mm)
+								{
+									m[mm] += g * rows[k * MOMENT_COUNT + mm][i];
+								}
+							}
+							const float mu_a2 = m[MU_A] * m[MU_A];
+							const float mu_b2 = m[MU_B] * m[MU_B];
+							const float mu_ab = m[MU_A] * m[MU_B];
+							const float var_a = m[AA] - mu_a2;
+							const float var_b = m[BB] - mu_b2;
+							const float cov = m[AB] - mu_ab;
+							const float num = (2 * mu_ab + _ctx.c1) * (2 * cov + _ctx.c2);
+							const float den = (mu_a2 + mu_b2 + _ctx.c1) * (var_a + var_b + _ctx.c2);
+							sum += double(num / den);
+						}
+						p.ssim[c] += sum;
+					}
+				}
+
+			public:
+
+				RowComparator(CompareContext const& ctx) :
+					_ctx(ctx),
+					_w(ctx.a.extent.width),
+					_h(ctx.a.extent.height),
+					_row_floats(_w * ctx.channels),
+					_row_a(_row_floats),
+					_row_b(_row_floats)
+				{
+					if (ctx.ssim)
+					{
+						_ring.resize(SSIM_TAPS * MOMENT_COUNT * _row_floats);
+					}
+				}
+
+				// Rows [y0, y1) of slice z
+				Result process(size_t y0, size_t y1, size_t z, PartialComparison& p)
+				{
+					Result res = Result::Success;
+					const int64_t h = int64_t(_h);
+					if (!_ctx.ssim)
+					{
+						for (size_t y = y0; y < y1 && res == Result::Success; ++y)
+						{
+							res = decodeRow(y, z);
+							if (res == Result::Success)
+							{
+								accumulateErrors(p);
+							}
+						}
+						return res;
+					}
+
+					const auto load = [&](int64_t virtual_row) -> Result
+					{
+						const int64_t y = std::clamp<int64_t>(virtual_row, 0, h - 1);
+						Result r = decodeRow(size_t(y), z);
+						if (r == Result::Success)
+						{
+							if (virtual_row >= int64_t(y0) && virtual_row < int64_t(y1))
+							{
+								accumulateErrors(p);
+							}
+							filterRow(virtual_row);
+						}
+						return r;
+					};
+
+					for (int64_t v = int64_t(y0) - SSIM_RADIUS; v < int64_t(y0) + SSIM_RADIUS && res == Result::Success; ++v)
+					{
+						res = load(v);
+					}
+					for (int64_t y = int64_t(y0); y < int64_t(y1) && res == Result::Success; ++y)
+					{
+						res = load(y + SSIM_RADIUS);
+						if (res == Result::Success)
+						{
+							accumulateSSIM(y, p);
+						}
+					}
+					return res;
+				}
+			};
+		}
+
+		Result Compare(ConstImageView const& a, ConstImageView const& b, CompareInfo const& info, ImageComparison& result)
+		{
+			if (a.empty() || b.empty() || !(a.extent == b.extent))
+			{
+				return Result::InvalidParameter;
+			}
+			CompareContext ctx{
+				.a = a,
+				.b = b,
+				.a_format = a.format,
+				.b_format = b.format,
+				.channels = std::min(a.format.channels, b.format.channels),
+				.ssim = info.compute_ssim,
+				.c1 = float((0.01 * info.peak) * (0.01 * info.peak)),
+				.c2 = float((0.03 * info.peak) * (0.03 * info.peak)),
+				.kernel = SSIMKernel(),
+			};
+			if (ctx.channels == 0)
+			{
+				return Result::InvalidParameter;
+			}
+			if (a.format.type == ElementType::sRGB && b.format.type == ElementType::sRGB)
+			{
+				ctx.a_format.type = ElementType::UNORM;
+				ctx.b_format.type = ElementType::UNORM;
+			}
+			ctx.float_format = FormatInfo{ .type = ElementType::FLOAT, .elem_size = sizeof(float), .channels = uint8_t(ctx.channels) };
+
+			const size_t w = a.extent.width;
+			const size_t h = a.extent.height;
+			const size_t rows = h * a.extent.depth;
+
+			PartialComparison total;
+			total.init(ctx.channels);
+			std::mutex mutex;
+			Result res = Result::Success;
+
+			// The SSIM ring has to be refilled at each task start, so the tasks should not be too small
+			const size_t min_rows = std::max<size_t>(ctx.ssim ? 4 * SSIM_TAPS : 1, (1 << 16) / std::max<size_t>(w, 1));
+			ParallelForRange(rows, min_rows, [&](size_t begin, size_t end)
+			{
+				RowComparator comparator(ctx);
+				PartialComparison p;
+				p.init(ctx.channels);
+				Result r = Result::Success;
+				// Split the range on the slices
+				size_t row = begin;
+				while (row < end && r == Result::Success)
+				{
+					const size_t z = row / h;
+					const size_t y0 = row % h;
+					const size_t y1 = std::min(h, y0 + (end - row));
+					r = comparator.process(y0, y1, z, p);
+					row += (y1 - y0);
+				}
+				std::unique_lock lock(mutex);
+				total.merge(p);
+				if (r != Result::Success)
+				{
+					res = r;
+				}
+			}, info.pool);
+
+			if (res != Result::Success)
+			{
+				return res;
+			}
+
+			const double n = double(a.pixelCount());
+			result.channels.resize(ctx.channels);
+			result.mse = 0;
+			result.ssim = 0;
+			for (uint32_t c = 0; c < ctx.channels; ++c)
+			{
+				ChannelComparison& cc = result.channels[c];
+				cc.mse = total.squared_error[c] / n;
+				cc.psnr = cc.mse > 0 ? 10.0 * std::log10((info.peak * info.peak) / cc.mse) : std::numeric_limits<double>::infinity();
+				cc.max_abs_error = total.max_abs_error[c];
+				cc.ssim = ctx.ssim ? total.ssim[c] / n : 0.0;
+				result.mse += cc.mse;
+				result.ssim += cc.ssim;
+			}
+			result.mse /= double(ctx.channels);
+			result.ssim /= double(ctx.channels);
+			result.psnr = result.mse > 0 ? 10.0 * std::log10((info.peak * info.peak) / result.mse) : std::numeric_limits<double>::infinity();
+			return res;
+		}
+
+		Result Compare(FormatedImage const& a, FormatedImage const& b, CompareInfo const& info, ImageComparison& result)
+		{
+			if (a.rowMajor() != b.rowMajor())
+			{
+				return Result::InvalidParameter;
+			}
+			return Compare(a.view(), b.view(), info, result);
+		}
+	}
+}
@@ -1,22 +1,146 @@
 #include <that/img/ImageIO.hpp>
 
+#include <cstring>
+
 namespace that
 {
 	namespace img
 	{
 		namespace io
 		{
-		
+			namespace
+			{
+				// Case insensitive (ASCII) comparison of an extension with a lower case name
+				template <class Char>
+				bool ExtensionIs(std::basic_string_view<Char> const& ext, std::string_view name)
+				{
+					const auto lower = [](Char c)
+					{
+						return (c >= Char('A') && c <= Char('Z')) ? Char(c - Char('A') + Char('a')) : c;
+					};
+					return ext.size() == name.size() && std::equal(ext.begin(), ext.end(), name.begin(), [&](Char c, char n) {return lower(c) == Char(n); });
+				}
+
+				template <class Char>
+				int NetpbmMagicNumber(std::basic_string_view<Char> const& ext)
+				{
+					constexpr const char* names[] = {"pbm", "pgm", "ppm", "pam"};
+					for (int i = 0; i < 4; ++i)
+					{
+						if (ExtensionIs(ext, names[i]))
+						{
+							return 4 + i;
+						}
+					}
+					return -1;
+				}
+			}
+
 			namespace netpbm
 			{
 				bool IsNetpbm(std::string_view const& ext)
 				{
-					return ext == "ppm" || ext == "pgm" || ext == "pbm";
+					return ExtensionIs(ext, "ppm") || ExtensionIs(ext, "pgm") || ExtensionIs(ext, "pbm") || ExtensionIs(ext, "pnm") || ExtensionIs(ext, "pam");
 				}
 
 				bool IsNetpbm(std::wstring_view const& ext)
 				{
-					return ext == L"ppm" || ext == L"pgm" || ext == L"pbm";
+					return ExtensionIs(ext, "ppm") || ExtensionIs(ext, "pgm") || ExtensionIs(ext, "pbm") || ExtensionIs(ext, "pnm") || ExtensionIs(ext, "pam");
+				}
+
+				int MagicNumber(std::string_view const& ext)
+				{
+					return NetpbmMagicNumber(ext);
+				}
+
+				int MagicNumber(std::wstring_view const& ext)
+				{
+					return NetpbmMagicNumber(ext);
+				}
+			}
+
+			namespace pfm
+			{
+				bool IsPFM(std::string_view const& ext)
+				{
+					return ExtensionIs(ext, "pfm");
+				}
+
+				bool IsPFM(std::wstring_view const& ext)
+				{
+					return ExtensionIs(ext, "pfm");
+				}
+			}
+
+			namespace thatimg
+			{
+				bool IsThatImg(std::string_view const& ext)
+				{
+					return ExtensionIs(ext, "thatimg") || ExtensionIs(ext, "thatimgz");
+				}
+
+				bool IsThatImg(std::wstring_view const& ext)
+				{
+					return ExtensionIs(ext, "thatimg") || ExtensionIs(ext, "thatimgz");
+				}
+
+				bool IsCompressed(std::string_view const& ext)
+				{
+					return ExtensionIs(ext, "thatimgz");
+				}
+
+				bool IsCompressed(std::wstring_view const& ext)
+				{
+					return ExtensionIs(ext, "thatimgz");
+				}
+			}
+
+			namespace qoi
+			{
+				bool CanReadWrite(std::string_view const& ext)
+				{
+					return ExtensionIs(ext, "qoi") || ExtensionIs(ext, "qois");
+				}
+
+				bool CanReadWrite(std::wstring_view const& ext)
+				{
+					return ExtensionIs(ext, "qoi") || ExtensionIs(ext, "qois");
+				}
+
+				bool IsStriped(std::string_view const& ext)
+				{
+					return ExtensionIs(ext, "qois");
+				}
+
+				bool IsStriped(std::wstring_view const& ext)
+				{
+					return ExtensionIs(ext, "qois");
+				}
+			}
+
+			namespace png
+			{
+				bool CanWrite(std::string_view const& ext)
+				{
+					return ExtensionIs(ext, "png");
+				}
+
+				bool CanWrite(std::wstring_view const& ext)
+				{
+					return ExtensionIs(ext, "png");
+				}
+			}
+
+			namespace exr
+			{
+				bool IsEXR(std::string_view const& ext)
+				{
+					return ExtensionIs(ext, "exr");
+				}
+
+				bool IsEXR(std::wstring_view const& ext)
+				{
+					return ExtensionIs(ext, "exr");
 				}
 			}
 
@@ -24,12 +148,52 @@ namespace that
 			{
 				bool CanReadWrite(std::string_view const& ext)
 				{
-					return ext == "png" || ext == "jpg" || ext == "jpeg" || ext == "tga" || ext == "hdr";
+					return ExtensionIs(ext, "png") || ExtensionIs(ext, "jpg") || ExtensionIs(ext, "jpeg") || ExtensionIs(ext, "tga") || ExtensionIs(ext, "hdr");
 				}
 
 				bool CanReadWrite(std::wstring_view const& ext)
 				{
-					return ext == L"png" || ext == L"jpg" || ext == L"jpeg" || ext == L"tga" || ext == L"hdr";
+					return ExtensionIs(ext, "png") || ExtensionIs(ext, "jpg") || ExtensionIs(ext, "jpeg") || ExtensionIs(ext, "tga") || ExtensionIs(ext, "hdr");
+				}
+
+				bool IsTGA(std::string_view const& ext)
+				{
+					return ExtensionIs(ext, "tga");
+				}
+
+				bool IsTGA(std::wstring_view const& ext)
+				{
+					return ExtensionIs(ext, "tga");
+				}
+
+				bool IsJPEG(std::string_view const& ext)
+				{
+					return ExtensionIs(ext, "jpg") || ExtensionIs(ext, "jpeg");
+				}
+
+				bool IsJPEG(std::wstring_view const& ext)
+				{
+					return ExtensionIs(ext, "jpg") || ExtensionIs(ext, "jpeg");
+				}
+
+				bool IsHDR(std::string_view const& ext)
+				{
+					return ExtensionIs(ext, "hdr");
+				}
+
+				bool IsHDR(std::wstring_view const& ext)
+				{
+					return ExtensionIs(ext, "hdr");
+				}
+
+				bool IsBMP(std::string_view const& ext)
+				{
+					return ExtensionIs(ext, "bmp");
+				}
+
+				bool IsBMP(std::wstring_view const& ext)
+				{
+					return ExtensionIs(ext, "bmp");
 				}
 			}
 
@@ -52,6 +216,101 @@ namespace that
 				that::PathStringView ext = that::PathStringView(s.data() + 1, s.size() - 1);
 				return ext;
 			}
+
+			std::string_view DetectFileFormat(std::span<const uint8_t> prefix)
+			{
+				const auto starts_with = [&](const void* signature, size_t size)
+				{
+					return prefix.size() >= size && std::memcmp(prefix.data(), signature, size) == 0;
+				};
+				const auto is_space = [](uint8_t c)
+				{
+					return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+				};
+				constexpr const uint8_t png[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+				constexpr const uint8_t jpg[3] = {0xFF, 0xD8, 0xFF};
+				constexpr const uint8_t exr[4] = {0x76, 0x2F, 0x31, 0x01};
+				if (starts_with(png, sizeof(png)))
+				{
+					return "png";
+				}
+				if (starts_with(jpg, sizeof(jpg)))
+				{
+					return "jpg";
+				}
+				if (starts_with(exr, sizeof(exr)))
+				{
+					return "exr";
+				}
+				if (starts_with("qoif", 4))
+				{
+					return "qoi";
+				}
+				if (starts_with("qois", 4))
+				{
+					return "qois";
+				}
+				if (starts_with("THATIMG", 8))
+				{
+					// Also .thatimgz (same header)
+					return "thatimg";
+				}
+				if (starts_with("#?RADIANCE", 10) || starts_with("#?RGBE", 6))
+				{
+					return "hdr";
+				}
+				if (prefix.size() >= 3 && prefix[0] == 'P' && is_space(prefix[2]))
+				{
+					switch (prefix[1])
+					{
+					case 'F':
+					case 'f':
+						return "pfm";
+					case '1':
+					case '4':
+						return "pbm";
+					case '2':
+					case '5':
+						return "pgm";
+					case '3':
+					case '6':
+						return "ppm";
+					case '7':
+						return "pam";
+					}
+				}
+				// TGA: color map type, image type, color map entry size, pixel depth and descriptor must be consistent
+				if (prefix.size() >= 18)
+				{
+					const uint8_t color_map = prefix[1];
+					const uint8_t type = prefix[2];
+					const uint8_t entry_size = prefix[7];
+					const uint32_t width = prefix[12] | (uint32_t(prefix[13]) << 8);
+					const uint32_t height = prefix[14] | (uint32_t(prefix[15]) << 8);
+					const uint8_t depth = prefix[16];
+					const uint8_t descriptor = prefix[17];
+					const bool mapped = type == 1 || type == 9;
+					const bool true_color = type == 2 || type == 3 || type == 10 || type == 11;
+					const auto valid_size = [](uint8_t bits)
+					{
+						return bits == 8 || bits == 15 || bits == 16 || bits == 24 || bits == 32;
+					};
+					bool valid = color_map <= 1 && (mapped || true_color) && width > 0 && height > 0 && (descriptor & 0xC0) == 0;
+					if (mapped)
+					{
+						valid = valid && color_map == 1 && (depth == 8 || depth == 16) && valid_size(entry_size) && entry_size != 8;
+					}
+					else
+					{
+						valid = valid && valid_size(depth) && (color_map == 0 || valid_size(entry_size));
+					}
+					if (valid)
+					{
+						return "tga";
+					}
+				}
+				return {};
+			}
 		}
 }
 
@@ -0,0 +1,181 @@
+#include <that/img/ImageResource.hpp>
+#include <that/img/ImageProcessor.hpp>
+
+#include <that/stl_ext/alignment.hpp>
+
+namespace that
+{
+	namespace img
+	{
+		void ImageResource::ComputeLayout(FormatInfo const& format, ImageExtent const& extent, uint32_t layers, uint32_t mips, size_t alignment, std::vector<size_t>& offsets)
+		{
+			const size_t pixel_size = format.pixelSize();
+			offsets.resize(size_t(layers) * size_t(mips) + 1);
+			size_t offset = 0;
+			size_t i = 0;
+			for (uint32_t l = 0; l < layers; ++l)
+			{
+				for (uint32_t m = 0; m < mips; ++m)
+				{
+					offset = std::alignUp(offset, alignment);
+					offsets[i] = offset;
+					offset += MipExtent(extent, m).pixelCount() * pixel_size;
+					++i;
+				}
+			}
+			offsets[i] = offset;
+		}
+
+		ImageResource::ImageResource(CreateInfo const& ci) :
+			_format(ci.format),
+			_extent(ci.extent),
+			_layers(std::max<uint32_t>(ci.layers, 1)),
+			_mips(ci.mips ? std::min(ci.mips, MaxMipLevels(ci.extent)) : MaxMipLevels(ci.extent)),
+			_alignment(std::max<size_t>(ci.alignment, 1))
+		{
+			computeOffsets();
+			_storage.allocate(_offsets.back(), _alignment, ci.zero_init);
+		}
+
+		ImageResource::ImageResource(CreateInfo const& ci, ImageStorage&& storage) :
+			_format(ci.format),
+			_extent(ci.extent),
+			_layers(std::max<uint32_t>(ci.layers, 1)),
+			_mips(ci.mips ? std::min(ci.mips, MaxMipLevels(ci.extent)) : MaxMipLevels(ci.extent)),
+			_alignment(std::max<size_t>(ci.alignment, 1)),
+			_storage(std::move(storage))
+		{
+			computeOffsets();
+			assert(_storage.size() >= _offsets.back());
+		}
+
+		void ImageResource::computeOffsets()
+		{
+			ComputeLayout(_format, _extent, _layers, _mips, _alignment, _offsets);
+		}
+
+		Result ImageResource::reFormat(FormatInfo const& new_format)
+		{
+			Result result = Result::Success;
+			if (new_format == _format)
+			{
+				return result;
+			}
+			const bool in_place = new_format.pixelSize() == _format.pixelSize();
+			ImageStorage new_storage;
+			std::vector<size_t> new_offsets;
+			if (in_place)
+			{
+				new_offsets = _offsets;
+			}
+			else
+			{
+				ComputeLayout(new_format, _extent, _layers, _mips, _alignment, new_offsets);
+				new_storage.allocate(new_offsets.back(), _alignment);
+			}
+			byte* dst_base = in_place ? _storage.data() : new_storage.data();
+
+			for (uint32_t l = 0; l < _layers && result == Result::Success; ++l)
+			{
+				for (uint32_t m = 0; m < _mips && result == Result::Success; ++m)
+				{
+					const uint32_t index = subresourceIndex(l, m);
+					const ImageExtent e = extent(m);
+					ImageProcessor::ConvertParams params{
+						.src = _storage.data() + _offsets[index],
+						.dst = dst_base + new_offsets[index],
+						.w = e.width,
+						.h = size_t(e.height) * size_t(e.depth),
+						.src_format = _format,
+						.dst_format = new_format,
+						.src_row_major = true,
+						.dst_row_major = true,
+					};
+					result = ImageProcessor::ConvertFormat(params);
+				}
+			}
+
+			// In place: a failure can only happen on the first conversion (the format pair is not supported), so the content is still valid
+			if (result == Result::Success)
+			{
+				_format = new_format;
+				if (!in_place)
+				{
+					_storage = std::move(new_storage);
+					_offsets = std::move(new_offsets);
+				}
+			}
+			return result;
+		}
+
+		Result ImageResource::convertSubresource(uint32_t layer, uint32_t mip, ImageView const& dst) const
+		{
+			const ImageExtent e = extent(mip);
+			if (!(dst.extent == e) || !dst.isPacked())
+			{
+				return Result::InvalidParameter;
+			}
+			ImageProcessor::ConvertParams params{
+				.src = rawData() + subresourceOffset(layer, mip),
+				.dst = dst.data,
+				.w = e.width,
+				.h = size_t(e.height) * size_t(e.depth),
+				.src_format = _format,
+				.dst_format = dst.format,
+				.src_row_major = true,
+				.dst_row_major = true,
+			};
+			return ImageProcessor::ConvertFormat(params);
+		}
+
+		Result ImageResource::copyFromImage(FormatedImage const& src, uint32_t layer, uint32_t mip, uint32_t slice)
+		{
+			const ImageExtent e = extent(mip);
+			if (layer >= _layers || mip >= _mips || slice >= e.depth || src.width() != e.width || src.height() != e.height)
+			{
+				return Result::InvalidParameter;
+			}
+			const FormatInfo src_format = src.format();
+			ImageProcessor::ConvertParams params{
+				.src = src.rawData(),
+				.dst = rawData() + subresourceOffset(layer, mip) + size_t(slice) * e.width * e.height * _format.pixelSize(),
+				.w = e.width,
+				.h = e.height,
+				.src_format = src_format,
+				.dst_format = _format,
+				.src_row_major = src.rowMajor(),
+				.dst_row_major = true,
+			};
+			return ImageProcessor::ConvertFormat(params);
+		}
+
+		Result ImageResource::copyToImage(FormatedImage& dst, uint32_t layer, uint32_t mip, uint32_t slice) const
+		{
+			const ImageExtent e = extent(mip);
+			if (layer >= _layers || mip >= _mips || slice >= e.depth)
+			{
+				return Result::InvalidParameter;
+			}
+			if (dst.empty())
+			{
+				dst = FormatedImage(e.width, e.height, _format, true);
+			}
+			else if (dst.width() != e.width || dst.height() != e.height)
+			{
+				return Result::InvalidParameter;
+			}
+			const FormatInfo dst_format = dst.format();
+			ImageProcessor::ConvertParams params{
+				.src = rawData() + subresourceOffset(layer, mip) + size_t(slice) * e.width * e.height * _format.pixelSize(),
+				.dst = dst.rawData(),
+				.w = e.width,
+				.h = e.height,
+				.src_format = _format,
+				.dst_format = dst_format,
+				.src_row_major = true,
+				.dst_row_major = dst.rowMajor(),
+			};
+			return ImageProcessor::ConvertFormat(params);
+		}
+	}
+}
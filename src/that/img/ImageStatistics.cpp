@@ -0,0 +1,348 @@
+#include <that/img/ImageStatistics.hpp>
+
+#include <that/math/Half.hpp>
+#include <that/utils/ThreadPool.hpp>
+
+#include <limits>
+#include <mutex>
+#include <cmath>
+#include <bit>
+
+namespace that
+{
+	namespace img
+	{
+		namespace
+		{
+			struct StatisticsContext
+			{
+				uint32_t channels = 0;
+				bool min_max = false;
+				bool moments = false;
+				bool histogram = false;
+				uint32_t bins = 0;
+				// raw value -> bin: (raw * bin_scale + bin_bias)
+				double bin_scale = 1;
+				double bin_bias = 0;
+				// For 8 and 16 bits integer formats: raw bit pattern -> bin
+				std::vector<uint32_t> bin_lut = {};
+				// Per channel shift of the data to reduce the cancellation when computing the variance
+				std::vector<double> shift = {};
+			};
+
+			struct PartialStatistics
+			{
+				size_t count = 0;
+				std::vector<double> min = {};
+				std::vector<double> max = {};
+				std::vector<double> sum = {};
+				std::vector<double> sum2 = {};
+				std::vector<uint64_t> histogram = {};
+
+				void init(StatisticsContext const& ctx)
+				{
+					min.assign(ctx.channels, std::numeric_limits<double>::infinity());
+					max.assign(ctx.channels, -std::numeric_limits<double>::infinity());
+					sum.assign(ctx.channels, 0.0);
+					sum2.assign(ctx.channels, 0.0);
+					if (ctx.histogram)
+					{
+						histogram.assign(size_t(ctx.channels) * ctx.bins, 0);
+					}
+				}
+
+				void merge(PartialStatistics const& other)
+				{
+					count += other.count;
+					for (size_t c = 0; c < min.size(); ++c)
+					{
+						min[c] = std::min(min[c], other.min[c]);
+						max[c] = std::max(max[c], other.max[c]);
+						sum[c] += other.sum[c];
+						sum2[c] += other.sum2[c];
+					}
+					for (size_t i = 0; i < histogram.size(); ++i)
+					{
+						histogram[i] += other.histogram[i];
+					}
+				}
+			};
+
+			template <class T>
+			using ComputeType = typename std::conditional<std::is_same<T, math::Half>::value, float, T>::type;
+
+			template <class T>
+			using BitPattern = typename UIntTypePerSize<sizeof(T)>::type;
+
+			// Processes n pixels, channel by channel: each inner loop is a simple strided reduction the compiler can vectorize
+			// n is small enough for the pixels to stay in cache between the channels
+			template <class T>
+			void AccumulatePixels(const T* src, size_t n, StatisticsContext const& ctx, PartialStatistics& p)
+			{
+				using V = ComputeType<T>;
+				const uint32_t C = ctx.channels;
+				for (uint32_t c = 0; c < C; ++c)
+				{
+					const T* s = src + c;
+					if (ctx.min_max)
+					{
+						V mn = V(s[0]), mx = V(s[0]);
+						for (size_t i = 0; i < n; ++i)
+						{
+							const V v = V(s[i * C]);
+							mn = v < mn ? v : mn;
+							mx = v > mx ? v : mx;
+						}
+						p.min[c] = std::min<double>(p.min[c], double(mn));
+						p.max[c] = std::max<double>(p.max[c], double(mx));
+					}
+					if (ctx.moments)
+					{
+						const double shift = ctx.shift[c];
+						double sum = 0, sum2 = 0;
+						for (size_t i = 0; i < n; ++i)
+						{
+							const double d = double(V(s[i * C])) - shift;
+							sum += d;
+							sum2 += d * d;
+						}
+						p.sum[c] += sum;
+						p.sum2[c] += sum2;
+					}
+					if (ctx.histogram)
+					{
+						uint64_t* h = p.histogram.data() + size_t(c) * ctx.bins;
+						if constexpr (sizeof(T) <= 2 && std::is_integral<T>::value)
+						{
+							const uint32_t* lut = ctx.bin_lut.data();
+							for (size_t i = 0; i < n; ++i)
+							{
+								++h[lut[static_cast<BitPattern<T>>(s[i * C])]];
+							}
+						}
+						else
+						{
+							const double last = double(ctx.bins - 1);
+							for (size_t i = 0; i < n; ++i)
+							{
+								double b = double(V(s[i * C])) * ctx.bin_scale + ctx.bin_bias;
+								// NaN goes to the first bin
+								b = (b >= 0) ? std::min(b, last) : 0.0;
+								++h[size_t(b)];
+							}
+						}
+					}
+				}
+				p.count += n;
+			}
+
+			template <class T>
+			void BuildBinLUT(StatisticsContext& ctx)
+			{
+				if constexpr (sizeof(T) <= 2 && std::is_integral<T>::value)
+				{
+					using U = BitPattern<T>;
+					const size_t N = size_t(std::numeric_limits<U>::max()) + 1;
+					ctx.bin_lut.resize(N);
+					const double last = double(ctx.bins - 1);
+					for (size_t u = 0; u < N; ++u)
+					{
+						const T t = std::bit_cast<T>(static_cast<U>(u));
+						double b = double(t) * ctx.bin_scale + ctx.bin_bias;
+						b = (b >= 0) ? std::min(b, last) : 0.0;
+						ctx.bin_lut[u] = uint32_t(b);
+					}
+				}
+			}
+
+			template <class T>
+			Result ComputeStatisticsImpl(ConstImageView const& view, ComputeStatisticsInfo const& info, double norm_scale, ImageStatistics& result)
+			{
+				using V = ComputeType<T>;
+				StatisticsContext ctx;
+				ctx.channels = view.format.channels;
+				ctx.min_max = !!(info.flags & StatisticsFlags::MinMax);
+				ctx.moments = !!(info.flags & StatisticsFlags::MeanVariance);
+				ctx.histogram = !!(info.flags & StatisticsFlags::Histogram) && info.histogram_bins > 0;
+				ctx.bins = ctx.histogram ? info.histogram_bins : 0;
+				if (ctx.histogram)
+				{
+					const double range = info.histogram_max - info.histogram_min;
+					if (!(range > 0))
+					{
+						return Result::InvalidParameter;
+					}
+					ctx.bin_scale = norm_scale * double(ctx.bins) / range;
+					ctx.bin_bias = -info.histogram_min * double(ctx.bins) / range;
+					BuildBinLUT<T>(ctx);
+				}
+				ctx.shift.resize(ctx.channels);
+				{
+					const T* first = reinterpret_cast<const T*>(view.data);
+					for (uint32_t c = 0; c < ctx.channels; ++c)
+					{
+						ctx.shift[c] = double(V(first[c]));
+					}
+				}
+
+				PartialStatistics total;
+				total.init(ctx);
+				std::mutex mutex;
+
+				// Chunks of pixels that stay in L1 while looping on the channels
+				constexpr const size_t block_pixels = 1024;
+				const auto process_pixels = [&](const T* src, size_t n, PartialStatistics& p)
+				{
+					for (size_t i = 0; i < n; i += block_pixels)
+					{
+						AccumulatePixels<T>(src + i * ctx.channels, std::min(block_pixels, n - i), ctx, p);
+					}
+				};
+
+				const auto merge = [&](PartialStatistics const& p)
+				{
+					std::unique_lock lock(mutex);
+					total.merge(p);
+				};
+
+				constexpr const size_t min_pixels_per_task = 1 << 16;
+				if (view.isPacked())
+				{
+					const T* base = reinterpret_cast<const T*>(view.data);
+					ParallelForRange(view.pixelCount(), min_pixels_per_task, [&](size_t begin, size_t end)
+					{
+						PartialStatistics p;
+						p.init(ctx);
+						process_pixels(base + begin * ctx.channels, end - begin, p);
+						merge(p);
+					}, info.pool);
+				}
+				else
+				{
+					const size_t w = view.extent.width;
+					const size_t h = view.extent.height;
+					const size_t rows = h * view.extent.depth;
+					ParallelForRange(rows, std::max<size_t>(1, min_pixels_per_task / std::max<size_t>(w, 1)), [&](size_t begin, size_t end)
+					{
+						PartialStatistics p;
+						p.init(ctx);
+						for (size_t r = begin; r < end; ++r)
+						{
+							const T* row = reinterpret_cast<const T*>(view.row(r % h, r / h));
+							process_pixels(row, w, p);
+						}
+						merge(p);
+					}, info.pool);
+				}
+
+				result.pixel_count = total.count;
+				result.channels.resize(ctx.channels);
+				const double n = double(std::max<size_t>(total.count, 1));
+				for (uint32_t c = 0; c < ctx.channels; ++c)
+				{
+					ChannelStatistics& s = result.channels[c];
+					s = ChannelStatistics{};
+					if (ctx.min_max)
+					{
+						s.min = total.min[c] * norm_scale;
+						s.max = total.max[c] * norm_scale;
+					}
+					if (ctx.moments)
+					{
+						const double mean_shifted = total.sum[c] / n;
+						s.mean = (mean_shifted + ctx.shift[c]) * norm_scale;
+						s.variance = std::max(0.0, total.sum2[c] / n - mean_shifted * mean_shifted) * (norm_scale * norm_scale);
+					}
+				}
+				result.histogram_bins = ctx.bins;
+				result.histogram = std::move(total.histogram);
+				return Result::Success;
+			}
+
+			template <ElementType type>
+			Result DispatchElementSize(ConstImageView const& view, ComputeStatisticsInfo const& info, ImageStatistics& result)
+			{
+				const auto norm_scale = [](auto t) -> double
+				{
+					using T = decltype(t);
+					if constexpr (type == ElementType::UNORM || type == ElementType::SNORM || type == ElementType::sRGB)
+					{
+						return 1.0 / double(std::numeric_limits<T>::max());
+					}
+					return 1.0;
+				};
+				Result res = Result::CannotConvertFormat;
+				switch (view.format.elem_size)
+				{
+				case 1:
+					if constexpr (type != ElementType::FLOAT)
+					{
+						using T = typename UnderlyingPixelType<type, 1>::type;
+						res = ComputeStatisticsImpl<T>(view, info, norm_scale(T{}), result);
+					}
+				break;
+				case 2:
+				{
+					using T = typename UnderlyingPixelType<type, 2>::type;
+					res = ComputeStatisticsImpl<T>(view, info, norm_scale(T{}), result);
+				}
+				break;
+				case 4:
+				{
+					using T = typename UnderlyingPixelType<type, 4>::type;
+					res = ComputeStatisticsImpl<T>(view, info, norm_scale(T{}), result);
+				}
+				break;
+				case 8:
+				{
+					using T = typename UnderlyingPixelType<type, 8>::type;
+					res = ComputeStatisticsImpl<T>(view, info, norm_scale(T{}), result);
+				}
+				break;
+				}
+				if constexpr (type == ElementType::SNORM)
+				{
+					// As defined by the glsl spec, the most negative value is clamped to -1
+					for (ChannelStatistics& s : result.channels)
+					{
+						s.min = std::max(s.min, -1.0);
+					}
+				}
+				return res;
+			}
+		}
+
+		Result ComputeStatistics(ConstImageView const& view, ComputeStatisticsInfo const& info, ImageStatistics& result)
+		{
+			if (view.empty() || view.format.channels == 0)
+			{
+				return Result::InvalidParameter;
+			}
+			Result res = Result::CannotConvertFormat;
+			switch (view.format.type)
+			{
+			case ElementType::UNORM:
+				res = DispatchElementSize<ElementType::UNORM>(view, info, result);
+			break;
+			case ElementType::SNORM:
+				res = DispatchElementSize<ElementType::SNORM>(view, info, result);
+			break;
+			case ElementType::UINT:
+				res = DispatchElementSize<ElementType::UINT>(view, info, result);
+			break;
+			case ElementType::SINT:
+				res = DispatchElementSize<ElementType::SINT>(view, info, result);
+			break;
+			case ElementType::sRGB:
+				res = DispatchElementSize<ElementType::sRGB>(view, info, result);
+			break;
+			case ElementType::FLOAT:
+				res = DispatchElementSize<ElementType::FLOAT>(view, info, result);
+			break;
+			default:
+			break;
+			}
+			return res;
+		}
+	}
+}
@@ -0,0 +1,151 @@
+#include <that/img/ImageStorage.hpp>
+
+#include <new>
+#include <cstring>
+#include <utility>
+#include <cassert>
+#include <algorithm>
+
+#include <that/stl_ext/alignment.hpp>
+
+namespace that
+{
+	namespace img
+	{
+		ImageStorage::ImageStorage(size_t size, size_t alignment, bool zero_init)
+		{
+			allocate(size, alignment, zero_init);
+		}
+
+		ImageStorage::ImageStorage(byte* data, size_t size, Deleter&& deleter) :
+			_data(data),
+			_size(size),
+			_capacity(size),
+			_alignment(1),
+			_deleter(deleter ? std::move(deleter) : Deleter([](byte*, size_t) {}))
+		{}
+
+		ImageStorage::ImageStorage(ImageStorage const& other)
+		{
+			allocate(other._size, other.isExternal() ? DefaultAlignment() : other._alignment, false);
+			if (_size)
+			{
+				std::memcpy(_data, other._data, _size);
+			}
+		}
+
+		ImageStorage::ImageStorage(ImageStorage&& other) noexcept :
+			_data(other._data),
+			_size(other._size),
+			_capacity(other._capacity),
+			_alignment(other._alignment),
+			_deleter(std::move(other._deleter))
+		{
+			other._data = nullptr;
+			other._size = 0;
+			other._capacity = 0;
+			other._deleter = {};
+		}
+
+		ImageStorage::~ImageStorage()
+		{
+			release();
+		}
+
+		ImageStorage& ImageStorage::operator=(ImageStorage const& other)
+		{
+			if (this != &other)
+			{
+				// Copies of external memory are owned
+				const size_t alignment = other.isExternal() ? DefaultAlignment() : other._alignment;
+				if (_size != other._size || _alignment != alignment || isExternal())
+				{
+					allocate(other._size, alignment, false);
+				}
+				if (_size)
+				{
+					std::memcpy(_data, other._data, _size);
+				}
+			}
+			return *this;
+		}
+
+		ImageStorage& ImageStorage::operator=(ImageStorage&& other) noexcept
+		{
+			swap(other);
+			return *this;
+		}
+
+		void ImageStorage::release()
+		{
+			if (_deleter)
+			{
+				_deleter(_data, _capacity);
+				_deleter = {};
+			}
+			else if (_data)
+			{
+				::operator delete[](_data, std::align_val_t(_alignment));
+			}
+			_data = nullptr;
+			_size = 0;
+			_capacity = 0;
+		}
+
+		void ImageStorage::allocate(size_t size, size_t alignment, bool zero_init)
+		{
+			assert(std::isPowerOf2(alignment));
+			release();
+			_alignment = std::max<size_t>(alignment, 1);
+			if (size)
+			{
+				_data = static_cast<byte*>(::operator new[](size, std::align_val_t(_alignment)));
+				_size = size;
+				_capacity = size;
+				if (zero_init)
+				{
+					std::memset(_data, 0, _size);
+				}
+			}
+		}
+
+		void ImageStorage::resize(size_t size, bool zero_init)
+		{
+			if (size <= _capacity)
+			{
+				if (zero_init && size > _size)
+				{
+					std::memset(_data + _size, 0, size - _size);
+				}
+				_size = size;
+			}
+			else
+			{
+				ImageStorage tmp(size, isExternal() ? DefaultAlignment() : _alignment, false);
+				if (_size)
+				{
+					std::memcpy(tmp._data, _data, _size);
+				}
+				if (zero_init)
+				{
+					std::memset(tmp._data + _size, 0, size - _size);
+				}
+				swap(tmp);
+			}
+		}
+
+		void ImageStorage::clear()
+		{
+			release();
+		}
+
+		void ImageStorage::swap(ImageStorage& other) noexcept
+		{
+			std::swap(_data, other._data);
+			std::swap(_size, other._size);
+			std::swap(_capacity, other._capacity);
+			std::swap(_alignment, other._alignment);
+			std::swap(_deleter, other._deleter);
+		}
+	}
+}
@@ -0,0 +1,891 @@
+#include <that/img/NetPBM.hpp>
+
+#include <that/utils/ThreadPool.hpp>
+
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <string_view>
+
+namespace that
+{
+	namespace img
+	{
+		namespace io
+		{
+			namespace netpbm
+			{
+				using byte = uint8_t;
+
+				__forceinline bool is_white(byte c)
+				{
+					return c == '\n' || c == '\r' || c == '\t' || c == ' ';
+				}
+
+				__forceinline void eat_white(const byte*& ptr, const byte* end)
+				{
+					for (; ptr != end; ++ptr)
+					{
+						if (!is_white(*ptr))
+							break;
+					}
+				}
+
+				__forceinline void eat_line(const byte*& ptr, const byte* end)
+				{
+					for (; ptr != end; ++ptr)
+					{
+						if (*ptr == '\n')
+							break;
+					}
+					if (ptr != end)
+						ptr++;
+				}
+
+				__forceinline void eat_token(const byte*& ptr, const byte* end)
+				{
+					for (; ptr != end; ++ptr)
+					{
+						if (is_white(*ptr))
+							break;
+					}
+				}
+
+				// Bounded (the buffer may not be null terminated, for example a file mapping)
+				// Returns -1 if there is no number
+				__forceinline int eat_int(const byte*& ptr, const byte* end)
+				{
+					eat_white(ptr, end);
+					int v = -1;
+					for (; ptr != end && *ptr >= '0' && *ptr <= '9'; ++ptr)
+					{
+						// Saturates (rejected later as an invalid size or max value)
+						v = std::min((v < 0 ? 0 : v * 10) + (*ptr - '0'), 1 << 28);
+					}
+					eat_token(ptr, end);
+					return v;
+				}
+
+				__forceinline void eat_comment(const byte*& ptr, const byte* end)
+				{
+					while (ptr != end)
+					{
+						eat_white(ptr, end);
+						if (ptr == end || *ptr != '#')
+							break;
+						eat_line(ptr, end);
+					}
+				}
+
+				// PAM header: "KEYWORD value" lines up to ENDHDR
+				Result ParsePAMHeader(const byte*& ptr, const byte* end, Header& header)
+				{
+					header.max_value = 0;
+					header.depth = 0;
+					header.tuple_type.clear();
+					// WIDTH, HEIGHT, DEPTH and MAXVAL are required
+					enum Seen : uint32_t
+					{
+						Width = 1,
+						Height = 2,
+						Depth = 4,
+						MaxValue = 8,
+						All = 15,
+					};
+					uint32_t seen = 0;
+					while (true)
+					{
+						eat_comment(ptr, end);
+						const byte* token = ptr;
+						eat_token(ptr, end);
+						const std::string_view keyword(reinterpret_cast<const char*>(token), ptr - token);
+						if (keyword.empty())
+						{
+							return Result::WrongFileFormat;
+						}
+						else if (keyword == "ENDHDR")
+						{
+							break;
+						}
+						else if (keyword == "WIDTH")
+						{
+							header.width = eat_int(ptr, end);
+							seen |= Seen::Width;
+						}
+						else if (keyword == "HEIGHT")
+						{
+							header.height = eat_int(ptr, end);
+							seen |= Seen::Height;
+						}
+						else if (keyword == "DEPTH")
+						{
+							header.depth = eat_int(ptr, end);
+							seen |= Seen::Depth;
+						}
+						else if (keyword == "MAXVAL")
+						{
+							header.max_value = eat_int(ptr, end);
+							seen |= Seen::MaxValue;
+						}
+						else if (keyword == "TUPLTYPE")
+						{
+							// The rest of the line, multiple TUPLTYPE lines are concatenated
+							while (ptr != end && (*ptr == ' ' || *ptr == '\t'))
+								++ptr;
+							const byte* value = ptr;
+							while (ptr != end && *ptr != '\n' && *ptr != '\r')
+								++ptr;
+							if (!header.tuple_type.empty())
+								header.tuple_type += ' ';
+							header.tuple_type.append(reinterpret_cast<const char*>(value), ptr - value);
+						}
+						else
+						{
+							return Result::WrongFileFormat;
+						}
+					}
+					if (seen != Seen::All || header.width <= 0 || header.height <= 0 || header.depth <= 0)
+					{
+						return Result::WrongFileFormat;
+					}
+					return Result::Success;
+				}
+
+				Result ParseHeader(const byte*& ptr, const byte* end, Header& header, int& mode)
+				{
+					eat_comment(ptr, end);
+					mode = 0;
+					if (ptr + 2 < end && ptr[0] == 'P')
+					{
+						mode = ptr[1] - '0';
+						header.magic_number = std::string(reinterpret_cast<const char*>(ptr), 2);
+						ptr += 2;
+					}
+					if (mode < 1 || mode > 7)
+					{
+						return Result::WrongFileFormat;
+					}
+
+					if (mode == 7)
+					{
+						Result result = ParsePAMHeader(ptr, end, header);
+						if (result != Result::Success)
+						{
+							return result;
+						}
+					}
+					else
+					{
+						eat_comment(ptr, end);
+						header.width = eat_int(ptr, end);
+
+						eat_comment(ptr, end);
+						header.height = eat_int(ptr, end);
+
+						if (mode == 1 || mode == 4)
+						{
+							header.max_value = 1;
+						}
+						else
+						{
+							eat_comment(ptr, end);
+							header.max_value = eat_int(ptr, end);
+						}
+						header.depth = (mode == 3 || mode == 6) ? 3 : 1;
+					}
+
+					if (header.width < 0 || header.height < 0 || !header.valid())
+					{
+						return Result::WrongFileFormat;
+					}
+
+					// Exactly one whitespace before the binary pixels (which can start with a "whitespace" value)
+					if (ptr != end)
+					{
+						++ptr;
+					}
+					return Result::Success;
+				}
+
+				FormatInfo GetFormat(Header const& header, int mode)
+				{
+					FormatInfo format;
+					// 8 bits samples are (most likely) gamma encoded, see the NetPBM spec
+					// Wider samples are read as linear UNORM16
+					if (header.max_value > 255)
+					{
+						format.type = ElementType::UNORM;
+						format.elem_size = 2;
+					}
+					else
+					{
+						format.type = ElementType::sRGB;
+						format.elem_size = 1;
+					}
+					format.channels = uint8_t(header.depth);
+					return format;
+				}
+
+				size_t FileRowSize(int mode, size_t width, FormatInfo const& format)
+				{
+					if (mode == 4)
+					{
+						return (width + 7) / 8;
+					}
+					return width * format.pixelSize();
+				}
+
+				void BinaryRowDecoder::init(Header const& header, int mode)
+				{
+					_mode = mode;
+					_width = header.width;
+					_format = GetFormat(header, mode);
+					_file_row_size = FileRowSize(mode, _width, _format);
+					_max_value = uint32_t(header.max_value);
+					_lut8.clear();
+					_lut16.clear();
+					if (_mode != 4)
+					{
+						if (_format.elem_size == 1 && _max_value != 255)
+						{
+							_lut8.resize(256);
+							for (uint32_t v = 0; v < 256; ++v)
+							{
+								_lut8[v] = uint8_t((std::min(v, _max_value) * 255 + _max_value / 2) / _max_value);
+							}
+						}
+						else if (_format.elem_size == 2 && _max_value != 65535)
+						{
+							_lut16.resize(65536);
+							for (uint32_t v = 0; v < 65536; ++v)
+							{
+								_lut16[v] = uint16_t((uint64_t(std::min(v, _max_value)) * 65535 + _max_value / 2) / _max_value);
+							}
+						}
+					}
+				}
+
+				bool BinaryRowDecoder::isIdentity() const
+				{
+					if (_mode == 4)
+					{
+						return false;
+					}
+					if (_format.elem_size == 1)
+					{
+						return _lut8.empty();
+					}
+					return std::endian::native == std::endian::big && _lut16.empty();
+				}
+
+				void BinaryRowDecoder::decode(const byte* src, byte* dst, size_t rows) const
+				{
+					const size_t row_size = rowByteSize();
+					const size_t samples = _width * _format.channels;
+					for (size_t r = 0; r < rows; ++r)
+					{
+						const byte* s = src + r * _file_row_size;
+						byte* d = dst + r * row_size;
+						if (_mode == 4)
+						{
+							UnpackBitmapRow(s, d, _width);
+						}
+						else if (_format.elem_size == 1)
+						{
+							if (_lut8.empty())
+							{
+								if (s != d)
+								{
+									std::memcpy(d, s, row_size);
+								}
+							}
+							else
+							{
+								const uint8_t* lut = _lut8.data();
+								for (size_t i = 0; i < samples; ++i)
+								{
+									d[i] = lut[s[i]];
+								}
+							}
+						}
+						else
+						{
+							// Big endian samples
+							uint16_t* d16 = reinterpret_cast<uint16_t*>(d);
+							if (_lut16.empty())
+							{
+								for (size_t i = 0; i < samples; ++i)
+								{
+									d16[i] = uint16_t((uint16_t(s[2 * i]) << 8) | s[2 * i + 1]);
+								}
+							}
+							else
+							{
+								const uint16_t* lut = _lut16.data();
+								for (size_t i = 0; i < samples; ++i)
+								{
+									d16[i] = lut[uint16_t((uint16_t(s[2 * i]) << 8) | s[2 * i + 1])];
+								}
+							}
+						}
+					}
+				}
+
+				namespace
+				{
+					enum CharClass : uint8_t
+					{
+						White,
+						Digit,
+						Comment,
+						Other,
+					};
+
+					constexpr const std::array<uint8_t, 256> char_classes = []()
+					{
+						std::array<uint8_t, 256> res = {};
+						res.fill(Other);
+						for (char c : {' ', '\t', '\n', '\r', '\v', '\f'})
+						{
+							res[uint8_t(c)] = White;
+						}
+						for (char c = '0'; c <= '9'; ++c)
+						{
+							res[uint8_t(c)] = Digit;
+						}
+						res[uint8_t('#')] = Comment;
+						return res;
+					}();
+
+					__forceinline void skip_comment(const byte*& ptr, const byte* end)
+					{
+						const void* nl = std::memchr(ptr, '\n', end - ptr);
+						ptr = nl ? static_cast<const byte*>(nl) : end;
+					}
+
+					// P1 digits don't need to be separated
+					size_t CountValues(const byte* ptr, const byte* end, bool bitmap)
+					{
+						size_t count = 0;
+						bool in_number = false;
+						while (ptr != end)
+						{
+							const uint8_t c = char_classes[*ptr];
+							if (c == Digit)
+							{
+								count += (bitmap || !in_number) ? 1 : 0;
+								in_number = true;
+							}
+							else
+							{
+								in_number = false;
+								if (c == Comment)
+								{
+									skip_comment(ptr, end);
+									continue;
+								}
+							}
+							++ptr;
+						}
+						return count;
+					}
+
+					// Writes the values of [ptr, end) from dst[index], up to dst[value_count - 1]
+					// index is left after the last written value
+					template <class T>
+					Result ParseValues(const byte* ptr, const byte* end, bool bitmap, const T* lut, uint32_t max_value, T* dst, size_t& index, size_t value_count)
+					{
+						while (ptr != end && index < value_count)
+						{
+							const uint8_t c = char_classes[*ptr];
+							if (c == Digit)
+							{
+								if (bitmap)
+								{
+									if (*ptr > '1')
+									{
+										return Result::WrongFileFormat;
+									}
+									// 1 is black
+									dst[index] = (*ptr == '1') ? T(0) : T(255);
+									++ptr;
+								}
+								else
+								{
+									uint32_t v = 0;
+									do
+									{
+										v = std::min<uint32_t>(v * 10 + (*ptr - '0'), max_value);
+										++ptr;
+									} while (ptr != end && char_classes[*ptr] == Digit);
+									dst[index] = lut[v];
+								}
+								++index;
+							}
+							else if (c == White)
+							{
+								++ptr;
+							}
+							else if (c == Comment)
+							{
+								skip_comment(ptr, end);
+							}
+							else
+							{
+								return Result::WrongFileFormat;
+							}
+						}
+						return Result::Success;
+					}
+				}
+
+				Result ParseASCII(const byte* begin, const byte* end, int mode, int max_value, size_t value_count, byte* dst, ThreadPool* pool)
+				{
+					if (mode < 1 || mode > 3 || max_value <= 0 || max_value > 65535)
+					{
+						return Result::InvalidParameter;
+					}
+					const bool bitmap = mode == 1;
+					const bool wide = max_value > 255;
+
+					// Values are rescaled to [0, 255] or [0, 65535]
+					std::vector<byte> lut8;
+					std::vector<uint16_t> lut16;
+					if (wide)
+					{
+						lut16.resize(size_t(max_value) + 1);
+						for (uint32_t v = 0; v <= uint32_t(max_value); ++v)
+						{
+							lut16[v] = uint16_t((v * 65535ull + max_value / 2) / max_value);
+						}
+					}
+					else
+					{
+						lut8.resize(size_t(max_value) + 1);
+						for (int v = 0; v <= max_value; ++v)
+						{
+							lut8[v] = byte((v * 255 + max_value / 2) / max_value);
+						}
+					}
+
+					ThreadPool& p = pool ? *pool : ThreadPool::Default();
+					const size_t size = end - begin;
+					constexpr const size_t min_chunk_size = 1 << 20;
+					const size_t chunk_count = std::max<size_t>(1, std::min<size_t>(size / min_chunk_size, (p.threadCount() + 1) * 4));
+
+					// Chunks start after a new line (a number or a comment never spans two chunks)
+					std::vector<const byte*> bounds(chunk_count + 1);
+					bounds[0] = begin;
+					bounds[chunk_count] = end;
+					for (size_t k = 1; k < chunk_count; ++k)
+					{
+						const byte* ptr = std::max(begin + k * (size / chunk_count), bounds[k - 1]);
+						const void* nl = std::memchr(ptr, '\n', end - ptr);
+						bounds[k] = nl ? static_cast<const byte*>(nl) + 1 : end;
+					}
+
+					std::vector<size_t> first_index(chunk_count + 1, 0);
+					if (chunk_count > 1)
+					{
+						p.parallelFor(chunk_count, [&](size_t k)
+						{
+							first_index[k + 1] = CountValues(bounds[k], bounds[k + 1], bitmap);
+						});
+						for (size_t k = 0; k < chunk_count; ++k)
+						{
+							first_index[k + 1] += first_index[k];
+						}
+					}
+					else
+					{
+						first_index[1] = value_count;
+					}
+
+					std::atomic<Result> result = Result::Success;
+					std::atomic<size_t> parsed = 0;
+					const auto parse = [&](size_t k)
+					{
+						size_t index = first_index[k];
+						if (index >= value_count)
+						{
+							return;
+						}
+						Result r = wide ?
+							ParseValues(bounds[k], bounds[k + 1], bitmap, lut16.data(), uint32_t(max_value), reinterpret_cast<uint16_t*>(dst), index, value_count) :
+							ParseValues(bounds[k], bounds[k + 1], bitmap, lut8.data(), uint32_t(max_value), dst, index, value_count);
+						if (r != Result::Success)
+						{
+							result = r;
+						}
+						parsed += index - first_index[k];
+					};
+					if (chunk_count > 1)
+					{
+						p.parallelFor(chunk_count, parse);
+					}
+					else
+					{
+						parse(0);
+					}
+					if (result == Result::Success && parsed < value_count)
+					{
+						// Not enough values
+						result = Result::WrongFileFormat;
+					}
+					return result;
+				}
+
+				void UnpackBitmapRow(const byte* src, byte* dst, size_t width)
+				{
+					for (size_t x = 0; x < width; ++x)
+					{
+						dst[x] = ((src[x >> 3] >> (7 - (x & 7))) & 1) ? 0 : 255;
+					}
+				}
+
+				void PackBitmapRow(const byte* src, byte* dst, size_t width)
+				{
+					std::memset(dst, 0, (width + 7) / 8);
+					for (size_t x = 0; x < width; ++x)
+					{
+						// Dark pixels are black (1)
+						dst[x >> 3] |= byte(src[x] < 128) << (7 - (x & 7));
+					}
+				}
+
+				Result StreamReader::open(CreateInfo const& ci)
+				{
+					close();
+					if (!ci.path)
+					{
+						return Result::InvalidParameter;
+					}
+					ResultAnd<FileSystem::Path> path = FileSystem::ResolveFilePath(*ci.path, ci.hint, ci.filesystem);
+					if (path.result != Result::Success)
+					{
+						return path.result;
+					}
+					Result result = _file.open(path.value);
+					if (result == Result::Success)
+					{
+						result = open(_file);
+					}
+					return result;
+				}
+
+				Result StreamReader::open(InputStream& stream)
+				{
+					_stream = &stream;
+					_row = 0;
+					_pending.clear();
+					_pending_offset = 0;
+
+					// Reads chunks until the header is complete
+					constexpr const size_t chunk = 4096;
+					constexpr const size_t max_header_size = 1 << 20;
+					Result result = Result::WrongFileFormat;
+					while (true)
+					{
+						const size_t old_size = _pending.size();
+						_pending.resize(old_size + chunk);
+						size_t read_count = 0;
+						Result read_result = _stream->read(std::span<byte>(_pending.data() + old_size, chunk), read_count);
+						_pending.resize(old_size + read_count);
+						if (read_result != Result::Success)
+						{
+							result = read_result;
+							break;
+						}
+						const bool eof = read_count < chunk;
+
+						const byte* begin = _pending.data();
+						const byte* end = begin + _pending.size();
+						const byte* ptr = begin;
+						result = ParseHeader(ptr, end, _header, _mode);
+						// Complete if the whitespace after the last number was reached
+						const bool complete = result == Result::Success && ptr != begin && is_white(ptr[-1]);
+						if (complete)
+						{
+							_pending_offset = ptr - begin;
+							break;
+						}
+						if (eof || _pending.size() > max_header_size)
+						{
+							result = Result::WrongFileFormat;
+							break;
+						}
+					}
+
+					if (result == Result::Success)
+					{
+						if (_mode <= 3)
+						{
+							// ASCII
+							result = Result::NotImplemented;
+						}
+						else if (_header.max_value > 65535)
+						{
+							result = Result::WrongFileFormat;
+						}
+						else
+						{
+							_decoder.init(_header, _mode);
+							_format = _decoder.format();
+						}
+					}
+					if (result != Result::Success)
+					{
+						close();
+					}
+					return result;
+				}
+
+				void StreamReader::close()
+				{
+					_file.close();
+					_stream = nullptr;
+					_pending.clear();
+					_pending.shrink_to_fit();
+					_pending_offset = 0;
+					_row = 0;
+					_header = {};
+				}
+
+				Result StreamReader::readBytes(byte* dst, size_t size)
+				{
+					const size_t from_pending = std::min(size, _pending.size() - _pending_offset);
+					if (from_pending)
+					{
+						std::memcpy(dst, _pending.data() + _pending_offset, from_pending);
+						_pending_offset += from_pending;
+						if (_pending_offset == _pending.size())
+						{
+							_pending.clear();
+							_pending.shrink_to_fit();
+							_pending_offset = 0;
+						}
+					}
+					if (from_pending < size)
+					{
+						size_t read_count = 0;
+						Result result = _stream->read(std::span<byte>(dst + from_pending, size - from_pending), read_count);
+						if (result != Result::Success)
+						{
+							return result;
+						}
+						if (read_count != size - from_pending)
+						{
+							// Truncated file
+							return Result::FileReadError;
+						}
+					}
+					return Result::Success;
+				}
+
+				Result StreamReader::readRows(std::span<byte> dst, size_t rows)
+				{
+					if (!_stream)
+					{
+						return Result::InvalidValue;
+					}
+					rows = std::min(rows, rowsLeft());
+					if (dst.size() < rows * rowByteSize())
+					{
+						return Result::InvalidParameter;
+					}
+					Result result = Result::Success;
+					if (_mode == 4)
+					{
+						_file_row.resize(_decoder.fileRowSize());
+						for (size_t r = 0; r < rows && result == Result::Success; ++r)
+						{
+							result = readBytes(_file_row.data(), _file_row.size());
+							if (result == Result::Success)
+							{
+								_decoder.decode(_file_row.data(), dst.data() + r * rowByteSize(), 1);
+							}
+						}
+					}
+					else
+					{
+						// The file rows have the same size as the decoded ones: decoded in place
+						result = readBytes(dst.data(), rows * rowByteSize());
+						if (result == Result::Success && !_decoder.isIdentity())
+						{
+							_decoder.decode(dst.data(), dst.data(), rows);
+						}
+					}
+					if (result == Result::Success)
+					{
+						_row += rows;
+					}
+					return result;
+				}
+
+				Result StreamWriter::open(CreateInfo const& ci)
+				{
+					if (!ci.path)
+					{
+						return Result::InvalidParameter;
+					}
+					ResultAnd<FileSystem::Path> path = FileSystem::ResolveFilePath(*ci.path, ci.hint, ci.filesystem);
+					if (path.result != Result::Success)
+					{
+						return path.result;
+					}
+					Result result = _file.open(path.value, !(ci.hint & FileSystem::Hint::DontCreateDirectory));
+					if (result == Result::Success)
+					{
+						result = open(_file, ci);
+					}
+					return result;
+				}
+
+				Result StreamWriter::open(OutputStream& stream, CreateInfo const& ci)
+				{
+					const uint32_t c = ci.format.channels;
+					int mode = ci.magic_number;
+					if (mode < 0)
+					{
+						mode = (c == 1) ? 5 : ((c == 3) ? 6 : 7);
+					}
+					if ((ci.format.elem_size != 1 && ci.format.elem_size != 2) || ci.format.type == ElementType::FLOAT || c == 0)
+					{
+						return Result::InvalidValue;
+					}
+					bool valid_mode = false;
+					switch (mode)
+					{
+					case 4:
+						valid_mode = c == 1 && ci.format.elem_size == 1;
+					break;
+					case 5:
+						valid_mode = c == 1;
+					break;
+					case 6:
+						valid_mode = c == 3;
+					break;
+					case 7:
+						valid_mode = true;
+					break;
+					}
+					if (!valid_mode)
+					{
+						return Result::InvalidValue;
+					}
+
+					_stream = &stream;
+					_width = ci.width;
+					_height = ci.height;
+					_row = 0;
+					_mode = mode;
+					_format = ci.format;
+					_file_row.clear();
+					if (_mode == 4 || (_format.elem_size == 2 && std::endian::native == std::endian::little))
+					{
+						_file_row.resize(FileRowSize(_mode, _width, _format));
+					}
+
+					const std::string max_value = (_format.elem_size == 2) ? "65535" : "255";
+					std::string header = "P" + std::to_string(_mode) + "\n";
+					if (_mode == 7)
+					{
+						std::string tuple_type = ci.tuple_type;
+						if (tuple_type.empty())
+						{
+							constexpr const char* default_types[] = {"GRAYSCALE", "GRAYSCALE_ALPHA", "RGB", "RGB_ALPHA"};
+							tuple_type = (c <= 4) ? default_types[c - 1] : "";
+						}
+						header += "WIDTH " + std::to_string(_width) + "\nHEIGHT " + std::to_string(_height) + "\nDEPTH " + std::to_string(c) + "\nMAXVAL " + max_value + "\n";
+						if (!tuple_type.empty())
+						{
+							header += "TUPLTYPE " + tuple_type + "\n";
+						}
+						header += "ENDHDR\n";
+					}
+					else
+					{
+						header += std::to_string(_width) + " " + std::to_string(_height) + "\n";
+						if (_mode != 4)
+						{
+							header += max_value + "\n";
+						}
+					}
+					return _stream->write(std::span<const byte>(reinterpret_cast<const byte*>(header.data()), header.size()));
+				}
+
+				Result StreamWriter::writeRows(std::span<const byte> src, size_t rows)
+				{
+					if (!_stream)
+					{
+						return Result::InvalidValue;
+					}
+					const size_t row_size = _width * _format.pixelSize();
+					if (rows > rowsLeft() || src.size() < rows * row_size)
+					{
+						return Result::InvalidParameter;
+					}
+					Result result = Result::Success;
+					if (_mode == 4)
+					{
+						for (size_t r = 0; r < rows && result == Result::Success; ++r)
+						{
+							PackBitmapRow(src.data() + r * row_size, _file_row.data(), _width);
+							result = _stream->write(_file_row);
+						}
+					}
+					else if (!_file_row.empty())
+					{
+						// 16 bits samples are big endian in the file
+						const size_t samples = _width * _format.channels;
+						for (size_t r = 0; r < rows && result == Result::Success; ++r)
+						{
+							const uint16_t* s = reinterpret_cast<const uint16_t*>(src.data() + r * row_size);
+							byte* d = _file_row.data();
+							for (size_t i = 0; i < samples; ++i)
+							{
+								d[2 * i] = byte(s[i] >> 8);
+								d[2 * i + 1] = byte(s[i]);
+							}
+							result = _stream->write(_file_row);
+						}
+					}
+					else
+					{
+						result = _stream->write(src.subspan(0, rows * row_size));
+					}
+					if (result == Result::Success)
+					{
+						_row += rows;
+					}
+					return result;
+				}
+
+				Result StreamWriter::close()
+				{
+					Result result = Result::Success;
+					if (_stream)
+					{
+						result = _stream->flush();
+						if (result == Result::Success && _row != _height)
+						{
+							result = Result::InvalidValue;
+						}
+					}
+					if (result == Result::Success)
+					{
+						result = _file.commit();
+					}
+					else
+					{
+						_file.discard();
+					}
+					_stream = nullptr;
+					return result;
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,192 @@
+#include <that/img/PFM.hpp>
+
+#include <that/utils/ThreadPool.hpp>
+
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <bit>
+#include <string>
+#include <vector>
+
+namespace that
+{
+	namespace img
+	{
+		namespace io
+		{
+			namespace pfm
+			{
+				using byte = uint8_t;
+
+				namespace
+				{
+					bool is_white(byte c)
+					{
+						return c == '\n' || c == '\r' || c == '\t' || c == ' ';
+					}
+
+					void eat_white(const byte*& ptr, const byte* end)
+					{
+						while (ptr != end && is_white(*ptr))
+							++ptr;
+					}
+
+					// The token in [ptr, end), as a null terminated string
+					std::string eat_token(const byte*& ptr, const byte* end)
+					{
+						eat_white(ptr, end);
+						const byte* begin = ptr;
+						while (ptr != end && !is_white(*ptr) && (ptr - begin) < 32)
+							++ptr;
+						return std::string(reinterpret_cast<const char*>(begin), ptr - begin);
+					}
+
+					void ByteSwap(byte* row, size_t samples)
+					{
+						uint32_t* p = reinterpret_cast<uint32_t*>(row);
+						for (size_t i = 0; i < samples; ++i)
+						{
+							const uint32_t v = p[i];
+							p[i] = (v >> 24) | ((v >> 8) & 0xFF00) | ((v << 8) & 0xFF0000) | (v << 24);
+						}
+					}
+				}
+
+				Result ParseHeader(const byte*& ptr, const byte* end, Header& header)
+				{
+					const std::string magic = eat_token(ptr, end);
+					if (magic == "PF")
+					{
+						header.channels = 3;
+					}
+					else if (magic == "Pf")
+					{
+						header.channels = 1;
+					}
+					else
+					{
+						return Result::WrongFileFormat;
+					}
+					const std::string w = eat_token(ptr, end);
+					const std::string h = eat_token(ptr, end);
+					const std::string scale = eat_token(ptr, end);
+					char* num_end = nullptr;
+					header.width = int(std::strtol(w.c_str(), &num_end, 10));
+					const bool w_ok = !w.empty() && *num_end == '\0';
+					header.height = int(std::strtol(h.c_str(), &num_end, 10));
+					const bool h_ok = !h.empty() && *num_end == '\0';
+					header.scale = std::strtof(scale.c_str(), &num_end);
+					const bool scale_ok = !scale.empty() && *num_end == '\0' && header.scale != 0;
+					if (!w_ok || !h_ok || !scale_ok || header.width <= 0 || header.height <= 0 || ptr == end)
+					{
+						return Result::WrongFileFormat;
+					}
+					// A single whitespace before the samples
+					++ptr;
+					return Result::Success;
+				}
+
+				FormatInfo GetFormat(Header const& header)
+				{
+					FormatInfo format;
+					format.type = ElementType::FLOAT;
+					format.elem_size = sizeof(float);
+					format.channels = uint8_t(header.channels);
+					return format;
+				}
+
+				void CopyRows(const byte* src, byte* dst, Header const& header, ThreadPool* pool)
+				{
+					const size_t h = header.height;
+					const size_t samples = size_t(header.width) * header.channels;
+					const size_t row_size = samples * sizeof(float);
+					const bool swap = header.littleEndian() != (std::endian::native == std::endian::little);
+					constexpr const size_t min_bytes_per_task = 1 << 18;
+					const size_t grain = std::max<size_t>(1, min_bytes_per_task / std::max<size_t>(row_size, 1));
+					if (src == dst)
+					{
+						// Swaps the pairs of rows (y, h - 1 - y)
+						ParallelForRange((h + 1) / 2, grain, [&](size_t begin, size_t end)
+						{
+							std::vector<byte> tmp(row_size);
+							for (size_t y = begin; y < end; ++y)
+							{
+								byte* top = dst + y * row_size;
+								byte* bottom = dst + (h - 1 - y) * row_size;
+								if (top != bottom)
+								{
+									std::memcpy(tmp.data(), top, row_size);
+									std::memcpy(top, bottom, row_size);
+									std::memcpy(bottom, tmp.data(), row_size);
+									if (swap)
+									{
+										ByteSwap(bottom, samples);
+									}
+								}
+								if (swap)
+								{
+									ByteSwap(top, samples);
+								}
+							}
+						}, pool);
+					}
+					else
+					{
+						ParallelForRange(h, grain, [&](size_t begin, size_t end)
+						{
+							for (size_t y = begin; y < end; ++y)
+							{
+								byte* d = dst + y * row_size;
+								std::memcpy(d, src + (h - 1 - y) * row_size, row_size);
+								if (swap)
+								{
+									ByteSwap(d, samples);
+								}
+							}
+						}, pool);
+					}
+				}
+
+				Result Write(OutputStream& stream, const float* pixels, size_t width, size_t height, uint32_t channels)
+				{
+					const RowSource rows{
+						.pixels = reinterpret_cast<const byte*>(pixels),
+						.row_bytes = width * channels * sizeof(float),
+					};
+					return Write(stream, rows, width, height, channels);
+				}
+
+				Result Write(OutputStream& stream, RowSource const& rows, size_t width, size_t height, uint32_t channels)
+				{
+					if (channels != 1 && channels != 3)
+					{
+						return Result::InvalidValue;
+					}
+					const size_t row_size = width * channels * sizeof(float);
+					if (rows.row_bytes != row_size)
+					{
+						return Result::InvalidParameter;
+					}
+					const char* scale = (std::endian::native == std::endian::little) ? "-1.0" : "1.0";
+					const std::string header = std::string(channels == 3 ? "PF" : "Pf") + "\n" + std::to_string(width) + " " + std::to_string(height) + "\n" + scale + "\n";
+					Result result = stream.write(std::span<const byte>(reinterpret_cast<const byte*>(header.data()), header.size()));
+					// Bottom-up rows, written straight from the image (or from the produced band)
+					const size_t band_rows = rows.bandRows();
+					std::vector<byte> scratch;
+					for (size_t band_end = height; band_end > 0 && result == Result::Success; )
+					{
+						const size_t band_begin = band_end - std::min(band_end, band_rows);
+						const byte* data = rows.rows(band_begin, band_end, scratch);
+						for (size_t y = band_end - band_begin; y > 0 && result == Result::Success; --y)
+						{
+							result = stream.write(std::span<const byte>(data + (y - 1) * row_size, row_size));
+						}
+						band_end = band_begin;
+					}
+					return result;
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,327 @@
+#include <that/img/PNG.hpp>
+
+#include <that/utils/ThreadPool.hpp>
+#include <that/utils/Deflate.hpp>
+
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
+namespace that
+{
+	namespace img
+	{
+		namespace io
+		{
+			namespace png
+			{
+				using byte = uint8_t;
+
+				namespace
+				{
+					constexpr const byte Signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+					// Around 1MB of filtered rows per stripe (independent of the number of threads, so the files are reproducible)
+					constexpr const size_t StripeBytes = 1 << 20;
+					// Rows filtered per task
+					constexpr const size_t FilterGrainBytes = 1 << 16;
+
+					enum Filter : byte
+					{
+						None = 0,
+						Sub = 1,
+						Up = 2,
+						Average = 3,
+						Paeth = 4,
+					};
+
+					void WriteBE32(byte* p, uint32_t v)
+					{
+						p[0] = byte(v >> 24);
+						p[1] = byte(v >> 16);
+						p[2] = byte(v >> 8);
+						p[3] = byte(v);
+					}
+
+					byte PaethPredictor(int a, int b, int c)
+					{
+						const int p = a + b - c;
+						const int pa = std::abs(p - a);
+						const int pb = std::abs(p - b);
+						const int pc = std::abs(p - c);
+						if (pa <= pb && pa <= pc)
+						{
+							return byte(a);
+						}
+						return byte(pb <= pc ? b : c);
+					}
+
+					// dst[i] = row[i] - prediction, prior is the previous row (zeros for the first row)
+					// The first pixel is handled apart so that the main loops have no branch (and vectorize)
+					void ApplyFilter(Filter filter, const byte* row, const byte* prior, size_t size, size_t bpp, byte* dst)
+					{
+						switch (filter)
+						{
+						case Filter::None:
+							std::memcpy(dst, row, size);
+						break;
+						case Filter::Sub:
+							for (size_t i = 0; i < bpp; ++i)
+							{
+								dst[i] = row[i];
+							}
+							for (size_t i = bpp; i < size; ++i)
+							{
+								dst[i] = byte(row[i] - row[i - bpp]);
+							}
+						break;
+						case Filter::Up:
+							for (size_t i = 0; i < size; ++i)
+							{
+								dst[i] = byte(row[i] - prior[i]);
+							}
+						break;
+						case Filter::Average:
+							for (size_t i = 0; i < bpp; ++i)
+							{
+								dst[i] = byte(row[i] - (prior[i] >> 1));
+							}
+							for (size_t i = bpp; i < size; ++i)
+							{
+								dst[i] = byte(row[i] - ((uint32_t(row[i - bpp]) + prior[i]) >> 1));
+							}
+						break;
+						case Filter::Paeth:
+							for (size_t i = 0; i < bpp; ++i)
+							{
+								dst[i] = byte(row[i] - prior[i]);
+							}
+							for (size_t i = bpp; i < size; ++i)
+							{
+								dst[i] = byte(row[i] - PaethPredictor(row[i - bpp], prior[i], prior[i - bpp]));
+							}
+						break;
+						}
+					}
+
+					// Sum of the filtered bytes as signed values: the usual heuristic of the smallest output
+					uint64_t FilterCost(const byte* filtered, size_t size)
+					{
+						uint64_t sum = 0;
+						for (size_t i = 0; i < size; ++i)
+						{
+							const int v = int8_t(filtered[i]);
+							sum += uint32_t(v < 0 ? -v : v);
+						}
+						return sum;
+					}
+
+					Result WriteChunk(OutputStream& stream, const char type[4], const byte* data, size_t size)
+					{
+						byte head[8];
+						WriteBE32(head, uint32_t(size));
+						std::memcpy(head + 4, type, 4);
+						uint32_t crc = deflate::CRC32(head + 4, 4);
+						crc = deflate::CRC32(data, size, crc);
+						byte tail[4];
+						WriteBE32(tail, crc);
+						Result result = stream.write(std::span<const byte>(head, 8));
+						if (result == Result::Success && size)
+						{
+							result = stream.write(std::span<const byte>(data, size));
+						}
+						if (result == Result::Success)
+						{
+							result = stream.write(std::span<const byte>(tail, 4));
+						}
+						return result;
+					}
+				}
+
+				Result Encode(OutputStream& stream, const byte* pixels, size_t width, size_t height, uint32_t channels, uint32_t elem_size, int level, ThreadPool* pool)
+				{
+					const RowSource rows{
+						.pixels = pixels,
+						.row_bytes = width * channels * elem_size,
+					};
+					return Encode(stream, rows, width, height, channels, elem_size, level, pool);
+				}
+
+				Result Encode(OutputStream& stream, RowSource const& rows, size_t width, size_t height, uint32_t channels, uint32_t elem_size, int level, ThreadPool* pool)
+				{
+					if ((!rows.pixels && !rows.produce) || width == 0 || height == 0 || width > 0x7FFFFFFF || height > 0x7FFFFFFF)
+					{
+						return Result::InvalidParameter;
+					}
+					if (channels < 1 || channels > 4 || (elem_size != 1 && elem_size != 2))
+					{
+						return Result::InvalidParameter;
+					}
+					level = level < 0 ? DefaultLevel : std::min(level, 9);
+					const size_t bpp = channels * elem_size;
+					const size_t row_bytes = width * bpp;
+					if (row_bytes > (size_t(1) << 30) || rows.row_bytes != row_bytes)
+					{
+						return Result::InvalidParameter;
+					}
+					// Filter type byte, then the filtered row
+					const size_t filtered_row = row_bytes + 1;
+					std::vector<byte> filtered(filtered_row * height);
+
+					const size_t band_rows = rows.bandRows(FilterGrainBytes);
+					ParallelForRange(height, band_rows, [&](size_t begin, size_t end)
+					{
+						// 16 bits samples are big endian
+						std::vector<byte> swapped[2];
+						const auto to_file_order = [&](const byte* row, uint32_t slot) -> const byte*
+						{
+							if (elem_size == 1)
+							{
+								return row;
+							}
+							std::vector<byte>& s = swapped[slot];
+							s.resize(row_bytes);
+							for (size_t i = 0; i < row_bytes; i += 2)
+							{
+								uint16_t v;
+								std::memcpy(&v, row + i, 2);
+								s[i] = byte(v >> 8);
+								s[i + 1] = byte(v);
+							}
+							return s.data();
+						};
+						std::vector<byte> candidate(row_bytes);
+						// The rows are requested a band at a time, the last row of a band is kept as the prior of the next one
+						std::vector<byte> band_scratch;
+						std::vector<byte> prior_row(row_bytes, 0);
+						if (begin > 0)
+						{
+							const byte* p = to_file_order(rows.rows(begin - 1, begin, band_scratch), 0);
+							std::memcpy(prior_row.data(), p, row_bytes);
+						}
+						for (size_t band_begin = begin; band_begin < end; band_begin += band_rows)
+						{
+							const size_t band_end = std::min(end, band_begin + band_rows);
+							const byte* band = rows.rows(band_begin, band_end, band_scratch);
+							const byte* prior = prior_row.data();
+							uint32_t slot = 0;
+							for (size_t r = band_begin; r < band_end; ++r)
+							{
+								const byte* row = to_file_order(band + (r - band_begin) * row_bytes, slot);
+								byte* dst = filtered.data() + r * filtered_row;
+								if (level <= 1)
+								{
+									// Fixed filter
+									const Filter filter = level == 0 ? Filter::None : Filter::Sub;
+									ApplyFilter(filter, row, prior, row_bytes, bpp, dst + 1);
+									dst[0] = filter;
+								}
+								else
+								{
+									Filter best = Filter::None;
+									uint64_t best_cost = ~uint64_t(0);
+									for (byte f = Filter::None; f <= Filter::Paeth; ++f)
+									{
+										ApplyFilter(Filter(f), row, prior, row_bytes, bpp, candidate.data());
+										const uint64_t cost = FilterCost(candidate.data(), row_bytes);
+										if (cost < best_cost)
+										{
+											best_cost = cost;
+											best = Filter(f);
+											std::memcpy(dst + 1, candidate.data(), row_bytes);
+										}
+									}
+									dst[0] = best;
+								}
+								prior = row;
+								slot ^= 1;
+							}
+							std::memcpy(prior_row.data(), prior, row_bytes);
+						}
+					}, pool);
+
+					// Compression of the stripes
+					const size_t stripe_rows = std::max<size_t>(1, StripeBytes / filtered_row);
+					const size_t stripe_count = (height + stripe_rows - 1) / stripe_rows;
+					std::vector<std::vector<byte>> segments(stripe_count);
+					std::vector<uint32_t> adlers(stripe_count);
+					std::vector<uint32_t> crcs(stripe_count);
+					ThreadPool& p = pool ? *pool : ThreadPool::Default();
+					p.parallelFor(stripe_count, [&](size_t s)
+					{
+						const size_t begin = s * stripe_rows * filtered_row;
+						const size_t size = std::min(stripe_rows, height - s * stripe_rows) * filtered_row;
+						std::vector<byte>& segment = segments[s];
+						// Stored blocks take 5 more bytes every 64KB
+						segment.reserve(level == 0 ? size + (size / 65535 + 2) * 5 + 8 : size / 2 + 1024);
+						if (s == 0)
+						{
+							byte header[2];
+							deflate::ZlibHeader(level, header);
+							segment.insert(segment.end(), header, header + 2);
+						}
+						deflate::Compress(filtered.data() + begin, size, deflate::CompressInfo{
+							.level = level,
+							.rle = level == 1,
+							.final = s + 1 == stripe_count,
+							.dictionary_size = begin,
+						}, segment);
+						adlers[s] = deflate::Adler32(filtered.data() + begin, size);
+						crcs[s] = deflate::CRC32(segment.data(), segment.size(), deflate::CRC32(reinterpret_cast<const byte*>("IDAT"), 4));
+					});
+
+					Result result = stream.write(std::span<const byte>(Signature, sizeof(Signature)));
+					if (result == Result::Success)
+					{
+						// Color type: grey, RGB, grey alpha, RGBA
+						constexpr const byte color_types[4] = {0, 4, 2, 6};
+						byte ihdr[13];
+						WriteBE32(ihdr, uint32_t(width));
+						WriteBE32(ihdr + 4, uint32_t(height));
+						ihdr[8] = byte(elem_size * 8);
+						ihdr[9] = color_types[channels - 1];
+						ihdr[10] = 0; // deflate
+						ihdr[11] = 0; // adaptive filtering
+						ihdr[12] = 0; // not interlaced
+						result = WriteChunk(stream, "IHDR", ihdr, sizeof(ihdr));
+					}
+					uint32_t adler = 1;
+					for (size_t s = 0; s < stripe_count && result == Result::Success; ++s)
+					{
+						const size_t size = std::min(stripe_rows, height - s * stripe_rows) * filtered_row;
+						adler = deflate::Adler32Combine(adler, adlers[s], size);
+						byte head[8];
+						WriteBE32(head, uint32_t(segments[s].size()));
+						std::memcpy(head + 4, "IDAT", 4);
+						byte tail[4];
+						WriteBE32(tail, crcs[s]);
+						result = stream.write(std::span<const byte>(head, 8));
+						if (result == Result::Success)
+						{
+							result = stream.write(segments[s]);
+						}
+						if (result == Result::Success)
+						{
+							result = stream.write(std::span<const byte>(tail, 4));
+						}
+						// Release the memory as soon as possible
+						segments[s] = {};
+					}
+					if (result == Result::Success)
+					{
+						// The zlib stream ends with the Adler32 of the filtered data, in its own IDAT chunk
+						byte trailer[4];
+						WriteBE32(trailer, adler);
+						result = WriteChunk(stream, "IDAT", trailer, sizeof(trailer));
+					}
+					if (result == Result::Success)
+					{
+						result = WriteChunk(stream, "IEND", nullptr, 0);
+					}
+					return result;
+				}
+			}
+		}
+	}
+}
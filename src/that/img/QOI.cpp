@@ -0,0 +1,456 @@
+#include <that/img/QOI.hpp>
+
+#include <that/utils/ThreadPool.hpp>
+
+#include <cstring>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+namespace that
+{
+	namespace img
+	{
+		namespace io
+		{
+			namespace qoi
+			{
+				using byte = uint8_t;
+
+				namespace
+				{
+					constexpr const byte OP_INDEX = 0x00;
+					constexpr const byte OP_DIFF = 0x40;
+					constexpr const byte OP_LUMA = 0x80;
+					constexpr const byte OP_RUN = 0xC0;
+					constexpr const byte OP_RGB = 0xFE;
+					constexpr const byte OP_RGBA = 0xFF;
+					constexpr const byte MASK_2 = 0xC0;
+
+					constexpr const size_t HeaderSize = 14;
+					// Striped: the QOI header, stripe rows, stripe count
+					constexpr const size_t StripedHeaderSize = HeaderSize + 8;
+					constexpr const byte EndMarker[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+					// Around 256K pixels of whole rows per stripe (independent of the number of threads, so the files are reproducible)
+					constexpr const size_t StripePixels = 1 << 18;
+
+					struct Pixel
+					{
+						byte r = 0, g = 0, b = 0, a = 255;
+
+						bool operator==(Pixel const& o) const
+						{
+							return r == o.r && g == o.g && b == o.b && a == o.a;
+						}
+					};
+
+					uint32_t Hash(Pixel const& p)
+					{
+						return (p.r * 3u + p.g * 5u + p.b * 7u + p.a * 11u) & 63u;
+					}
+
+					void WriteBE32(byte* p, uint32_t v)
+					{
+						p[0] = byte(v >> 24);
+						p[1] = byte(v >> 16);
+						p[2] = byte(v >> 8);
+						p[3] = byte(v);
+					}
+
+					uint32_t ReadBE32(const byte* p)
+					{
+						return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+					}
+
+					// Worst case: a tag and 4 bytes per pixel
+					size_t MaxChunksSize(size_t pixel_count)
+					{
+						return pixel_count * 5;
+					}
+
+					// Encodes pixel_count pixels (C channels) with a fresh encoder state, returns the size written to dst
+					template <uint32_t C>
+					size_t EncodeChunks(const byte* src, size_t pixel_count, byte* dst)
+					{
+						Pixel index[64];
+						std::memset(index, 0, sizeof(index));
+						Pixel prev;
+						byte* op = dst;
+						uint32_t run = 0;
+						for (size_t i = 0; i < pixel_count; ++i)
+						{
+							const byte* s = src + i * C;
+							Pixel px;
+							if constexpr (C <= 2)
+							{
+								px.r = px.g = px.b = s[0];
+								if constexpr (C == 2)
+								{
+									px.a = s[1];
+								}
+							}
+							else
+							{
+								px.r = s[0];
+								px.g = s[1];
+								px.b = s[2];
+								if constexpr (C == 4)
+								{
+									px.a = s[3];
+								}
+							}
+
+							if (px == prev)
+							{
+								++run;
+								if (run == 62)
+								{
+									*op++ = OP_RUN | byte(run - 1);
+									run = 0;
+								}
+								continue;
+							}
+							if (run)
+							{
+								*op++ = OP_RUN | byte(run - 1);
+								run = 0;
+							}
+							const uint32_t h = Hash(px);
+							if (index[h] == px)
+							{
+								*op++ = OP_INDEX | byte(h);
+							}
+							else
+							{
+								index[h] = px;
+								if (px.a == prev.a)
+								{
+									const int8_t vr = int8_t(px.r - prev.r);
+									const int8_t vg = int8_t(px.g - prev.g);
+									const int8_t vb = int8_t(px.b - prev.b);
+									const int vg_r = vr - vg;
+									const int vg_b = vb - vg;
+									if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2)
+									{
+										*op++ = OP_DIFF | byte((vr + 2) << 4) | byte((vg + 2) << 2) | byte(vb + 2);
+									}
+									else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8)
+									{
+										*op++ = OP_LUMA | byte(vg + 32);
+										*op++ = byte((vg_r + 8) << 4) | byte(vg_b + 8);
+									}
+									else
+									{
+										*op++ = OP_RGB;
+										*op++ = px.r;
+										*op++ = px.g;
+										*op++ = px.b;
+									}
+								}
+								else
+								{
+									*op++ = OP_RGBA;
+									*op++ = px.r;
+									*op++ = px.g;
+									*op++ = px.b;
+									*op++ = px.a;
+								}
+							}
+							prev = px;
+						}
+						if (run)
+						{
+							*op++ = OP_RUN | byte(run - 1);
+						}
+						return size_t(op - dst);
+					}
+
+					size_t EncodeChunks(const byte* src, size_t pixel_count, uint32_t channels, byte* dst)
+					{
+						switch (channels)
+						{
+						case 1:
+							return EncodeChunks<1>(src, pixel_count, dst);
+						case 2:
+							return EncodeChunks<2>(src, pixel_count, dst);
+						case 3:
+							return EncodeChunks<3>(src, pixel_count, dst);
+						default:
+							return EncodeChunks<4>(src, pixel_count, dst);
+						}
+					}
+
+					// Decodes exactly pixel_count pixels (C channels) from [src, src + size) with a fresh decoder state
+					template <uint32_t C>
+					Result DecodeChunks(const byte* src, size_t size, byte* dst, size_t pixel_count)
+					{
+						Pixel index[64];
+						std::memset(index, 0, sizeof(index));
+						Pixel px;
+						const byte* ip = src;
+						const byte* const iend = src + size;
+						size_t i = 0;
+						while (i < pixel_count)
+						{
+							if (ip == iend)
+							{
+								return Result::WrongFileFormat;
+							}
+							const byte b1 = *ip++;
+							uint32_t run = 1;
+							if (b1 == OP_RGB)
+							{
+								if (iend - ip < 3)
+								{
+									return Result::WrongFileFormat;
+								}
+								px.r = ip[0];
+								px.g = ip[1];
+								px.b = ip[2];
+								ip += 3;
+							}
+							else if (b1 == OP_RGBA)
+							{
+								if (iend - ip < 4)
+								{
+									return Result::WrongFileFormat;
+								}
+								px.r = ip[0];
+								px.g = ip[1];
+								px.b = ip[2];
+								px.a = ip[3];
+								ip += 4;
+							}
+							else if ((b1 & MASK_2) == OP_INDEX)
+							{
+								px = index[b1];
+							}
+							else if ((b1 & MASK_2) == OP_DIFF)
+							{
+								px.r += byte(((b1 >> 4) & 3) - 2);
+								px.g += byte(((b1 >> 2) & 3) - 2);
+								px.b += byte((b1 & 3) - 2);
+							}
+							else if ((b1 & MASK_2) == OP_LUMA)
+							{
+								if (ip == iend)
+								{
+									return Result::WrongFileFormat;
+								}
+								const byte b2 = *ip++;
+								const int vg = (b1 & 0x3F) - 32;
+								px.r += byte(vg - 8 + ((b2 >> 4) & 0x0F));
+								px.g += byte(vg);
+								px.b += byte(vg - 8 + (b2 & 0x0F));
+							}
+							else
+							{
+								run = (b1 & 0x3F) + 1;
+								if (run > pixel_count - i)
+								{
+									return Result::WrongFileFormat;
+								}
+							}
+							index[Hash(px)] = px;
+							for (uint32_t k = 0; k < run; ++k, ++i)
+							{
+								byte* d = dst + i * C;
+								d[0] = px.r;
+								d[1] = px.g;
+								d[2] = px.b;
+								if constexpr (C == 4)
+								{
+									d[3] = px.a;
+								}
+							}
+						}
+						return Result::Success;
+					}
+
+					Result DecodeChunks(const byte* src, size_t size, byte* dst, size_t pixel_count, uint32_t channels)
+					{
+						return channels == 4 ? DecodeChunks<4>(src, size, dst, pixel_count) : DecodeChunks<3>(src, size, dst, pixel_count);
+					}
+
+					void WriteHeader(byte* dst, Header const& header)
+					{
+						std::memcpy(dst, header.striped ? "qois" : "qoif", 4);
+						WriteBE32(dst + 4, header.width);
+						WriteBE32(dst + 8, header.height);
+						dst[12] = header.channels;
+						dst[13] = header.colorspace;
+						if (header.striped)
+						{
+							WriteBE32(dst + 14, header.stripe_rows);
+							WriteBE32(dst + 18, header.stripe_count);
+						}
+					}
+				}
+
+				Result ParseHeader(std::span<const byte> file, Header& header)
+				{
+					if (file.size() < HeaderSize + sizeof(EndMarker))
+					{
+						return Result::WrongFileFormat;
+					}
+					const byte* p = file.data();
+					if (std::memcmp(p, "qoif", 4) == 0)
+					{
+						header.striped = false;
+					}
+					else if (std::memcmp(p, "qois", 4) == 0)
+					{
+						header.striped = true;
+					}
+					else
+					{
+						return Result::WrongFileFormat;
+					}
+					header.width = ReadBE32(p + 4);
+					header.height = ReadBE32(p + 8);
+					header.channels = p[12];
+					header.colorspace = p[13];
+					if (header.width == 0 || header.height == 0 || (header.channels != 3 && header.channels != 4) || header.colorspace > 1)
+					{
+						return Result::WrongFileFormat;
+					}
+					if (header.height >= PixelsMax / header.width)
+					{
+						return Result::WrongFileFormat;
+					}
+					if (header.striped)
+					{
+						if (file.size() < StripedHeaderSize)
+						{
+							return Result::WrongFileFormat;
+						}
+						header.stripe_rows = ReadBE32(p + 14);
+						header.stripe_count = ReadBE32(p + 18);
+						if (header.stripe_rows == 0 || header.stripe_count != header.height / header.stripe_rows + (header.height % header.stripe_rows != 0))
+						{
+							return Result::WrongFileFormat;
+						}
+						if ((file.size() - StripedHeaderSize) / sizeof(uint32_t) < header.stripe_count)
+						{
+							return Result::WrongFileFormat;
+						}
+					}
+					else
+					{
+						header.stripe_rows = header.height;
+						header.stripe_count = 1;
+					}
+					return Result::Success;
+				}
+
+				FormatInfo GetFormat(Header const& header)
+				{
+					FormatInfo format;
+					format.type = header.colorspace == 0 ? ElementType::sRGB : ElementType::UNORM;
+					format.elem_size = 1;
+					format.channels = header.channels;
+					return format;
+				}
+
+				Result Decode(std::span<const byte> file, Header const& header, byte* dst, ThreadPool* pool)
+				{
+					const size_t w = header.width;
+					const uint32_t c = header.channels;
+					if (!header.striped)
+					{
+						return DecodeChunks(file.data() + HeaderSize, file.size() - HeaderSize, dst, w * header.height, c);
+					}
+
+					// Stripe sizes, then the stripes
+					std::vector<size_t> offsets(size_t(header.stripe_count) + 1);
+					offsets[0] = StripedHeaderSize + size_t(header.stripe_count) * sizeof(uint32_t);
+					for (size_t s = 0; s < header.stripe_count; ++s)
+					{
+						offsets[s + 1] = offsets[s] + ReadBE32(file.data() + StripedHeaderSize + s * sizeof(uint32_t));
+					}
+					if (offsets.back() > file.size())
+					{
+						return Result::WrongFileFormat;
+					}
+					std::atomic<Result> result = Result::Success;
+					ThreadPool& p = pool ? *pool : ThreadPool::Default();
+					p.parallelFor(header.stripe_count, [&](size_t s)
+					{
+						const size_t y = s * header.stripe_rows;
+						const size_t rows = std::min<size_t>(header.stripe_rows, header.height - y);
+						Result r = DecodeChunks(file.data() + offsets[s], offsets[s + 1] - offsets[s], dst + y * w * c, w * rows, c);
+						if (r != Result::Success)
+						{
+							result = r;
+						}
+					});
+					return result;
+				}
+
+				Result Encode(OutputStream& stream, const byte* pixels, size_t width, size_t height, uint32_t channels, bool srgb, bool striped, ThreadPool* pool)
+				{
+					// Larger images would not be read back
+					if (width == 0 || height == 0 || height >= PixelsMax / width || channels == 0 || channels > 4)
+					{
+						return Result::InvalidParameter;
+					}
+					Header header;
+					header.width = uint32_t(width);
+					header.height = uint32_t(height);
+					header.channels = (channels == 2 || channels == 4) ? 4 : 3;
+					header.colorspace = srgb ? 0 : 1;
+					header.striped = striped;
+
+					Result result = Result::Success;
+					if (!striped)
+					{
+						std::vector<byte> buffer(HeaderSize + MaxChunksSize(width * height) + sizeof(EndMarker));
+						WriteHeader(buffer.data(), header);
+						size_t size = HeaderSize + EncodeChunks(pixels, width * height, channels, buffer.data() + HeaderSize);
+						std::memcpy(buffer.data() + size, EndMarker, sizeof(EndMarker));
+						size += sizeof(EndMarker);
+						result = stream.write(std::span<const byte>(buffer.data(), size));
+					}
+					else
+					{
+						header.stripe_rows = uint32_t(std::clamp<size_t>(StripePixels / width, 1, height));
+						header.stripe_count = uint32_t((height + header.stripe_rows - 1) / header.stripe_rows);
+
+						std::vector<std::vector<byte>> stripes(header.stripe_count);
+						std::vector<size_t> sizes(header.stripe_count);
+						ThreadPool& p = pool ? *pool : ThreadPool::Default();
+						p.parallelFor(header.stripe_count, [&](size_t s)
+						{
+							const size_t y = s * header.stripe_rows;
+							const size_t rows = std::min<size_t>(header.stripe_rows, height - y);
+							stripes[s].resize(MaxChunksSize(width * rows));
+							sizes[s] = EncodeChunks(pixels + y * width * channels, width * rows, channels, stripes[s].data());
+						});
+
+						std::vector<byte> head(StripedHeaderSize + stripes.size() * sizeof(uint32_t));
+						WriteHeader(head.data(), header);
+						for (size_t s = 0; s < stripes.size(); ++s)
+						{
+							if (sizes[s] > 0xFFFFFFFF)
+							{
+								return Result::InvalidValue;
+							}
+							WriteBE32(head.data() + StripedHeaderSize + s * sizeof(uint32_t), uint32_t(sizes[s]));
+						}
+						result = stream.write(head);
+						for (size_t s = 0; s < stripes.size() && result == Result::Success; ++s)
+						{
+							result = stream.write(std::span<const byte>(stripes[s].data(), sizes[s]));
+						}
+						if (result == Result::Success)
+						{
+							result = stream.write(std::span<const byte>(EndMarker, sizeof(EndMarker)));
+						}
+					}
+					return result;
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,474 @@
+#include <that/img/ThatImg.hpp>
+
+#include <that/stl_ext/alignment.hpp>
+#include <that/utils/LZ4.hpp>
+#include <that/utils/ThreadPool.hpp>
+
+#include <cstring>
+#include <bit>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <limits>
+
+namespace that
+{
+	namespace img
+	{
+		namespace io
+		{
+			namespace thatimg
+			{
+				using byte = uint8_t;
+
+				namespace
+				{
+					// Around 256KB of whole rows per block: a band of rows can be decompressed on its own
+					size_t ChooseBlockSize(size_t row_size)
+					{
+						constexpr const size_t target = 1 << 18;
+						row_size = std::max<size_t>(row_size, 1);
+						return std::max<size_t>(1, target / row_size) * row_size;
+					}
+
+					// offsets are relative to the payload
+					Result WriteFile(OutputStream& stream, FileHeader file_header, std::vector<size_t> const& offsets, const byte* payload, size_t row_size, ThreadPool* pool)
+					{
+						if constexpr (std::endian::native != std::endian::little)
+						{
+							return Result::NotImplemented;
+						}
+						const size_t alignment = file_header.alignment;
+						if (alignment == 0 || alignment > MaxAlignment || !std::isPowerOf2(alignment))
+						{
+							return Result::InvalidValue;
+						}
+						const size_t payload_size = offsets.back();
+						const bool compress = Compression(file_header.compression) == Compression::LZ4;
+
+						// Compressed in parallel, each block in its own buffer
+						size_t block_size = 0;
+						std::vector<std::vector<byte>> blocks;
+						std::vector<uint64_t> block_offsets;
+						if (compress)
+						{
+							block_size = ChooseBlockSize(row_size);
+							const size_t block_count = (payload_size + block_size - 1) / block_size;
+							blocks.resize(block_count);
+							ThreadPool& p = pool ? *pool : ThreadPool::Default();
+							p.parallelFor(block_count, [&](size_t i)
+							{
+								const size_t begin = i * block_size;
+								const size_t size = std::min(block_size, payload_size - begin);
+								std::vector<byte>& block = blocks[i];
+								block.resize(lz4::CompressBound(size));
+								size_t compressed = lz4::Compress(payload + begin, size, block.data(), block.size());
+								if (compressed == 0 || compressed >= size)
+								{
+									// Stored
+									block.assign(payload + begin, payload + begin + size);
+								}
+								else
+								{
+									block.resize(compressed);
+								}
+							});
+							block_offsets.resize(block_count + 1);
+							block_offsets[0] = 0;
+							for (size_t i = 0; i < block_count; ++i)
+							{
+								block_offsets[i + 1] = block_offsets[i] + blocks[i].size();
+							}
+						}
+
+						size_t header_size = sizeof(FileHeader) + offsets.size() * sizeof(uint64_t);
+						if (compress)
+						{
+							header_size += sizeof(uint64_t) + block_offsets.size() * sizeof(uint64_t);
+						}
+						file_header.header_size = uint32_t(header_size);
+						file_header.payload_offset = std::alignUp<size_t>(header_size, alignment);
+						file_header.payload_size = payload_size;
+
+						// Header, offsets, block index and padding, in a single write
+						std::vector<byte> head(file_header.payload_offset, 0);
+						byte* ptr = head.data();
+						const auto push = [&ptr](const void* data, size_t size)
+						{
+							std::memcpy(ptr, data, size);
+							ptr += size;
+						};
+						push(&file_header, sizeof(FileHeader));
+						for (size_t o : offsets)
+						{
+							const uint64_t o64 = o;
+							push(&o64, sizeof(uint64_t));
+						}
+						if (compress)
+						{
+							const uint64_t bs = block_size;
+							push(&bs, sizeof(uint64_t));
+							push(block_offsets.data(), block_offsets.size() * sizeof(uint64_t));
+						}
+						Result result = stream.write(head);
+						if (compress)
+						{
+							for (size_t i = 0; i < blocks.size() && result == Result::Success; ++i)
+							{
+								result = stream.write(blocks[i]);
+							}
+						}
+						else if (result == Result::Success)
+						{
+							result = stream.write(std::span<const byte>(payload, payload_size));
+						}
+						return result;
+					}
+
+					FileHeader MakeFileHeader(FormatInfo const& format, ImageExtent const& extent, uint32_t layers, uint32_t mips, size_t alignment, bool row_major, Compression compression)
+					{
+						FileHeader res;
+						res.type = uint16_t(format.type);
+						res.elem_size = format.elem_size;
+						res.channels = format.channels;
+						res.row_major = row_major ? 1 : 0;
+						res.compression = uint8_t(compression);
+						res.width = extent.width;
+						res.height = extent.height;
+						res.depth = extent.depth;
+						res.layers = layers;
+						res.mips = mips;
+						res.alignment = uint32_t(alignment);
+						return res;
+					}
+
+					// Whether the layout of ImageResource (see ComputeLayout) fits in a size_t, the fields of a file header are not trusted
+					bool LayoutFits(FormatInfo const& format, ImageExtent const& extent, uint32_t layers, uint32_t mips, size_t alignment)
+					{
+						constexpr const size_t max = std::numeric_limits<size_t>::max();
+						// Upper bound of the size of a layer, with the padding before each mip
+						size_t layer_size = 0;
+						for (uint32_t m = 0; m < mips; ++m)
+						{
+							const ImageExtent e = ImageResource::MipExtent(extent, m);
+							size_t mip_size = format.pixelSize();
+							for (const size_t d : {size_t(e.width), size_t(e.height), size_t(e.depth)})
+							{
+								if (mip_size > max / d)
+								{
+									return false;
+								}
+								mip_size *= d;
+							}
+							if (mip_size > max - alignment || layer_size > max - alignment - mip_size)
+							{
+								return false;
+							}
+							layer_size += mip_size + alignment;
+						}
+						return layer_size <= max / layers;
+					}
+
+					uint64_t ReadU64(const byte* ptr)
+					{
+						uint64_t res;
+						std::memcpy(&res, ptr, sizeof(uint64_t));
+						return res;
+					}
+				}
+
+				Result ParseFileHeader(std::span<const byte> file, Header& header)
+				{
+					if constexpr (std::endian::native != std::endian::little)
+					{
+						return Result::NotImplemented;
+					}
+					if (file.size() < sizeof(FileHeader))
+					{
+						return Result::WrongFileFormat;
+					}
+					FileHeader& fh = header.file;
+					std::memcpy(&fh, file.data(), sizeof(FileHeader));
+					if (std::memcmp(fh.magic, FileHeader{}.magic, sizeof(fh.magic)) != 0)
+					{
+						return Result::WrongFileFormat;
+					}
+					if (fh.version != FileHeader{}.version || fh.compression > uint8_t(Compression::LZ4))
+					{
+						return Result::NotImplemented;
+					}
+
+					const bool valid_format = fh.type < uint16_t(ElementType::MAX_ENUM) && std::has_single_bit(uint32_t(fh.elem_size)) && fh.elem_size <= 8 && fh.channels > 0;
+					const bool valid_extent = fh.width > 0 && fh.height > 0 && fh.depth > 0;
+					if (!valid_format || !valid_extent || fh.layers == 0 || fh.alignment == 0 || fh.alignment > MaxAlignment || !std::isPowerOf2(fh.alignment))
+					{
+						return Result::WrongFileFormat;
+					}
+					header.format = FormatInfo{.type = ElementType(fh.type), .elem_size = fh.elem_size, .channels = fh.channels};
+					header.extent = ImageExtent{.width = fh.width, .height = fh.height, .depth = fh.depth};
+					if (fh.mips == 0 || fh.mips > ImageResource::MaxMipLevels(header.extent))
+					{
+						return Result::WrongFileFormat;
+					}
+					return Result::Success;
+				}
+
+				Result ParseHeader(std::span<const byte> file, Header& header)
+				{
+					Result result = ParseFileHeader(file, header);
+					if (result != Result::Success)
+					{
+						return result;
+					}
+					FileHeader const& fh = header.file;
+					const bool compressed = header.compression() != Compression::None;
+
+					const size_t count = size_t(fh.layers) * size_t(fh.mips) + 1;
+					size_t index_end = sizeof(FileHeader) + count * sizeof(uint64_t);
+					if (index_end > file.size())
+					{
+						return Result::WrongFileFormat;
+					}
+
+					// The offsets must be the layout of ImageResource (so the payload can be used as is)
+					if (!LayoutFits(header.format, header.extent, fh.layers, fh.mips, fh.alignment))
+					{
+						return Result::WrongFileFormat;
+					}
+					ImageResource::ComputeLayout(header.format, header.extent, fh.layers, fh.mips, fh.alignment, header.offsets);
+					for (size_t i = 0; i < count; ++i)
+					{
+						if (ReadU64(file.data() + sizeof(FileHeader) + i * sizeof(uint64_t)) != header.offsets[i])
+						{
+							return Result::WrongFileFormat;
+						}
+					}
+					if (header.offsets.back() != fh.payload_size)
+					{
+						return Result::WrongFileFormat;
+					}
+
+					size_t stored_payload_size = fh.payload_size;
+					header.block_size = 0;
+					header.block_offsets.clear();
+					if (compressed)
+					{
+						if (index_end + sizeof(uint64_t) > file.size())
+						{
+							return Result::WrongFileFormat;
+						}
+						header.block_size = ReadU64(file.data() + index_end);
+						index_end += sizeof(uint64_t);
+						if (header.block_size == 0)
+						{
+							return Result::WrongFileFormat;
+						}
+						// Without overflow (block_size is not trusted)
+						const size_t block_count = fh.payload_size / header.block_size + (fh.payload_size % header.block_size != 0);
+						if (block_count + 1 > (file.size() - index_end) / sizeof(uint64_t))
+						{
+							return Result::WrongFileFormat;
+						}
+						header.block_offsets.resize(block_count + 1);
+						for (size_t i = 0; i <= block_count; ++i)
+						{
+							header.block_offsets[i] = ReadU64(file.data() + index_end + i * sizeof(uint64_t));
+						}
+						index_end += (block_count + 1) * sizeof(uint64_t);
+						if (header.block_offsets[0] != 0)
+						{
+							return Result::WrongFileFormat;
+						}
+						for (size_t i = 0; i < block_count; ++i)
+						{
+							const size_t raw_size = std::min<size_t>(header.block_size, fh.payload_size - i * header.block_size);
+							if (header.block_offsets[i + 1] < header.block_offsets[i] || header.block_offsets[i + 1] - header.block_offsets[i] > raw_size)
+							{
+								return Result::WrongFileFormat;
+							}
+						}
+						stored_payload_size = header.block_offsets.back();
+					}
+
+					if (fh.header_size != index_end)
+					{
+						return Result::WrongFileFormat;
+					}
+					if (fh.payload_offset < fh.header_size || (fh.payload_offset % fh.alignment) != 0 || fh.payload_offset > file.size() || stored_payload_size > file.size() - fh.payload_offset)
+					{
+						return Result::WrongFileFormat;
+					}
+					return Result::Success;
+				}
+
+				Result ReadPayload(std::span<const byte> file, Header const& header, size_t offset, std::span<byte> dst, ThreadPool* pool)
+				{
+					const size_t payload_size = header.file.payload_size;
+					if (offset > payload_size || dst.size() > payload_size - offset)
+					{
+						return Result::InvalidParameter;
+					}
+					const byte* payload = file.data() + header.file.payload_offset;
+					if (header.compression() == Compression::None)
+					{
+						std::memcpy(dst.data(), payload + offset, dst.size());
+						return Result::Success;
+					}
+					if (dst.empty())
+					{
+						return Result::Success;
+					}
+
+					const size_t bs = header.block_size;
+					const size_t first = offset / bs;
+					const size_t last = (offset + dst.size() - 1) / bs;
+					if (last + 1 >= header.block_offsets.size())
+					{
+						return Result::InvalidParameter;
+					}
+					std::atomic<Result> result = Result::Success;
+					ThreadPool& p = pool ? *pool : ThreadPool::Default();
+					p.parallelFor(last - first + 1, [&](size_t k)
+					{
+						const size_t i = first + k;
+						const size_t begin = i * bs;
+						const size_t raw_size = std::min(bs, payload_size - begin);
+						const byte* src = payload + header.block_offsets[i];
+						const size_t src_size = header.block_offsets[i + 1] - header.block_offsets[i];
+						// Part of the block in dst
+						const size_t copy_begin = std::max(begin, offset);
+						const size_t copy_end = std::min(begin + raw_size, offset + dst.size());
+						byte* d = dst.data() + (copy_begin - offset);
+						Result r = Result::Success;
+						if (src_size == raw_size)
+						{
+							// Stored
+							std::memcpy(d, src + (copy_begin - begin), copy_end - copy_begin);
+						}
+						else if (copy_begin == begin && copy_end == begin + raw_size)
+						{
+							r = lz4::Decompress(src, src_size, d, raw_size);
+						}
+						else
+						{
+							std::vector<byte> tmp(raw_size);
+							r = lz4::Decompress(src, src_size, tmp.data(), raw_size);
+							std::memcpy(d, tmp.data() + (copy_begin - begin), copy_end - copy_begin);
+						}
+						if (r != Result::Success)
+						{
+							result = r;
+						}
+					});
+					return result;
+				}
+
+				Result Write(OutputStream& stream, FormatlessImage const& image, FormatInfo const& format, bool row_major, Compression compression, ThreadPool* pool)
+				{
+					if (image.empty() || image.byteSize() != image.width() * image.height() * format.pixelSize())
+					{
+						return Result::InvalidParameter;
+					}
+					const ImageExtent extent{.width = uint32_t(image.width()), .height = uint32_t(image.height()), .depth = 1};
+					const size_t alignment = std::min<size_t>(ImageStorage::DefaultAlignment(), MaxAlignment);
+					const std::vector<size_t> offsets = {0, image.byteSize()};
+					const size_t row_size = (row_major ? image.width() : image.height()) * format.pixelSize();
+					return WriteFile(stream, MakeFileHeader(format, extent, 1, 1, alignment, row_major, compression), offsets, image.rawData(), row_size, pool);
+				}
+
+				Result Write(OutputStream& stream, ImageResource const& resource, Compression compression, ThreadPool* pool)
+				{
+					if (resource.empty())
+					{
+						return Result::InvalidParameter;
+					}
+					const FileHeader fh = MakeFileHeader(resource.format(), resource.extent(), resource.layers(), resource.mips(), resource.alignment(), true, compression);
+					return WriteFile(stream, fh, resource.offsets(), resource.rawData(), size_t(resource.extent().width) * resource.format().pixelSize(), pool);
+				}
+
+				Result MapFile(FileSystem::Hint hint, FileSystem::Path const& path, FileSystem* filesystem, MappedFile& mapped, Header& header)
+				{
+					FileSystem::MapFileInfo fs_info{
+						.hint = hint,
+						.path = &path,
+						.result = &mapped,
+					};
+					Result result = FileSystem::MapFile(fs_info, filesystem);
+					if (result == Result::Success)
+					{
+						result = ParseHeader(mapped.span(), header);
+					}
+					return result;
+				}
+
+				Result ReadImageResource(ReadResourceInfo const& info)
+				{
+					if (!info.path || !info.target)
+					{
+						return Result::InvalidParameter;
+					}
+					MappedFile mapped;
+					Header header;
+					Result result = MapFile(info.hint, *info.path, info.filesystem, mapped, header);
+					if (result != Result::Success)
+					{
+						return result;
+					}
+					if (!header.file.row_major)
+					{
+						return Result::WrongFileFormat;
+					}
+					ImageResource::CreateInfo ci{
+						.format = header.format,
+						.extent = header.extent,
+						.layers = header.file.layers,
+						.mips = header.file.mips,
+						.alignment = header.file.alignment,
+					};
+					const size_t payload_size = header.file.payload_size;
+					if (header.compression() == Compression::None)
+					{
+						byte* payload = mapped.data() + header.file.payload_offset;
+						std::shared_ptr<MappedFile> owner = std::make_shared<MappedFile>(std::move(mapped));
+						*info.target = ImageResource(ci, ImageStorage(payload, payload_size, [owner](byte*, size_t) {}));
+					}
+					else
+					{
+						ImageStorage storage(payload_size, ci.alignment);
+						result = ReadPayload(mapped.span(), header, 0, std::span<byte>(storage.data(), payload_size), info.pool);
+						if (result == Result::Success)
+						{
+							*info.target = ImageResource(ci, std::move(storage));
+						}
+					}
+					return result;
+				}
+
+				Result WriteImageResource(WriteResourceInfo const& info)
+				{
+					if (!info.path || !info.resource)
+					{
+						return Result::InvalidParameter;
+					}
+					ResultAnd<FileSystem::Path> path = FileSystem::ResolveFilePath(*info.path, info.hint, info.filesystem);
+					if (path.result != Result::Success)
+					{
+						return path.result;
+					}
+					// A failure leaves an existing file untouched
+					AtomicFileOutputStream file;
+					Result result = file.open(path.value, !(info.hint & FileSystem::Hint::DontCreateDirectory));
+					if (result == Result::Success)
+					{
+						result = Write(file, *info.resource, info.compression, info.pool);
+					}
+					if (result == Result::Success)
+					{
+						result = file.commit();
+					}
+					return result;
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,85 @@
+#include <that/utils/AsyncResult.hpp>
+#include <that/utils/ThreadPool.hpp>
+
+#include <cassert>
+
+namespace that
+{
+	bool AsyncResult::ready() const
+	{
+		assert(_state);
+		std::unique_lock lock(_state->mutex);
+		return _state->done;
+	}
+
+	Result AsyncResult::wait() const
+	{
+		assert(_state);
+		std::unique_lock lock(_state->mutex);
+		_state->condition.wait(lock, [this]() {return _state->done; });
+		return _state->result;
+	}
+
+	AsyncResult const& AsyncResult::then(Callback&& callback) const
+	{
+		assert(_state);
+		Result result;
+		{
+			std::unique_lock lock(_state->mutex);
+			if (!_state->done)
+			{
+				_state->callbacks.push_back(std::move(callback));
+				return *this;
+			}
+			result = _state->result;
+		}
+		callback(result);
+		return *this;
+	}
+
+	bool AsyncResult::await_suspend(std::coroutine_handle<> handle) const
+	{
+		assert(_state);
+		std::unique_lock lock(_state->mutex);
+		if (_state->done)
+		{
+			// Completed in the meantime: don't suspend
+			return false;
+		}
+		_state->callbacks.push_back([handle](Result) {handle.resume(); });
+		return true;
+	}
+
+	AsyncPromise::AsyncPromise() :
+		_state(std::make_shared<AsyncResult::State>())
+	{}
+
+	void AsyncPromise::complete(Result result)
+	{
+		std::vector<AsyncResult::Callback> callbacks;
+		{
+			std::unique_lock lock(_state->mutex);
+			assert(!_state->done);
+			_state->result = result;
+			_state->done = true;
+			callbacks = std::move(_state->callbacks);
+		}
+		_state->condition.notify_all();
+		for (AsyncResult::Callback& callback : callbacks)
+		{
+			callback(result);
+		}
+	}
+
+	AsyncResult RunAsync(std::function<Result()>&& f, ThreadPool* executor)
+	{
+		ThreadPool& pool = executor ? *executor : ThreadPool::Default();
+		AsyncPromise promise;
+		AsyncResult res = promise.getResult();
+		pool.push([promise, f = std::move(f)]() mutable
+		{
+			promise.complete(f());
+		});
+		return res;
+	}
+}
@@ -0,0 +1,1247 @@
+#include <that/utils/Deflate.hpp>
+
+#include <cstring>
+#include <algorithm>
+#include <array>
+
+namespace that
+{
+	namespace deflate
+	{
+		namespace
+		{
+			constexpr const uint32_t WindowSize = 1 << 15;
+			constexpr const uint32_t WindowMask = WindowSize - 1;
+			constexpr const uint32_t HashBits = 15;
+			constexpr const uint32_t MinMatch = 3;
+			constexpr const uint32_t MaxMatch = 258;
+			// A match of MinMatch bytes further than that costs more than its literals
+			constexpr const uint32_t TooFar = 4096;
+			constexpr const size_t MaxBlockSymbols = 1 << 15;
+			constexpr const size_t MaxStoredSize = 65535;
+
+			constexpr const uint32_t LitLenCodes = 286;
+			constexpr const uint32_t DistCodes = 30;
+			constexpr const uint32_t CodeLengthCodes = 19;
+			constexpr const uint32_t EndOfBlock = 256;
+
+			constexpr const uint16_t LengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+			constexpr const uint8_t LengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+			constexpr const uint16_t DistBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+			constexpr const uint8_t DistExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+			constexpr const uint8_t CodeLengthOrder[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+			struct Tables
+			{
+				// length (3 to 258) -> length code - 257
+				uint8_t length_code[MaxMatch + 1] = {};
+				// distance - 1 (< 256) -> distance code
+				uint8_t dist_code_low[256] = {};
+				// (distance - 1) >> 7 -> distance code
+				uint8_t dist_code_high[256] = {};
+				uint32_t crc[8][256] = {};
+				// Fixed Huffman code lengths
+				uint8_t fixed_litlen[288] = {};
+				uint8_t fixed_dist[DistCodes] = {};
+
+				Tables()
+				{
+					for (uint32_t c = 0; c < 29; ++c)
+					{
+						for (uint32_t l = LengthBase[c]; l < LengthBase[c] + (1u << LengthExtra[c]) && l <= MaxMatch; ++l)
+						{
+							length_code[l] = uint8_t(c);
+						}
+					}
+					for (uint32_t c = 0; c < DistCodes; ++c)
+					{
+						for (uint32_t d = DistBase[c]; d < DistBase[c] + (1u << DistExtra[c]); ++d)
+						{
+							if (d - 1 < 256)
+							{
+								dist_code_low[d - 1] = uint8_t(c);
+							}
+							dist_code_high[(d - 1) >> 7] = uint8_t(c);
+						}
+					}
+					for (uint32_t i = 0; i < 256; ++i)
+					{
+						uint32_t c = i;
+						for (uint32_t k = 0; k < 8; ++k)
+						{
+							c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+						}
+						crc[0][i] = c;
+					}
+					for (uint32_t k = 1; k < 8; ++k)
+					{
+						for (uint32_t i = 0; i < 256; ++i)
+						{
+							crc[k][i] = (crc[k - 1][i] >> 8) ^ crc[0][crc[k - 1][i] & 0xFF];
+						}
+					}
+					for (uint32_t i = 0; i < 288; ++i)
+					{
+						fixed_litlen[i] = i < 144 ? 8 : (i < 256 ? 9 : (i < 280 ? 7 : 8));
+					}
+					std::fill_n(fixed_dist, DistCodes, uint8_t(5));
+				}
+
+				uint32_t distCode(uint32_t dist) const
+				{
+					return (dist - 1) < 256 ? dist_code_low[dist - 1] : dist_code_high[(dist - 1) >> 7];
+				}
+			};
+
+			Tables const& GetTables()
+			{
+				static const Tables tables;
+				return tables;
+			}
+
+			// Same trade-offs as zlib's configuration table
+			struct LevelParams
+			{
+				// The chain is shortened for the lazy search once a match is that long
+				uint32_t good_length;
+				// Lazy levels: no lazy search once a match is that long
+				// Greedy levels: only the first position of longer matches is hashed
+				uint32_t max_lazy;
+				// Stop searching once a match is that long
+				uint32_t nice_length;
+				uint32_t max_chain;
+				bool lazy;
+			};
+
+			constexpr const LevelParams Levels[10] = {
+				{0, 0, 0, 0, false},
+				{4, 4, 8, 4, false},
+				{4, 5, 16, 8, false},
+				{4, 6, 32, 32, false},
+				{4, 4, 16, 16, true},
+				{8, 16, 32, 32, true},
+				{8, 16, 128, 128, true},
+				{8, 32, 128, 256, true},
+				{32, 128, MaxMatch, 1024, true},
+				{32, MaxMatch, MaxMatch, 4096, true},
+			};
+
+			// LSB first bit packing
+			class BitWriter
+			{
+			protected:
+
+				std::vector<uint8_t>& _out;
+				uint64_t _bits = 0;
+				uint32_t _count = 0;
+
+			public:
+
+				BitWriter(std::vector<uint8_t>& out) :
+					_out(out)
+				{}
+
+				// n <= 16
+				void put(uint32_t value, uint32_t n)
+				{
+					_bits |= uint64_t(value) << _count;
+					_count += n;
+					if (_count >= 32)
+					{
+						const uint8_t b[4] = {uint8_t(_bits), uint8_t(_bits >> 8), uint8_t(_bits >> 16), uint8_t(_bits >> 24)};
+						_out.insert(_out.end(), b, b + 4);
+						_bits >>= 32;
+						_count -= 32;
+					}
+				}
+
+				// Pads to the next byte boundary, flushes the pending bits
+				void align()
+				{
+					while (_count > 0)
+					{
+						_out.push_back(uint8_t(_bits));
+						_bits >>= 8;
+						_count = _count > 8 ? _count - 8 : 0;
+					}
+					_bits = 0;
+				}
+
+				void bytes(const uint8_t* data, size_t size)
+				{
+					_out.insert(_out.end(), data, data + size);
+				}
+			};
+
+			// Length limited Huffman code lengths of the n symbols (0 for the unused ones)
+			void BuildLengths(const uint32_t* freq, uint32_t n, uint32_t max_bits, uint8_t* lengths)
+			{
+				struct Sym
+				{
+					uint32_t key;
+					uint32_t index;
+				};
+				std::array<Sym, 288> syms;
+				uint32_t used = 0;
+				std::fill_n(lengths, n, uint8_t(0));
+				for (uint32_t i = 0; i < n; ++i)
+				{
+					if (freq[i])
+					{
+						syms[used++] = Sym{freq[i], i};
+					}
+				}
+				if (used == 0)
+				{
+					return;
+				}
+				if (used == 1)
+				{
+					lengths[syms[0].index] = 1;
+					return;
+				}
+				std::sort(syms.begin(), syms.begin() + used, [](Sym const& a, Sym const& b) {return a.key < b.key || (a.key == b.key && a.index < b.index); });
+
+				// In place minimum redundancy code lengths (Moffat and Katajainen), on the ascending frequencies
+				{
+					Sym* A = syms.data();
+					const int N = int(used);
+					int root = 0, leaf = 2;
+					A[0].key += A[1].key;
+					for (int next = 1; next < N - 1; ++next)
+					{
+						if (leaf >= N || A[root].key < A[leaf].key)
+						{
+							A[next].key = A[root].key;
+							A[root++].key = uint32_t(next);
+						}
+						else
+						{
+							A[next].key = A[leaf++].key;
+						}
+						if (leaf >= N || (root < next && A[root].key < A[leaf].key))
+						{
+							A[next].key += A[root].key;
+							A[root++].key = uint32_t(next);
+						}
+						else
+						{
+							A[next].key += A[leaf++].key;
+						}
+					}
+					A[N - 2].key = 0;
+					for (int next = N - 3; next >= 0; --next)
+					{
+						A[next].key = A[A[next].key].key + 1;
+					}
+					int avbl = 1, used_nodes = 0, depth = 0;
+					root = N - 2;
+					int next = N - 1;
+					while (avbl > 0)
+					{
+						while (root >= 0 && int(A[root].key) == depth)
+						{
+							++used_nodes;
+							--root;
+						}
+						while (avbl > used_nodes)
+						{
+							A[next--].key = uint32_t(depth);
+							--avbl;
+						}
+						avbl = 2 * used_nodes;
+						++depth;
+						used_nodes = 0;
+					}
+				}
+
+				// Limits the lengths to max_bits, keeping the code complete
+				uint32_t count[33] = {};
+				for (uint32_t i = 0; i < used; ++i)
+				{
+					++count[std::min<uint32_t>(syms[i].key, 32)];
+				}
+				for (uint32_t l = max_bits + 1; l <= 32; ++l)
+				{
+					count[max_bits] += count[l];
+					count[l] = 0;
+				}
+				uint64_t total = 0;
+				for (uint32_t l = max_bits; l > 0; --l)
+				{
+					total += uint64_t(count[l]) << (max_bits - l);
+				}
+				while (total != (uint64_t(1) << max_bits))
+				{
+					--count[max_bits];
+					for (uint32_t l = max_bits - 1; l > 0; --l)
+					{
+						if (count[l])
+						{
+							--count[l];
+							count[l + 1] += 2;
+							break;
+						}
+					}
+					--total;
+				}
+
+				// The least frequent symbols get the longest codes
+				uint32_t s = 0;
+				for (uint32_t l = max_bits; l > 0; --l)
+				{
+					for (uint32_t k = 0; k < count[l]; ++k)
+					{
+						lengths[syms[s++].index] = uint8_t(l);
+					}
+				}
+			}
+
+			// Canonical codes, bit reversed (Huffman codes are packed MSB first)
+			void BuildCodes(const uint8_t* lengths, uint32_t n, uint16_t* codes)
+			{
+				uint32_t count[16] = {};
+				for (uint32_t i = 0; i < n; ++i)
+				{
+					++count[lengths[i]];
+				}
+				count[0] = 0;
+				uint32_t next[16] = {};
+				uint32_t code = 0;
+				for (uint32_t l = 1; l < 16; ++l)
+				{
+					code = (code + count[l - 1]) << 1;
+					next[l] = code;
+				}
+				for (uint32_t i = 0; i < n; ++i)
+				{
+					const uint32_t l = lengths[i];
+					if (l)
+					{
+						uint32_t c = next[l]++;
+						uint32_t r = 0;
+						for (uint32_t b = 0; b < l; ++b)
+						{
+							r = (r << 1) | (c & 1);
+							c >>= 1;
+						}
+						codes[i] = uint16_t(r);
+					}
+				}
+			}
+
+			struct Symbol
+			{
+				// Literal byte if dist == 0, else match length
+				uint16_t value;
+				uint16_t dist;
+			};
+
+			class BlockWriter
+			{
+			protected:
+
+				Tables const& _tables;
+				BitWriter _bits;
+
+				void writeStored(const uint8_t* data, size_t size, bool final)
+				{
+					do
+					{
+						const size_t n = std::min(size, MaxStoredSize);
+						const bool last = n == size;
+						_bits.put((final && last) ? 1 : 0, 1);
+						_bits.put(0, 2);
+						_bits.align();
+						const uint8_t header[4] = {uint8_t(n), uint8_t(n >> 8), uint8_t(~n), uint8_t(~n >> 8)};
+						_bits.bytes(header, 4);
+						_bits.bytes(data, n);
+						data += n;
+						size -= n;
+					} while (size > 0);
+				}
+
+				void writeSymbols(std::vector<Symbol> const& symbols, const uint8_t* litlen_lengths, const uint16_t* litlen_codes, const uint8_t* dist_lengths, const uint16_t* dist_codes)
+				{
+					for (Symbol const& s : symbols)
+					{
+						if (s.dist == 0)
+						{
+							_bits.put(litlen_codes[s.value], litlen_lengths[s.value]);
+						}
+						else
+						{
+							const uint32_t lc = _tables.length_code[s.value];
+							_bits.put(litlen_codes[257 + lc], litlen_lengths[257 + lc]);
+							if (LengthExtra[lc])
+							{
+								_bits.put(s.value - LengthBase[lc], LengthExtra[lc]);
+							}
+							const uint32_t dc = _tables.distCode(s.dist);
+							_bits.put(dist_codes[dc], dist_lengths[dc]);
+							if (DistExtra[dc])
+							{
+								_bits.put(s.dist - DistBase[dc], DistExtra[dc]);
+							}
+						}
+					}
+					_bits.put(litlen_codes[EndOfBlock], litlen_lengths[EndOfBlock]);
+				}
+
+			public:
+
+				BlockWriter(std::vector<uint8_t>& out) :
+					_tables(GetTables()),
+					_bits(out)
+				{}
+
+				// Writes the block of symbols (which encode data) as the smallest of stored, fixed and dynamic Huffman
+				void writeBlock(std::vector<Symbol> const& symbols, const uint8_t* data, size_t size, bool final)
+				{
+					uint32_t litlen_freq[LitLenCodes] = {};
+					uint32_t dist_freq[DistCodes] = {};
+					for (Symbol const& s : symbols)
+					{
+						if (s.dist == 0)
+						{
+							++litlen_freq[s.value];
+						}
+						else
+						{
+							++litlen_freq[257 + _tables.length_code[s.value]];
+							++dist_freq[_tables.distCode(s.dist)];
+						}
+					}
+					litlen_freq[EndOfBlock] = 1;
+
+					uint8_t litlen_lengths[288] = {};
+					uint8_t dist_lengths[DistCodes] = {};
+					BuildLengths(litlen_freq, LitLenCodes, 15, litlen_lengths);
+					BuildLengths(dist_freq, DistCodes, 15, dist_lengths);
+					if (std::all_of(dist_lengths, dist_lengths + DistCodes, [](uint8_t l) {return l == 0; }))
+					{
+						// At least one distance code
+						dist_lengths[0] = 1;
+					}
+
+					uint32_t hlit = LitLenCodes;
+					while (hlit > 257 && litlen_lengths[hlit - 1] == 0)
+					{
+						--hlit;
+					}
+					uint32_t hdist = DistCodes;
+					while (hdist > 1 && dist_lengths[hdist - 1] == 0)
+					{
+						--hdist;
+					}
+
+					// Run length encoding of the code lengths: (symbol, extra bits value)
+					std::array<uint8_t, LitLenCodes + DistCodes> all_lengths;
+					std::copy_n(litlen_lengths, hlit, all_lengths.begin());
+					std::copy_n(dist_lengths, hdist, all_lengths.begin() + hlit);
+					const uint32_t total_lengths = hlit + hdist;
+					std::array<std::pair<uint8_t, uint8_t>, LitLenCodes + DistCodes> rle;
+					uint32_t rle_count = 0;
+					uint32_t cl_freq[CodeLengthCodes] = {};
+					const auto emit = [&](uint8_t symbol, uint8_t extra)
+					{
+						rle[rle_count++] = {symbol, extra};
+						++cl_freq[symbol];
+					};
+					for (uint32_t i = 0; i < total_lengths;)
+					{
+						const uint8_t l = all_lengths[i];
+						uint32_t run = 1;
+						while (i + run < total_lengths && all_lengths[i + run] == l)
+						{
+							++run;
+						}
+						i += run;
+						if (l == 0)
+						{
+							while (run >= 11)
+							{
+								const uint32_t r = std::min<uint32_t>(run, 138);
+								emit(18, uint8_t(r - 11));
+								run -= r;
+							}
+							if (run >= 3)
+							{
+								emit(17, uint8_t(run - 3));
+								run = 0;
+							}
+						}
+						else
+						{
+							emit(l, 0);
+							--run;
+							while (run >= 3)
+							{
+								const uint32_t r = std::min<uint32_t>(run, 6);
+								emit(16, uint8_t(r - 3));
+								run -= r;
+							}
+						}
+						for (; run > 0; --run)
+						{
+							emit(l, 0);
+						}
+					}
+					if (std::count_if(cl_freq, cl_freq + CodeLengthCodes, [](uint32_t f) {return f != 0; }) < 2)
+					{
+						// The code length code must be complete: at least two codes
+						++cl_freq[cl_freq[0] ? 1 : 0];
+					}
+					uint8_t cl_lengths[CodeLengthCodes] = {};
+					BuildLengths(cl_freq, CodeLengthCodes, 7, cl_lengths);
+					uint32_t hclen = CodeLengthCodes;
+					while (hclen > 4 && cl_lengths[CodeLengthOrder[hclen - 1]] == 0)
+					{
+						--hclen;
+					}
+
+					// Sizes in bits
+					const Tables& t = _tables;
+					const auto data_cost = [&](const uint8_t* ll, const uint8_t* dl)
+					{
+						uint64_t bits = 0;
+						for (uint32_t i = 0; i < LitLenCodes; ++i)
+						{
+							bits += uint64_t(litlen_freq[i]) * (ll[i] + (i > 256 ? LengthExtra[i - 257] : 0));
+						}
+						for (uint32_t i = 0; i < DistCodes; ++i)
+						{
+							bits += uint64_t(dist_freq[i]) * (dl[i] + DistExtra[i]);
+						}
+						return bits;
+					};
+					uint64_t dynamic_cost = 3 + 5 + 5 + 4 + 3 * hclen + data_cost(litlen_lengths, dist_lengths);
+					for (uint32_t i = 0; i < CodeLengthCodes; ++i)
+					{
+						dynamic_cost += uint64_t(cl_freq[i]) * (cl_lengths[i] + (i == 16 ? 2 : (i == 17 ? 3 : (i == 18 ? 7 : 0))));
+					}
+					const uint64_t fixed_cost = 3 + data_cost(t.fixed_litlen, t.fixed_dist);
+					const uint64_t stored_cost = (uint64_t(size) + 5 * (size / MaxStoredSize + 1)) * 8 + 7;
+
+					if (stored_cost <= fixed_cost && stored_cost <= dynamic_cost)
+					{
+						writeStored(data, size, final);
+					}
+					else if (fixed_cost <= dynamic_cost)
+					{
+						uint16_t litlen_codes[288] = {};
+						uint16_t dist_codes[DistCodes] = {};
+						BuildCodes(t.fixed_litlen, 288, litlen_codes);
+						BuildCodes(t.fixed_dist, DistCodes, dist_codes);
+						_bits.put(final ? 1 : 0, 1);
+						_bits.put(1, 2);
+						writeSymbols(symbols, t.fixed_litlen, litlen_codes, t.fixed_dist, dist_codes);
+					}
+					else
+					{
+						uint16_t litlen_codes[288] = {};
+						uint16_t dist_codes[DistCodes] = {};
+						uint16_t cl_codes[CodeLengthCodes] = {};
+						BuildCodes(litlen_lengths, LitLenCodes, litlen_codes);
+						BuildCodes(dist_lengths, DistCodes, dist_codes);
+						BuildCodes(cl_lengths, CodeLengthCodes, cl_codes);
+						_bits.put(final ? 1 : 0, 1);
+						_bits.put(2, 2);
+						_bits.put(hlit - 257, 5);
+						_bits.put(hdist - 1, 5);
+						_bits.put(hclen - 4, 4);
+						for (uint32_t i = 0; i < hclen; ++i)
+						{
+							_bits.put(cl_lengths[CodeLengthOrder[i]], 3);
+						}
+						for (uint32_t i = 0; i < rle_count; ++i)
+						{
+							const uint8_t symbol = rle[i].first;
+							_bits.put(cl_codes[symbol], cl_lengths[symbol]);
+							if (symbol >= 16)
+							{
+								_bits.put(rle[i].second, symbol == 16 ? 2 : (symbol == 17 ? 3 : 7));
+							}
+						}
+						writeSymbols(symbols, litlen_lengths, litlen_codes, dist_lengths, dist_codes);
+					}
+				}
+
+				void writeStoredBlocks(const uint8_t* data, size_t size, bool final)
+				{
+					writeStored(data, size, final);
+				}
+
+				// Empty stored block: ends the segment on a byte boundary
+				void syncFlush()
+				{
+					writeStored(nullptr, 0, false);
+				}
+
+				void finish()
+				{
+					_bits.align();
+				}
+			};
+		}
+
+		namespace
+		{
+			// LSB first bit reading, past the end of the input it reads zeros (see overflowed)
+			class BitReader
+			{
+			protected:
+
+				const uint8_t* _p;
+				const uint8_t* _end;
+				uint64_t _bits = 0;
+				uint32_t _count = 0;
+				// Zero bytes loaded past the end
+				size_t _overrun = 0;
+
+				void refill()
+				{
+					while (_count <= 56)
+					{
+						uint64_t b = 0;
+						if (_p < _end)
+						{
+							b = *_p++;
+						}
+						else
+						{
+							++_overrun;
+						}
+						_bits |= b << _count;
+						_count += 8;
+					}
+				}
+
+			public:
+
+				BitReader(const uint8_t* src, size_t size) :
+					_p(src),
+					_end(src + size)
+				{}
+
+				// n <= 32
+				uint32_t peek(uint32_t n)
+				{
+					if (_count < n)
+					{
+						refill();
+					}
+					return uint32_t(_bits & ((uint64_t(1) << n) - 1));
+				}
+
+				void consume(uint32_t n)
+				{
+					_bits >>= n;
+					_count -= n;
+				}
+
+				uint32_t get(uint32_t n)
+				{
+					const uint32_t v = peek(n);
+					consume(n);
+					return v;
+				}
+
+				// More bits were consumed than the input has
+				bool overflowed() const
+				{
+					return _overrun * 8 > _count;
+				}
+
+				// Drops the bits up to the byte boundary, then returns the next size bytes (nullptr if the input is too short)
+				const uint8_t* alignedBytes(size_t size)
+				{
+					consume(_count % 8);
+					const size_t buffered = _count / 8;
+					if (buffered < _overrun)
+					{
+						return nullptr;
+					}
+					const uint8_t* q = _p - (buffered - _overrun);
+					if (size_t(_end - q) < size)
+					{
+						return nullptr;
+					}
+					_p = q + size;
+					_bits = 0;
+					_count = 0;
+					_overrun = 0;
+					return q;
+				}
+			};
+
+			// Canonical Huffman decoding: a table on the first PrimaryBits bits, the longer codes are decoded bit by bit
+			constexpr const uint32_t PrimaryBits = 10;
+
+			struct HuffmanDecoder
+			{
+				// Number of codes per length
+				uint16_t count[16] = {};
+				// Symbols sorted by code
+				uint16_t symbol[288] = {};
+				// (symbol << 4) | length, length 0 for the codes longer than PrimaryBits
+				uint16_t table[1 << PrimaryBits] = {};
+
+				// Returns false if the code is over-subscribed (incomplete codes are accepted, their unused codes are errors)
+				bool build(const uint8_t* lengths, uint32_t n)
+				{
+					std::fill_n(count, 16, uint16_t(0));
+					for (uint32_t i = 0; i < n; ++i)
+					{
+						++count[lengths[i]];
+					}
+					count[0] = 0;
+					int left = 1;
+					for (uint32_t l = 1; l < 16; ++l)
+					{
+						left = (left << 1) - count[l];
+						if (left < 0)
+						{
+							return false;
+						}
+					}
+					uint16_t offsets[16] = {};
+					for (uint32_t l = 1; l < 15; ++l)
+					{
+						offsets[l + 1] = offsets[l] + count[l];
+					}
+					for (uint32_t i = 0; i < n; ++i)
+					{
+						if (lengths[i])
+						{
+							symbol[offsets[lengths[i]]++] = uint16_t(i);
+						}
+					}
+					std::fill_n(table, 1 << PrimaryBits, uint16_t(0));
+					uint32_t code = 0;
+					uint32_t index = 0;
+					for (uint32_t l = 1; l <= PrimaryBits; ++l)
+					{
+						for (uint32_t k = 0; k < count[l]; ++k, ++code, ++index)
+						{
+							uint32_t r = 0;
+							for (uint32_t b = 0; b < l; ++b)
+							{
+								r |= ((code >> b) & 1) << (l - 1 - b);
+							}
+							for (; r < (1u << PrimaryBits); r += (1u << l))
+							{
+								table[r] = uint16_t((symbol[index] << 4) | l);
+							}
+						}
+						code <<= 1;
+					}
+					return true;
+				}
+
+				// Returns -1 for an invalid code
+				int decode(BitReader& bits) const
+				{
+					const uint16_t entry = table[bits.peek(PrimaryBits)];
+					if (entry & 15)
+					{
+						bits.consume(entry & 15);
+						return entry >> 4;
+					}
+					int code = 0, first = 0, index = 0;
+					for (uint32_t l = 1; l < 16; ++l)
+					{
+						code |= int(bits.get(1));
+						const int c = count[l];
+						if (code - c < first)
+						{
+							return symbol[index + (code - first)];
+						}
+						index += c;
+						first = (first + c) << 1;
+						code <<= 1;
+					}
+					return -1;
+				}
+			};
+
+			struct FixedDecoders
+			{
+				HuffmanDecoder litlen;
+				HuffmanDecoder dist;
+
+				FixedDecoders()
+				{
+					Tables const& t = GetTables();
+					litlen.build(t.fixed_litlen, 288);
+					dist.build(t.fixed_dist, DistCodes);
+				}
+			};
+		}
+
+		void Compress(const uint8_t* src, size_t src_size, CompressInfo const& info, std::vector<uint8_t>& dst)
+		{
+			BlockWriter writer(dst);
+			const int level = std::clamp(info.level, 0, 9);
+			if (level == 0)
+			{
+				writer.writeStoredBlocks(src, src_size, info.final);
+			}
+			else if (info.rle)
+			{
+				const size_t dict = std::min<size_t>(info.dictionary_size, 1);
+				const uint8_t* base = src - dict;
+				const size_t total = dict + src_size;
+				std::vector<Symbol> symbols;
+				symbols.reserve(MaxBlockSymbols);
+				size_t block_start = dict;
+				size_t p = dict;
+				while (p < total)
+				{
+					uint32_t len = 0;
+					if (p > 0)
+					{
+						const uint8_t previous = base[p - 1];
+						const uint32_t max_len = uint32_t(std::min<size_t>(MaxMatch, total - p));
+						while (len < max_len && base[p + len] == previous)
+						{
+							++len;
+						}
+					}
+					if (len >= MinMatch)
+					{
+						symbols.push_back(Symbol{uint16_t(len), 1});
+						p += len;
+					}
+					else
+					{
+						symbols.push_back(Symbol{base[p], 0});
+						++p;
+					}
+					if (symbols.size() >= MaxBlockSymbols && p < total)
+					{
+						writer.writeBlock(symbols, base + block_start, p - block_start, false);
+						symbols.clear();
+						block_start = p;
+					}
+				}
+				writer.writeBlock(symbols, base + block_start, p - block_start, info.final);
+			}
+			else
+			{
+				const LevelParams params = Levels[level];
+				const size_t dict = std::min<size_t>(info.dictionary_size, WindowSize);
+				const uint8_t* base = src - dict;
+				const size_t total = dict + src_size;
+
+				std::vector<int32_t> head(size_t(1) << HashBits, -1);
+				std::vector<int32_t> prev(WindowSize, -1);
+				const auto hash = [&](size_t p)
+				{
+					const uint32_t v = uint32_t(base[p]) | (uint32_t(base[p + 1]) << 8) | (uint32_t(base[p + 2]) << 16);
+					return (v * 2654435761u) >> (32 - HashBits);
+				};
+				// Positions < inserted are in the hash chains
+				size_t inserted = 0;
+				const auto insert_until = [&](size_t end)
+				{
+					end = std::min(end, total >= MinMatch ? total - MinMatch + 1 : 0);
+					for (; inserted < end; ++inserted)
+					{
+						const uint32_t h = hash(inserted);
+						prev[inserted & WindowMask] = head[h];
+						head[h] = int32_t(inserted);
+					}
+				};
+				// p must not be inserted yet
+				const auto find = [&](size_t p, uint32_t chain, uint32_t& best_dist) -> uint32_t
+				{
+					const uint32_t max_len = uint32_t(std::min<size_t>(MaxMatch, total - p));
+					if (max_len < MinMatch)
+					{
+						return 0;
+					}
+					const uint8_t* b = base + p;
+					int32_t cand = head[hash(p)];
+					uint32_t best_len = MinMatch - 1;
+					while (cand >= 0 && chain-- > 0)
+					{
+						const size_t dist = p - size_t(cand);
+						if (dist > WindowSize)
+						{
+							break;
+						}
+						const uint8_t* a = base + cand;
+						if (a[best_len] == b[best_len] && a[0] == b[0] && a[1] == b[1])
+						{
+							uint32_t l = 2;
+							while (l < max_len && a[l] == b[l])
+							{
+								++l;
+							}
+							if (l > best_len)
+							{
+								best_len = l;
+								best_dist = uint32_t(dist);
+								if (l >= params.nice_length || l == max_len)
+								{
+									break;
+								}
+							}
+						}
+						const int32_t next = prev[cand & WindowMask];
+						if (next >= cand)
+						{
+							break;
+						}
+						cand = next;
+					}
+					if (best_len < MinMatch || (best_len == MinMatch && best_dist > TooFar))
+					{
+						return 0;
+					}
+					return best_len;
+				};
+
+				insert_until(dict);
+				std::vector<Symbol> symbols;
+				symbols.reserve(MaxBlockSymbols);
+				size_t block_start = dict;
+				size_t p = dict;
+				while (p < total)
+				{
+					uint32_t dist = 0;
+					uint32_t len = find(p, params.max_chain, dist);
+					if (len && params.lazy)
+					{
+						// One step lazy evaluation: a longer match at the next position wins
+						while (len < params.max_lazy && p + 1 < total)
+						{
+							insert_until(p + 1);
+							uint32_t dist2 = 0;
+							const uint32_t len2 = find(p + 1, len >= params.good_length ? params.max_chain >> 2 : params.max_chain, dist2);
+							if (len2 <= len)
+							{
+								break;
+							}
+							symbols.push_back(Symbol{base[p], 0});
+							++p;
+							len = len2;
+							dist = dist2;
+						}
+					}
+					if (len)
+					{
+						symbols.push_back(Symbol{uint16_t(len), uint16_t(dist)});
+						if (params.lazy || len <= params.max_lazy)
+						{
+							insert_until(p + len);
+						}
+						else
+						{
+							insert_until(p + 1);
+							inserted = std::max(inserted, p + len);
+						}
+						p += len;
+					}
+					else
+					{
+						symbols.push_back(Symbol{base[p], 0});
+						insert_until(p + 1);
+						++p;
+					}
+					if (symbols.size() >= MaxBlockSymbols && p < total)
+					{
+						writer.writeBlock(symbols, base + block_start, p - block_start, false);
+						symbols.clear();
+						block_start = p;
+					}
+				}
+				writer.writeBlock(symbols, base + block_start, p - block_start, info.final);
+			}
+			if (!info.final)
+			{
+				writer.syncFlush();
+			}
+			writer.finish();
+		}
+
+		Result Decompress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_size)
+		{
+			static const FixedDecoders fixed;
+			BitReader bits(src, src_size);
+			uint8_t* out = dst;
+			uint8_t* const out_end = dst + dst_size;
+			HuffmanDecoder litlen, dist;
+			bool final = false;
+			while (!final)
+			{
+				final = bits.get(1) != 0;
+				const uint32_t type = bits.get(2);
+				if (bits.overflowed())
+				{
+					return Result::WrongFileFormat;
+				}
+				if (type == 0)
+				{
+					const uint8_t* header = bits.alignedBytes(4);
+					if (!header)
+					{
+						return Result::WrongFileFormat;
+					}
+					const uint32_t len = uint32_t(header[0]) | (uint32_t(header[1]) << 8);
+					const uint32_t nlen = uint32_t(header[2]) | (uint32_t(header[3]) << 8);
+					if ((len ^ 0xFFFF) != nlen || size_t(out_end - out) < len)
+					{
+						return Result::WrongFileFormat;
+					}
+					const uint8_t* data = bits.alignedBytes(len);
+					if (!data)
+					{
+						return Result::WrongFileFormat;
+					}
+					if (len)
+					{
+						std::memcpy(out, data, len);
+						out += len;
+					}
+					continue;
+				}
+				const HuffmanDecoder* ll = &fixed.litlen;
+				const HuffmanDecoder* dd = &fixed.dist;
+				if (type == 2)
+				{
+					const uint32_t hlit = bits.get(5) + 257;
+					const uint32_t hdist = bits.get(5) + 1;
+					const uint32_t hclen = bits.get(4) + 4;
+					if (hlit > LitLenCodes || hdist > DistCodes)
+					{
+						return Result::WrongFileFormat;
+					}
+					uint8_t cl_lengths[CodeLengthCodes] = {};
+					for (uint32_t i = 0; i < hclen; ++i)
+					{
+						cl_lengths[CodeLengthOrder[i]] = uint8_t(bits.get(3));
+					}
+					HuffmanDecoder cl;
+					if (!cl.build(cl_lengths, CodeLengthCodes))
+					{
+						return Result::WrongFileFormat;
+					}
+					uint8_t lengths[LitLenCodes + DistCodes] = {};
+					for (uint32_t i = 0; i < hlit + hdist;)
+					{
+						const int symbol = cl.decode(bits);
+						if (symbol < 0 || bits.overflowed())
+						{
+							return Result::WrongFileFormat;
+						}
+						if (symbol < 16)
+						{
+							lengths[i++] = uint8_t(symbol);
+							continue;
+						}
+						uint8_t value = 0;
+						uint32_t repeat = 0;
+						if (symbol == 16)
+						{
+							if (i == 0)
+							{
+								return Result::WrongFileFormat;
+							}
+							value = lengths[i - 1];
+							repeat = 3 + bits.get(2);
+						}
+						else if (symbol == 17)
+						{
+							repeat = 3 + bits.get(3);
+						}
+						else
+						{
+							repeat = 11 + bits.get(7);
+						}
+						if (i + repeat > hlit + hdist)
+						{
+							return Result::WrongFileFormat;
+						}
+						std::fill_n(lengths + i, repeat, value);
+						i += repeat;
+					}
+					if (lengths[EndOfBlock] == 0 || !litlen.build(lengths, hlit) || !dist.build(lengths + hlit, hdist))
+					{
+						return Result::WrongFileFormat;
+					}
+					ll = &litlen;
+					dd = &dist;
+				}
+				else if (type != 1)
+				{
+					return Result::WrongFileFormat;
+				}
+
+				while (true)
+				{
+					int symbol = ll->decode(bits);
+					if (symbol < 0 || bits.overflowed())
+					{
+						return Result::WrongFileFormat;
+					}
+					if (symbol < 256)
+					{
+						if (out == out_end)
+						{
+							return Result::WrongFileFormat;
+						}
+						*out++ = uint8_t(symbol);
+					}
+					else if (symbol == EndOfBlock)
+					{
+						break;
+					}
+					else
+					{
+						symbol -= 257;
+						if (symbol >= 29)
+						{
+							return Result::WrongFileFormat;
+						}
+						const size_t len = LengthBase[symbol] + bits.get(LengthExtra[symbol]);
+						const int ds = dd->decode(bits);
+						if (ds < 0 || ds >= int(DistCodes))
+						{
+							return Result::WrongFileFormat;
+						}
+						const size_t distance = DistBase[ds] + bits.get(DistExtra[ds]);
+						if (distance > size_t(out - dst) || len > size_t(out_end - out))
+						{
+							return Result::WrongFileFormat;
+						}
+						const uint8_t* from = out - distance;
+						if (distance >= len)
+						{
+							std::memcpy(out, from, len);
+						}
+						else
+						{
+							// Overlapping copy: repeats the last distance bytes
+							for (size_t i = 0; i < len; ++i)
+							{
+								out[i] = from[i];
+							}
+						}
+						out += len;
+					}
+				}
+			}
+			if (bits.overflowed() || out != out_end)
+			{
+				return Result::WrongFileFormat;
+			}
+			return Result::Success;
+		}
+
+		void ZlibHeader(int level, uint8_t header[2])
+		{
+			// FLEVEL from the level, FCHECK makes the header a multiple of 31
+			const uint32_t flevel = level < 2 ? 0 : (level < 6 ? 1 : (level == 6 ? 2 : 3));
+			const uint32_t cmf = 0x78;
+			uint32_t flg = flevel << 6;
+			flg += 31 - ((cmf * 256 + flg) % 31);
+			header[0] = uint8_t(cmf);
+			header[1] = uint8_t(flg);
+		}
+
+		void ZlibCompress(const uint8_t* src, size_t src_size, int level, std::vector<uint8_t>& dst)
+		{
+			uint8_t header[2];
+			ZlibHeader(level, header);
+			dst.insert(dst.end(), header, header + 2);
+			Compress(src, src_size, CompressInfo{.level = level}, dst);
+			const uint32_t adler = Adler32(src, src_size);
+			const uint8_t trailer[4] = {uint8_t(adler >> 24), uint8_t(adler >> 16), uint8_t(adler >> 8), uint8_t(adler)};
+			dst.insert(dst.end(), trailer, trailer + 4);
+		}
+
+		Result ZlibDecompress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_size)
+		{
+			if (src_size < 6)
+			{
+				return Result::WrongFileFormat;
+			}
+			const uint32_t cmf = src[0];
+			const uint32_t flg = src[1];
+			// Deflate, window <= 32KB, no preset dictionary
+			if ((cmf & 0x0F) != 8 || (cmf >> 4) > 7 || (cmf * 256 + flg) % 31 != 0 || (flg & 0x20))
+			{
+				return Result::WrongFileFormat;
+			}
+			Result result = Decompress(src + 2, src_size - 6, dst, dst_size);
+			if (result == Result::Success)
+			{
+				const uint8_t* t = src + src_size - 4;
+				const uint32_t adler = (uint32_t(t[0]) << 24) | (uint32_t(t[1]) << 16) | (uint32_t(t[2]) << 8) | uint32_t(t[3]);
+				if (adler != Adler32(dst, dst_size))
+				{
+					result = Result::WrongFileFormat;
+				}
+			}
+			return result;
+		}
+
+		uint32_t Adler32(const uint8_t* data, size_t size, uint32_t adler)
+		{
+			constexpr const uint32_t Base = 65521;
+			// Largest n such that the sums don't overflow
+			constexpr const size_t NMax = 5552;
+			uint32_t a = adler & 0xFFFF;
+			uint32_t b = adler >> 16;
+			while (size > 0)
+			{
+				const size_t n = std::min(size, NMax);
+				for (size_t i = 0; i < n; ++i)
+				{
+					a += data[i];
+					b += a;
+				}
+				a %= Base;
+				b %= Base;
+				data += n;
+				size -= n;
+			}
+			return a | (b << 16);
+		}
+
+		uint32_t Adler32Combine(uint32_t adler1, uint32_t adler2, size_t size2)
+		{
+			constexpr const uint64_t Base = 65521;
+			const uint64_t rem = size2 % Base;
+			uint64_t sum1 = adler1 & 0xFFFF;
+			uint64_t sum2 = (rem * sum1) % Base;
+			sum1 += (adler2 & 0xFFFF) + Base - 1;
+			sum2 += (adler1 >> 16) + (adler2 >> 16) + Base - rem;
+			sum1 %= Base;
+			sum2 %= Base;
+			return uint32_t(sum1 | (sum2 << 16));
+		}
+
+		uint32_t CRC32(const uint8_t* data, size_t size, uint32_t crc)
+		{
+			const auto& t = GetTables().crc;
+			crc = ~crc;
+			// Slicing by 8
+			while (size >= 8)
+			{
+				const uint32_t one = (uint32_t(data[0]) | (uint32_t(data[1]) << 8) | (uint32_t(data[2]) << 16) | (uint32_t(data[3]) << 24)) ^ crc;
+				crc = t[7][one & 0xFF] ^ t[6][(one >> 8) & 0xFF] ^ t[5][(one >> 16) & 0xFF] ^ t[4][one >> 24] ^
+					t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+				data += 8;
+				size -= 8;
+			}
+			for (size_t i = 0; i < size; ++i)
+			{
+				crc = t[0][(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+			}
+			return ~crc;
+		}
+	}
+}
@@ -0,0 +1,235 @@
+#include <that/utils/LZ4.hpp>
+
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+namespace that
+{
+	namespace lz4
+	{
+		namespace
+		{
+			constexpr const size_t MinMatch = 4;
+			// The last match must start at least 12 bytes before the end, the last 5 bytes are always literals
+			constexpr const size_t MFLimit = 12;
+			constexpr const size_t LastLiterals = 5;
+			constexpr const size_t MaxDistance = 65535;
+			constexpr const uint32_t HashLog = 12;
+
+			uint32_t Read32(const uint8_t* p)
+			{
+				uint32_t v;
+				std::memcpy(&v, p, sizeof(v));
+				return v;
+			}
+
+			uint32_t Hash(uint32_t sequence)
+			{
+				return (sequence * 2654435761u) >> (32 - HashLog);
+			}
+
+			// 15 in the token, then bytes of 255
+			uint8_t* WriteLength(uint8_t* op, size_t length)
+			{
+				for (; length >= 255; length -= 255)
+				{
+					*op++ = 255;
+				}
+				*op++ = uint8_t(length);
+				return op;
+			}
+
+			size_t LengthSize(size_t length)
+			{
+				return length >= 15 ? (length - 15) / 255 + 1 : 0;
+			}
+		}
+
+		size_t Compress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t capacity, uint32_t acceleration)
+		{
+			const uint8_t* ip = src;
+			const uint8_t* anchor = src;
+			const uint8_t* const iend = src + src_size;
+			uint8_t* op = dst;
+			uint8_t* const oend = dst + capacity;
+			acceleration = std::max<uint32_t>(acceleration, 1);
+
+			const auto emit_sequence = [&](const uint8_t* literals, size_t literal_length, size_t offset, size_t match_length) -> bool
+			{
+				const size_t ml = match_length - MinMatch;
+				const size_t needed = 1 + LengthSize(literal_length) + literal_length + 2 + LengthSize(ml);
+				if (size_t(oend - op) < needed)
+				{
+					return false;
+				}
+				uint8_t* token = op++;
+				*token = uint8_t(std::min<size_t>(literal_length, 15) << 4);
+				if (literal_length >= 15)
+				{
+					op = WriteLength(op, literal_length - 15);
+				}
+				std::memcpy(op, literals, literal_length);
+				op += literal_length;
+				*op++ = uint8_t(offset);
+				*op++ = uint8_t(offset >> 8);
+				*token |= uint8_t(std::min<size_t>(ml, 15));
+				if (ml >= 15)
+				{
+					op = WriteLength(op, ml - 15);
+				}
+				return true;
+			};
+
+			if (src_size > MFLimit)
+			{
+				// Positions (from src) of the last occurrence of each hashed sequence
+				std::vector<uint32_t> table(size_t(1) << HashLog, 0);
+				const uint8_t* const match_limit = iend - MFLimit;
+				const uint8_t* const match_end_limit = iend - LastLiterals;
+				++ip;
+				while (ip < match_limit)
+				{
+					// Skips faster and faster in incompressible data
+					uint32_t search = acceleration << 6;
+					const uint8_t* match = nullptr;
+					while (true)
+					{
+						const uint32_t h = Hash(Read32(ip));
+						const uint8_t* candidate = src + table[h];
+						table[h] = uint32_t(ip - src);
+						if (candidate < ip && size_t(ip - candidate) <= MaxDistance && Read32(candidate) == Read32(ip))
+						{
+							match = candidate;
+							break;
+						}
+						ip += (search++ >> 6);
+						if (ip >= match_limit)
+						{
+							break;
+						}
+					}
+					if (!match)
+					{
+						break;
+					}
+					// Extends backward and forward
+					while (ip > anchor && match > src && ip[-1] == match[-1])
+					{
+						--ip;
+						--match;
+					}
+					const uint8_t* m = ip + MinMatch;
+					const uint8_t* r = match + MinMatch;
+					while (m < match_end_limit && *m == *r)
+					{
+						++m;
+						++r;
+					}
+					if (!emit_sequence(anchor, size_t(ip - anchor), size_t(ip - match), size_t(m - ip)))
+					{
+						return 0;
+					}
+					ip = m;
+					anchor = ip;
+					if (ip < match_limit)
+					{
+						table[Hash(Read32(ip - 2))] = uint32_t(ip - 2 - src);
+					}
+				}
+			}
+
+			// Last literals
+			const size_t literal_length = size_t(iend - anchor);
+			if (size_t(oend - op) < 1 + LengthSize(literal_length) + literal_length)
+			{
+				return 0;
+			}
+			*op++ = uint8_t(std::min<size_t>(literal_length, 15) << 4);
+			if (literal_length >= 15)
+			{
+				op = WriteLength(op, literal_length - 15);
+			}
+			std::memcpy(op, anchor, literal_length);
+			op += literal_length;
+			return size_t(op - dst);
+		}
+
+		Result Decompress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_size)
+		{
+			const uint8_t* ip = src;
+			const uint8_t* const iend = src + src_size;
+			uint8_t* op = dst;
+			uint8_t* const oend = dst + dst_size;
+
+			const auto read_length = [&](size_t& length) -> bool
+			{
+				uint8_t b;
+				do
+				{
+					if (ip == iend)
+					{
+						return false;
+					}
+					b = *ip++;
+					length += b;
+				} while (b == 255);
+				return true;
+			};
+
+			while (ip < iend)
+			{
+				const uint8_t token = *ip++;
+				size_t literal_length = token >> 4;
+				if (literal_length == 15 && !read_length(literal_length))
+				{
+					return Result::WrongFileFormat;
+				}
+				if (size_t(iend - ip) < literal_length || size_t(oend - op) < literal_length)
+				{
+					return Result::WrongFileFormat;
+				}
+				std::memcpy(op, ip, literal_length);
+				ip += literal_length;
+				op += literal_length;
+				if (ip == iend)
+				{
+					// The last sequence has no match
+					break;
+				}
+
+				if (iend - ip < 2)
+				{
+					return Result::WrongFileFormat;
+				}
+				const size_t offset = size_t(ip[0]) | (size_t(ip[1]) << 8);
+				ip += 2;
+				size_t match_length = token & 15;
+				if (match_length == 15 && !read_length(match_length))
+				{
+					return Result::WrongFileFormat;
+				}
+				match_length += MinMatch;
+				if (offset == 0 || offset > size_t(op - dst) || size_t(oend - op) < match_length)
+				{
+					return Result::WrongFileFormat;
+				}
+				const uint8_t* match = op - offset;
+				if (offset >= match_length)
+				{
+					std::memcpy(op, match, match_length);
+					op += match_length;
+				}
+				else
+				{
+					// Overlapping copy (repeats the last offset bytes)
+					for (size_t i = 0; i < match_length; ++i)
+					{
+						*op++ = *match++;
+					}
+				}
+			}
+			return op == oend ? Result::Success : Result::WrongFileFormat;
+		}
+	}
+}
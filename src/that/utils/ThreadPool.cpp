@@ -0,0 +1,136 @@
+#include <that/utils/ThreadPool.hpp>
+
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+namespace that
+{
+	ThreadPool::ThreadPool() :
+		ThreadPool(CreateInfo{})
+	{}
+
+	ThreadPool::ThreadPool(CreateInfo const& ci)
+	{
+		uint32_t n = ci.threads;
+		if (n == 0)
+		{
+			n = std::max<uint32_t>(std::thread::hardware_concurrency(), 1);
+		}
+		_threads.reserve(n);
+		for (uint32_t i = 0; i < n; ++i)
+		{
+			_threads.emplace_back([this]() {workerLoop(); });
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::unique_lock lock(_mutex);
+			_stop = true;
+		}
+		_condition.notify_all();
+		for (std::thread& t : _threads)
+		{
+			t.join();
+		}
+	}
+
+	void ThreadPool::workerLoop()
+	{
+		while (true)
+		{
+			Task task;
+			{
+				std::unique_lock lock(_mutex);
+				_condition.wait(lock, [this]() {return _stop || !_tasks.empty(); });
+				if (_tasks.empty())
+				{
+					// _stop and nothing left to do
+					return;
+				}
+				task = std::move(_tasks.front());
+				_tasks.pop_front();
+			}
+			task();
+		}
+	}
+
+	void ThreadPool::push(Task&& task)
+	{
+		{
+			std::unique_lock lock(_mutex);
+			_tasks.push_back(std::move(task));
+		}
+		_condition.notify_one();
+	}
+
+	void ThreadPool::parallelFor(size_t count, std::function<void(size_t)> const& f)
+	{
+		if (count == 0)
+		{
+			return;
+		}
+		if (count == 1 || _threads.empty())
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				f(i);
+			}
+			return;
+		}
+
+		// Shared with the helper tasks, which may start after this function returned (when all the work was already done)
+		struct State
+		{
+			std::atomic<size_t> next = 0;
+			std::atomic<size_t> remaining = 0;
+			size_t count = 0;
+			const std::function<void(size_t)>* f = nullptr;
+		};
+		std::shared_ptr<State> state = std::make_shared<State>();
+		state->remaining = count;
+		state->count = count;
+		state->f = &f;
+
+		const auto work = [](State& s)
+		{
+			while (true)
+			{
+				const size_t i = s.next.fetch_add(1);
+				if (i >= s.count)
+				{
+					break;
+				}
+				(*s.f)(i);
+				if (s.remaining.fetch_sub(1) == 1)
+				{
+					s.remaining.notify_all();
+				}
+			}
+		};
+
+		const size_t helpers = std::min(count - 1, _threads.size());
+		for (size_t i = 0; i < helpers; ++i)
+		{
+			push([state, work]() {work(*state); });
+		}
+
+		work(*state);
+
+		// Wait for the iterations claimed by the helpers
+		size_t r = state->remaining.load();
+		while (r != 0)
+		{
+			state->remaining.wait(r);
+			r = state->remaining.load();
+		}
+	}
+
+	ThreadPool& ThreadPool::Default()
+	{
+		static ThreadPool pool;
+		return pool;
+	}
+}